@@ -33,7 +33,7 @@ public:
 	void DoMWD();
 	
 	// Set functions
-	inline void SetTrace( std::vector<unsigned short> t ){ trace = t; };
+	inline void SetTrace( const std::vector<unsigned short> &t ){ trace = t; };
 	inline void SetRiseTime( unsigned int t ){ rise_time = t; };
 	inline void SetDecayTime( float t ){ decay_time = t; };
 	inline void SetFlatTop( unsigned int t ){ flat_top = t; };
@@ -141,7 +141,7 @@ public:
 	float FebexEnergy( unsigned int sfp, unsigned int board, unsigned int ch, unsigned int raw );
 	unsigned int FebexThreshold( unsigned int sfp, unsigned int board, unsigned int ch );
 	long FebexTime( unsigned int sfp, unsigned int board, unsigned int ch );
-	FebexMWD DoMWD( unsigned int sfp, unsigned int board, unsigned int ch, std::vector<unsigned short> trace );
+	FebexMWD DoMWD( unsigned int sfp, unsigned int board, unsigned int ch, const std::vector<unsigned short> &trace );
 
 	
 private:
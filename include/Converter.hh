@@ -2,6 +2,7 @@
 #define __CONVERTER_HH
 
 #include <bitset>
+#include <chrono>
 #include <memory>
 #include <fstream>
 #include <iostream>
@@ -34,6 +35,26 @@
 # include "DataPackets.hh"
 #endif
 
+// Block index header
+#ifndef __DATAINDEX_HH
+# include "DataIndex.hh"
+#endif
+
+// Hit buffer header
+#ifndef __HITBUFFER_HH
+# include "HitBuffer.hh"
+#endif
+
+// Hit file header
+#ifndef __HITFILE_HH
+# include "HitFile.hh"
+#endif
+
+// Hit queue header
+#ifndef __HITQUEUE_HH
+# include "HitQueue.hh"
+#endif
+
 
 class MiniballConverter {
 	
@@ -46,23 +67,64 @@ public:
 	void ResetHists();
 	void MakeTree();
 	void StartFile();
+	void PrintWaitTime( double wait_time );
+
+	// Index of the blocks in the input file
+	bool StartIndex( std::string input_file_name );
+	void FinishIndex();
+	void StartIndexEntry( unsigned long long offset,
+						  unsigned long long block,
+						  unsigned long long event = 0 );
+	void FinishIndexEntry();
+	inline void IndexTime( unsigned long long t ){
+		if( !flag_index ) return;
+		if( t < index_entry.first_time ) index_entry.first_time = t;
+		if( t > index_entry.last_time ) index_entry.last_time = t;
+	};
+	inline void IndexHit( unsigned char sfp, unsigned long long t ){
+		if( !flag_index ) return;
+		IndexTime( t );
+		if( sfp < 4 ) index_entry.hits[sfp]++;
+	};
+	void RestoreIndexEntry( const MiniballDataIndexEntry &entry );
 	unsigned long long SortTree();
 
 	void SetOutput( std::string output_file_name );
 	
 	inline void CloseOutput(){
 		std::cout << "\n Writing data and closing the file" << std::endl;
+		hits.Flush();
+		sorted_tree = hits.GetTree();
+		hit_file.Close();
 		output_file->Write( 0, TObject::kWriteDelete );
 		output_file->Close();
 	};
 	inline TFile* GetFile(){ return output_file; };
-	inline TTree* GetTree(){ return output_tree; };
 	inline TTree* GetMbsInfo(){ return mbsinfo_tree; };
 	inline TTree* GetSortedTree(){ return sorted_tree; };
 
+	// Empty the sorted tree once its hits have been used, like the monitor does
+	inline void ResetSortedTree(){
+		if( sorted_tree ) sorted_tree->Reset();
+		hit_file.Rewind();
+		hits.ResetOrder();
+	};
+
 	inline void AddCalibration( std::shared_ptr<MiniballCalibration> mycal ){ cal = mycal; };
 	inline void SourceOnly(){ flag_source = true; };
 
+	// Pass the sorted hits straight to an event builder through a queue,
+	// set before MakeTree. The sorted tree is then only written if the
+	// settings ask for it
+	inline void SetHitQueue( MiniballHitQueue *q ){
+		hit_queue = q;
+		hits.SetHitQueue( q );
+	};
+	inline void SetNumberOfThreads( int n ){
+		nthreads = n > 0 ? n : 1;
+		hits.SetThreads( nthreads );
+	};
+
 	inline void AddProgressBar( std::shared_ptr<TGProgressBar> myprog ){
 		prog = myprog;
 		_prog_ = true;
@@ -75,6 +137,18 @@ protected:
 	// Flag for source run
 	bool flag_source;
 
+	// Number of threads used to decode the data
+	unsigned int nthreads;
+
+	// Index of the blocks that is written during the conversion
+	MiniballDataIndex index;
+	MiniballDataIndexEntry index_entry;
+	bool flag_index;		///< true when writing an index
+	bool flag_index_entry;	///< true when an entry is being filled
+
+	// When the conversion of the current file started
+	std::chrono::steady_clock::time_point start_time;
+
 	// Logs
 	std::stringstream sslogs;
 	
@@ -112,6 +186,16 @@ protected:
 
 	// For traces
 	unsigned int nsamples;
+	std::vector<unsigned short> trace_samples; ///< reused for every trace
+	bool KeepTrace( unsigned char sfp, unsigned char board, unsigned char ch );
+
+	// Unpack the samples of a trace in bulk. MIDAS words have four 14-bit
+	// samples each, highest first, and MBS words have two samples, lowest
+	// first, with 12 or 14 bits given by the mask
+	static void UnpackSamples64( const ULong64_t *words, UInt_t nwords,
+								 unsigned short *samples );
+	static void UnpackSamples32( const UInt_t *words, UInt_t nwords,
+								 UShort_t mask, unsigned short *samples );
 
 
 	
@@ -123,14 +207,17 @@ protected:
 	
 	// Output stuff
 	TFile *output_file;
-	TTree *output_tree;
 	TTree *sorted_tree;
 	TTree *mbsinfo_tree;
+	MiniballHitBuffer hits;		///< puts the hits in time order for sorted_tree
+	MiniballHitFile hit_file;	///< binary copy of sorted_tree for the event builder
+	MiniballHitQueue *hit_queue;	///< sorted hits to an event builder on another thread
 
 	// Counters
 	std::vector<std::vector<unsigned long>> ctr_febex_hit;		// hits on each Febex module
 	std::vector<std::vector<unsigned long>> ctr_febex_pause;   	// pause acq for module
 	std::vector<std::vector<unsigned long>> ctr_febex_resume;  	// resume acq for module
+	std::vector<std::vector<std::vector<unsigned long>>> ctr_febex_trace;	// traces from each channel, for downscaling
 	unsigned long ctr_febex_ext;								// pulser timestamps
 
 	// Histograms
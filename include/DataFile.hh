@@ -0,0 +1,136 @@
+// A class to map a raw data file into memory and hand out
+// pointers to its blocks without copying them. A background
+// thread reads ahead of the blocks that have been asked for,
+// so that the decoding doesn't have to wait for the disk.
+// Files compressed with gzip or zstd are decompressed on the
+// same thread in to a ring of chunks instead of being mapped
+
+#ifndef __DATAFILE_HH
+#define __DATAFILE_HH
+
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+class MiniballDataFile {
+
+public:
+
+	MiniballDataFile();
+	~MiniballDataFile();
+
+	// Open and close functions
+	bool Open( std::string _filename );
+	void Close();
+
+	// Map any data that was added to the file since it was opened.
+	// Returns true if the file grew, in which case pointers from
+	// before are no longer valid and have to be got again
+	bool Refresh();
+
+	inline bool IsOpen(){ return fd >= 0; };
+	inline bool IsCompressed(){ return compressed; };
+	inline std::string GetFileName(){ return filename; };
+
+	// Size of the mapped file in bytes. For a compressed file this
+	// is only known once all of it has been decompressed
+	inline unsigned long long GetSize(){ return len; };
+
+	// Pointer to the start of the mapping, nullptr if compressed
+	inline const char* GetData(){ return ptr; };
+
+	// Pointer to the block of a given size at a given offset,
+	// or nullptr if the block is not completely inside the file.
+	// Waits for the read ahead to get there if it hasn't already
+	const char* GetBlock( unsigned long long offset,
+						  unsigned long long size );
+
+	// Check that the file has data up to a given offset, waiting
+	// for it to be decompressed if we don't know yet
+	bool IsAvailable( unsigned long long end );
+
+	// Say that nothing before this offset will be asked for again,
+	// so that the decompressor can reuse the space for it, or the
+	// pages of a mapped file can be dropped from memory
+	void Release( unsigned long long offset );
+
+	// Percentage of the file that has been read so far
+	float GetProgress();
+
+	// Blocks asked for from a compressed file must not cross the
+	// boundary between two chunks, so the chunks are made a whole
+	// number of blocks. Must be set before the file is opened
+	inline void SetBlockSize( unsigned long long bytes ){ block_size = bytes; };
+
+	// Time in seconds that GetBlock spent waiting for data to be read
+	inline double GetWaitTime(){ return wait_time; };
+
+	// How far to read ahead of the last block that was asked for
+	inline void SetReadAhead( unsigned long long bytes ){ ra_window = bytes; };
+
+	// Tell the kernel that we will soon need the start of another file,
+	// so it can be reading it while we are still busy with this one
+	static void WillNeed( std::string _filename,
+						  unsigned long long bytes = 0x4000000 );
+
+private:
+
+	std::string filename;
+	int fd;				///< file descriptor of the open file
+	const char *ptr;	///< start of the read-only mapping
+	size_t len;			///< length of the file and the mapping in bytes
+
+	// Read ahead thread and the window of the file that it has read,
+	// from ra_begin to ra_ready, which is kept ra_window past ra_request
+	void ReadAhead();
+	void StartReadAhead( unsigned long long offset );
+	void StopReadAhead();
+	std::thread ra_thread;
+	std::mutex ra_mutex;
+	std::condition_variable ra_cv;
+	unsigned long long ra_begin;	///< start of the data that has been read in
+	unsigned long long ra_ready;	///< end of the data that has been read in
+	unsigned long long ra_request;	///< end of the furthest block asked for
+	unsigned long long ra_window;	///< how far ahead to read in bytes
+	bool ra_stop;					///< tells the read ahead thread to finish
+
+	double wait_time;	///< time spent waiting for the read ahead in seconds
+	unsigned long long released;	///< pages before this have been dropped
+
+	// Decompression thread, which fills a ring of chunks from ring_base
+	// to ring_end, using the same thread, mutex and flags as the read ahead
+	void Decompress();
+	bool compressed;				///< true if the file is decompressed and not mapped
+	int format;						///< compression format from the magic bytes
+	std::vector<std::vector<char>> ring;	///< ring of decompressed chunks
+	unsigned long long chunk_size;	///< size of each chunk in the ring
+	unsigned long long block_size;	///< chunks are a multiple of this size
+	unsigned long long ring_base;	///< start of the oldest chunk still needed
+	unsigned long long ring_end;	///< end of the data that has been decompressed
+	unsigned long long zpos;		///< bytes of the compressed file read so far
+	unsigned long long zlen;		///< size of the compressed file
+	bool stream_end;				///< true when everything has been decompressed
+
+	// Compression formats
+	enum format_t {
+		FORMAT_NONE = 0,
+		FORMAT_GZIP = 1,
+		FORMAT_ZSTD = 2
+	};
+
+	// Size of each read ahead step
+	static const unsigned long long RA_CHUNK = 0x100000;
+
+};
+
+#endif
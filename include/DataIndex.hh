@@ -0,0 +1,105 @@
+// A class to write and read an index of the blocks in a raw data file.
+// There is an entry for each MIDAS block or MBS buffer with the range of
+// timestamps in it and the decoder state needed to start from there
+
+#ifndef __DATAINDEX_HH
+#define __DATAINDEX_HH
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstring>
+
+
+// One entry in the index
+struct MiniballDataIndexEntry {
+	unsigned long long offset;		///< byte offset in the file to start decoding from
+	unsigned long long block;		///< MIDAS block or MBS buffer number
+	unsigned long long event;		///< first MBS event starting in this buffer
+	unsigned long long first_time;	///< earliest timestamp in the block
+	unsigned long long last_time;	///< latest timestamp in the block
+	unsigned long long tm_stp;		///< decoder timestamp at the start of the block
+	unsigned long long good_tm_stp;	///< last good MBS timestamp at the start of the block
+	unsigned long long tm_stp_msb;	///< MSB of the extended timestamp at the start
+	unsigned long long tm_stp_hsb;	///< HSB of the extended timestamp at the start
+	unsigned int hits[4];			///< number of hits in each SFP
+
+	// The FEBEX hit that is still being put together at the start of the
+	// block, since its data items can be split over two blocks
+	unsigned long long hit_time;	///< timestamp of the hit
+	unsigned long long hit_eventid;	///< event ID of the hit
+	float hit_energy;				///< energy of the hit
+	float hit_Qhalf;				///< 16-bit float charge of the hit
+	unsigned int hit_Qint;			///< 32-bit integer charge of the hit
+	unsigned short hit_Qshort;		///< 16-bit integer charge of the hit
+	unsigned char hit_sfp;			///< SFP ID of the hit
+	unsigned char hit_board;		///< board ID of the hit
+	unsigned char hit_ch;			///< channel ID of the hit
+	unsigned char hit_bits;			///< threshold, veto, fail and pile-up bits
+	unsigned char febex_flags;		///< which data items and traces were seen
+	unsigned short adc_data_lsb;	///< low half of the 32-bit charge
+	unsigned short adc_data_hsb;	///< high half of the 32-bit charge
+	float energy;					///< last calibrated energy of the decoder
+};
+
+
+class MiniballDataIndex {
+
+public:
+
+	MiniballDataIndex();
+	~MiniballDataIndex();
+
+	// Write a new index, one entry at a time
+	bool Create( std::string _filename );
+	void Add( const MiniballDataIndexEntry &entry );
+	void Close();
+
+	// Read an index back in
+	bool Read( std::string _filename );
+
+	inline unsigned long GetNumberOfEntries(){ return entries.size(); };
+	inline const MiniballDataIndexEntry& GetEntry( unsigned long i ){ return entries.at(i); };
+
+	// First timestamp in the whole file
+	unsigned long long GetFirstTime();
+
+	// Find the first and last entries that overlap with a time range, given
+	// in seconds from the start of the file, or with a range of blocks
+	bool FindTimeRange( double start, double stop,
+						unsigned long &first, unsigned long &last );
+	bool FindBlockRange( unsigned long long start, unsigned long long stop,
+						 unsigned long &first, unsigned long &last );
+
+	// Last entry at or before a given MBS event
+	bool FindEvent( unsigned long long event, unsigned long &entry );
+
+	// Name of the index file for a given data file
+	static inline std::string GetIndexName( std::string data_file_name ){
+		return data_file_name + ".idx";
+	};
+
+	// Check if an entry has any timestamps in it
+	static inline bool HasTime( const MiniballDataIndexEntry &entry ){
+		return entry.first_time <= entry.last_time;
+	};
+
+	// Reset an entry before filling it
+	static inline void ClearEntry( MiniballDataIndexEntry &entry ){
+		std::memset( &entry, 0, sizeof(entry) );
+		entry.first_time = -1;
+	};
+
+private:
+
+	std::string filename;
+	std::ofstream index_file;
+	std::vector<MiniballDataIndexEntry> entries;
+
+	// First 8 bytes of an index file, the number is the version
+	static constexpr const char *MAGIC = "MBINDEX2";
+
+};
+
+#endif
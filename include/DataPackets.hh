@@ -19,21 +19,21 @@ public:
 			  bool th, bool v, bool f, bool p );
 	~FebexData() {};
 
-	inline long long			GetTime() { return time; };
-	inline unsigned long long	GetEventID() { return eventid; };
-	inline unsigned short		GetTraceLength() { return trace.size(); };
-	inline unsigned short		GetQshort() { return Qshort; };
-	inline Float16_t			GetQhalf() { return Qhalf; };
-	inline unsigned int			GetQint() { return Qint; };
-	inline unsigned char		GetSfp() { return sfp; };
-	inline unsigned char		GetBoard() { return board; };
-	inline unsigned char		GetChannel() { return ch; };
-	inline float				GetEnergy() { return energy; };
-	inline bool					IsOverThreshold() { return thres; };
-	inline bool					IsVeto() { return veto; };
-	inline bool					IsFail() { return fail; };
-	inline bool					IsPileUp() { return pileup; };
-	inline std::vector<unsigned short> GetTrace() { return trace; };
+	inline long long			GetTime() const { return time; };
+	inline unsigned long long	GetEventID() const { return eventid; };
+	inline unsigned short		GetTraceLength() const { return trace.size(); };
+	inline unsigned short		GetQshort() const { return Qshort; };
+	inline Float16_t			GetQhalf() const { return Qhalf; };
+	inline unsigned int			GetQint() const { return Qint; };
+	inline unsigned char		GetSfp() const { return sfp; };
+	inline unsigned char		GetBoard() const { return board; };
+	inline unsigned char		GetChannel() const { return ch; };
+	inline float				GetEnergy() const { return energy; };
+	inline bool					IsOverThreshold() const { return thres; };
+	inline bool					IsVeto() const { return veto; };
+	inline bool					IsFail() const { return fail; };
+	inline bool					IsPileUp() const { return pileup; };
+	inline const std::vector<unsigned short>& GetTrace() const { return trace; };
 	inline TGraph* GetTraceGraph() {
 		std::vector<int> x, y;
 		std::string title = "Trace for SFP " + std::to_string( GetSfp() );
@@ -48,15 +48,16 @@ public:
         g.get()->SetTitle( title.data() );
 		return (TGraph*)g.get()->Clone();
 	};
-	inline unsigned short		GetSample( unsigned int i = 0 ) {
+	inline unsigned short		GetSample( unsigned int i = 0 ) const {
 		if( i >= trace.size() ) return 0;
 		return trace.at(i);
 	};
 	
 	inline void	SetTime( long long t ) { time = t; };
 	inline void	SetEventID( unsigned long long id ) { eventid = id; };
-	inline void	SetTrace( std::vector<unsigned short> t ) { trace = t; };
+	inline void	SetTrace( const std::vector<unsigned short> &t ) { trace = t; };
 	inline void AddSample( unsigned short s ) { trace.push_back(s); };
+	inline void SwapTrace( std::vector<unsigned short> &t ) { trace.swap(t); };
 	inline void	SetQshort( unsigned short q ) { Qshort = q; };
 	inline void	SetQhalf( Float16_t q ) { Qhalf = q; };
 	inline void	SetQint( unsigned int q ) { Qint = q; };
@@ -102,11 +103,11 @@ public:
 	InfoData( long long t, unsigned long long id, unsigned char s, unsigned char b, unsigned char m );
 	~InfoData() {};
 	
-	inline long long			GetTime(){ return time; };
-	inline unsigned long long	GetEventID(){ return eventid; };
-	inline unsigned char 		GetCode(){ return code; };
-	inline unsigned char		GetSfp(){ return sfp; };
-	inline unsigned char		GetBoard(){ return board; };
+	inline long long			GetTime() const { return time; };
+	inline unsigned long long	GetEventID() const { return eventid; };
+	inline unsigned char 		GetCode() const { return code; };
+	inline unsigned char		GetSfp() const { return sfp; };
+	inline unsigned char		GetBoard() const { return board; };
 
 	inline void SetTime( long long t ){ time = t; };
 	inline void SetEventID( unsigned long long id ){ eventid = id; };
@@ -139,21 +140,28 @@ public:
 	MiniballDataPackets() {};
 	~MiniballDataPackets() {};
 
-	inline bool	IsFebex() { return febex_packets.size(); };
-	inline bool	IsInfo() { return info_packets.size(); };
+	inline bool	IsFebex() const { return febex_packets.size(); };
+	inline bool	IsInfo() const { return info_packets.size(); };
 	
 	void SetData( std::shared_ptr<FebexData> data );
 	void SetData( std::shared_ptr<InfoData> data );
 
-	// These methods are not very safe for access
+	// These methods are not very safe for access, and make a copy
 	inline std::shared_ptr<FebexData> GetFebexData() { return std::make_shared<FebexData>( febex_packets.at(0) ); };
 	inline std::shared_ptr<InfoData> GetInfoData() { return std::make_shared<InfoData>( info_packets.at(0) ); };
-	
-	// Complicated way to get the time...
-	unsigned long long GetEventID();
-	long long GetTime();
-	UInt_t GetTimeMSB();
-	UInt_t GetTimeLSB();
+
+	// The data in the packet itself, without copying it. The pointers
+	// are nullptr if there's no data of that type
+	inline const FebexData& GetFebexRef() const { return febex_packets.at(0); };
+	inline const InfoData& GetInfoRef() const { return info_packets.at(0); };
+	inline FebexData* GetFebex() { return IsFebex() ? &febex_packets[0] : nullptr; };
+	inline InfoData* GetInfo() { return IsInfo() ? &info_packets[0] : nullptr; };
+
+	// Time and event ID of whichever data there is
+	unsigned long long GetEventID() const;
+	long long GetTime() const;
+	UInt_t GetTimeMSB() const;
+	UInt_t GetTimeLSB() const;
 
 	void ClearData();
 
@@ -174,8 +182,8 @@ public:
 	MBSInfoPackets() {};
 	~MBSInfoPackets() {};
 	
-	inline long long			GetTime(){ return time; };
-	inline unsigned long long	GetEventID(){ return eventid; };
+	inline long long			GetTime() const { return time; };
+	inline unsigned long long	GetEventID() const { return eventid; };
 
 	inline void SetTime( long long t ){ time = t; };
 	inline void SetEventID( unsigned long long id ){ eventid = id; };
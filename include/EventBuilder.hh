@@ -7,9 +7,12 @@
 #include <sstream>
 #include <vector>
 #include <memory>
+#include <thread>
 
+#include <TROOT.h>
 #include <TFile.h>
 #include <TTree.h>
+#include <TBranch.h>
 #include <TMath.h>
 #include <TChain.h>
 #include <TH1.h>
@@ -35,23 +38,132 @@
 # include "DataPackets.hh"
 #endif
 
+// Hit buffer header, for flat hits
+#ifndef __HITBUFFER_HH
+# include "HitBuffer.hh"
+#endif
+
+// Hit file header, to read the hits without ROOT
+#ifndef __HITFILE_HH
+# include "HitFile.hh"
+#endif
+
+// Hit queue header, to take the hits straight from the converter
+#ifndef __HITQUEUE_HH
+# include "HitQueue.hh"
+#endif
+
 // Miniball Events tree
 #ifndef __MINIBALLEVTS_HH
 # include "MiniballEvts.hh"
 #endif
 
 
+// The hits of each sort of detector in the event that is being built, with
+// an array for each part of the hit. Clear only puts the lengths back to
+// zero, so the arrays keep their space from one event to the next and
+// only grow when an event has more hits than any before it
+struct MiniballGammaHits {
+	std::vector<float>				en;		///< Miniball energies
+	std::vector<unsigned long long>	ts;		///< Miniball timestamps
+	std::vector<unsigned char>		clu;	///< cluster IDs
+	std::vector<unsigned char>		cry;	///< crystal IDs
+	std::vector<unsigned char>		seg;	///< segment IDs
+	inline unsigned int size() const { return en.size(); };
+	inline void Clear(){
+		en.clear(); ts.clear(); clu.clear(); cry.clear(); seg.clear();
+	};
+	inline void Add( float e, unsigned long long t,
+					 unsigned char c, unsigned char y, unsigned char g ){
+		en.push_back(e); ts.push_back(t); clu.push_back(c); cry.push_back(y); seg.push_back(g);
+	};
+};
+
+// The hits of an event put in to buckets, like the crystals of Miniball,
+// and kept in their order within each bucket. Set the bucket of each hit
+// in key, then Sort, which is a counting sort, so it goes through the
+// hits twice rather than comparing each one with all of the others
+struct MiniballHitBuckets {
+	std::vector<unsigned int>	key;	///< bucket of each hit
+	std::vector<unsigned int>	index;	///< hit numbers, one bucket after another
+	std::vector<unsigned int>	first;	///< first of each bucket in index, and the end
+	inline unsigned int begin( unsigned int b ) const { return first[b]; };
+	inline unsigned int end( unsigned int b ) const { return first[b+1]; };
+	inline void Sort( unsigned int nbuckets ){
+		// Count each bucket two along, so that after the running sum
+		// first[b+1] is the start of bucket b, and moves to its end as
+		// the hits are put in, which leaves first[b] at its start
+		first.assign( nbuckets + 2, 0 );
+		for( unsigned int i = 0; i < key.size(); ++i ) first[key[i]+2]++;
+		for( unsigned int b = 2; b < nbuckets + 2; ++b ) first[b] += first[b-1];
+		index.resize( key.size() );
+		for( unsigned int i = 0; i < key.size(); ++i ) index[first[key[i]+1]++] = i;
+	};
+};
+
+struct MiniballParticleHits {
+	std::vector<float>				en;		///< CD energies
+	std::vector<unsigned long long>	ts;		///< CD timestamps
+	std::vector<unsigned char>		det;	///< CD detector IDs
+	std::vector<unsigned char>		sec;	///< CD sector IDs
+	std::vector<unsigned char>		side;	///< CD side IDs; 0 = p, 1 = n
+	std::vector<unsigned char>		strip;	///< CD strip IDs
+	inline unsigned int size() const { return en.size(); };
+	inline void Clear(){
+		en.clear(); ts.clear(); det.clear(); sec.clear(); side.clear(); strip.clear();
+	};
+	inline void Add( float e, unsigned long long t, unsigned char d,
+					 unsigned char c, unsigned char s, unsigned char p ){
+		en.push_back(e); ts.push_back(t); det.push_back(d);
+		sec.push_back(c); side.push_back(s); strip.push_back(p);
+	};
+};
+
+struct MiniballBeamDumpHits {
+	std::vector<float>				en;		///< beam dump energies
+	std::vector<unsigned long long>	ts;		///< beam dump timestamps
+	std::vector<unsigned char>		det;	///< beam dump detector IDs
+	inline unsigned int size() const { return en.size(); };
+	inline void Clear(){ en.clear(); ts.clear(); det.clear(); };
+	inline void Add( float e, unsigned long long t, unsigned char d ){
+		en.push_back(e); ts.push_back(t); det.push_back(d);
+	};
+};
+
+struct MiniballSpedeHits {
+	std::vector<float>				en;		///< Spede energies
+	std::vector<unsigned long long>	ts;		///< Spede timestamps
+	std::vector<unsigned char>		seg;	///< Spede segment IDs
+	inline unsigned int size() const { return en.size(); };
+	inline void Clear(){ en.clear(); ts.clear(); seg.clear(); };
+	inline void Add( float e, unsigned long long t, unsigned char g ){
+		en.push_back(e); ts.push_back(t); seg.push_back(g);
+	};
+};
+
+struct MiniballIonChamberHits {
+	std::vector<float>				en;		///< IonChamber energies
+	std::vector<unsigned long long>	ts;		///< IonChamber timestamps
+	std::vector<unsigned char>		id;		///< IonChamber layer IDs
+	inline unsigned int size() const { return en.size(); };
+	inline void Clear(){ en.clear(); ts.clear(); id.clear(); };
+	inline void Add( float e, unsigned long long t, unsigned char l ){
+		en.push_back(e); ts.push_back(t); id.push_back(l);
+	};
+};
+
 
 class MiniballEventBuilder {
 	
 public:
 
 	MiniballEventBuilder( std::shared_ptr<MiniballSettings> myset );
-	~MiniballEventBuilder() {};
+	~MiniballEventBuilder();
 
 	void	SetInputFile( std::string input_file_name );
 	void	SetInputTree( TTree *user_tree );
 	void	SetMBSInfoTree( TTree *user_tree );
+	void	SetInputQueue( MiniballHitQueue *q );	///< hits from a converter on another thread
 	void	SetOutput( std::string output_file_name );
 	void	StartFile();	///< called for every file
 	void	Initialise();	///< called for every event
@@ -65,6 +177,10 @@ public:
 		prog = myprog;
 		_prog_ = true;
 	};
+
+	// Build slices of the run on this many threads at once. Only for
+	// input files, since each thread has to open the file for itself
+	inline void SetNumberOfThreads( int n ){ nthreads = n > 0 ? n : 1; };
 	
 	unsigned long	BuildEvents();
 
@@ -80,11 +196,14 @@ public:
 	inline void CloseOutput(){
 		output_tree->ResetBranchAddresses();
 		output_file->Close();
-		input_tree->ResetBranchAddresses();
-		mbsinfo_tree->ResetBranchAddresses();
-		input_file->Close();
-		delete in_data;
-		delete mbs_info;
+		if( flag_input_file ) {
+			input_tree->ResetBranchAddresses();
+			mbsinfo_tree->ResetBranchAddresses();
+			input_file->Close();
+			hit_file.Close();
+			delete in_data;
+			delete mbs_info;
+		}
 		log_file.close(); //?? to close or not to close?
 	}; ///< Closes the output files from this class
 
@@ -97,8 +216,53 @@ private:
 	TTree *mbsinfo_tree;
 	MiniballDataPackets *in_data;
 	MBSInfoPackets *mbs_info;
-	std::shared_ptr<FebexData> febex_data;
-	std::shared_ptr<InfoData> info_data;
+	MiniballHit in_hit;			///< current hit, from either sort of tree
+	bool flag_flat_input;		///< input tree has flat branches, not data packets
+	MiniballHitFile hit_file;	///< same hits as the input tree, read instead of it
+	bool flag_hit_file;			///< hits come from the hit file
+	MiniballHitQueue *hit_queue;	///< hits come from a converter through this queue
+
+	// Read an entry of the input tree, the hit file or the queue, in to in_hit
+	bool GetInputEntry( unsigned long i );
+
+	// Build the events from the hits first to last, looking ahead to last
+	void BuildSlice( unsigned long first, unsigned long last );
+
+	// Build the events in slices on worker threads. The hits can be cut in
+	// to slices wherever the gap between two of them is longer than the
+	// build window, because an event is always closed there
+	void BuildParallel();
+	unsigned long FindSliceEnd( unsigned long i );
+	std::unique_ptr<MiniballEventBuilder> MakeWorker();
+
+	// Keep the info hits of a slice, so that the running EBIS, T1, SC,
+	// pulser and pause times at the start of the next one can be found
+	void ScanInfo( unsigned long first, unsigned long last );
+	void UpdateInfoState( const MiniballHit &h );
+	void CopyInfoState( const MiniballEventBuilder &from );
+
+	// Get a worker ready for its next slice
+	void StartSlice( unsigned long first );
+
+	// Add the counters and histograms of a worker to this one
+	void AddWorker( const MiniballEventBuilder &w );
+
+	// Go to a directory of the output file for the histograms, if there is one
+	void ChangeDirectory( std::string dirname );
+
+	// Progress bar in the GUI and the terminal
+	void ShowProgress( float percent );
+
+	std::string input_file_name;	///< so that the workers can open it too
+	unsigned int nthreads;			///< number of threads to build events on
+	bool flag_worker;				///< builds slices for another event builder
+
+	// For the workers only
+	std::vector<MiniballHit> info_hits;		///< info hits of the slice
+	std::vector<MiniballEvts> slice_evts;	///< events built from the slice
+	unsigned long n_slice_evts;				///< number of them, the rest are spare
+	bool flag_time_first;					///< time_first is from this slice
+	std::vector<std::pair<unsigned long long,bool>> tdiff_pending;	///< tdiff times and noise flags until then
 
 	/// Outputs
 	TFile *output_file;
@@ -162,35 +326,21 @@ private:
 	bool				mythres;		///< above threshold?
 
 
-	// Miniball specific variables
-	std::vector<float>					mb_en_list;		///< list of Miniball energies for GammaRayFinder
-	std::vector<unsigned long long>		mb_ts_list;		///< list of Miniball timestamps for GammaRayFinder
-	std::vector<unsigned char>			mb_clu_list;	///< list of cluster IDs
-	std::vector<unsigned char>			mb_cry_list;	///< list of crystal IDs
-	std::vector<unsigned char>			mb_seg_list;	///< list of segment IDs
-
-	// CD detector specific variables
-	std::vector<float>					cd_en_list;		///< list of CD energies for ParticleFinder
-	std::vector<unsigned long long>		cd_ts_list;		///< list of CD timestamps for ParticleFinder
-	std::vector<unsigned char>			cd_det_list;	///< list of CD detector IDs
-	std::vector<unsigned char>			cd_sec_list;	///< list of CD sector IDs
-	std::vector<unsigned char>			cd_side_list;	///< list of CD side IDs; 0 = p, 1 = n
-	std::vector<unsigned char>			cd_strip_list;	///< list of CD strip IDs
-
-	// Beam dump detector specific variables
-	std::vector<float>					bd_en_list;		///< list of beam dump energies for BeamDumpFinder
-	std::vector<unsigned long long>		bd_ts_list;		///< list of beam dump timestamps for BeamDumpFinder
-	std::vector<unsigned char>			bd_det_list;	///< list of beam dump detector IDs
-
-	// Spede detector specific variables
-	std::vector<float>					spede_en_list;		///< list of Spede energies for ElectronFinder
-	std::vector<unsigned long long>		spede_ts_list;		///< list of Spede timestamps for ElectronFinder
-	std::vector<unsigned char>			spede_seg_list;		///< list of Spede segment IDs
-
-	// IonChamber detector specific variables
-	std::vector<float>					ic_en_list;		///< list of IonChamber energies for IonChamberFinder
-	std::vector<unsigned long long>		ic_ts_list;		///< list of IonChamber timestamps for IonChamberFinder
-	std::vector<unsigned char>			ic_id_list;		///< list of IonChamber layer IDs
+	// Hits of each detector in the event being built
+	MiniballGammaHits		mb_hits;		///< Miniball hits for GammaRayFinder
+	MiniballParticleHits	cd_hits;		///< CD hits for ParticleFinder
+	MiniballBeamDumpHits	bd_hits;		///< beam dump hits for BeamDumpFinder
+	MiniballSpedeHits		spede_hits;		///< Spede hits for SpedeFinder
+	MiniballIonChamberHits	ic_hits;		///< IonChamber hits for IonChamberFinder
+
+	// Space for the finders to use, kept from one event to the next
+	MiniballHitBuckets			mb_crystals;	///< Miniball hits of each crystal
+	MiniballHitBuckets			ab_clusters;	///< gamma rays of each cluster, for addback
+	std::vector<bool>			ab_used;		///< gamma rays already used for addback
+	std::vector<unsigned int>	cd_pindex;		///< p-side hits of one CD sector
+	std::vector<unsigned int>	cd_nindex;		///< n-side hits of one CD sector
+	std::vector<unsigned int>	ic_index;		///< IonChamber hits already used
+	std::vector<unsigned int>	ic_layer;		///< layers of the IonChamber hits already used
 
 
 	// Counters
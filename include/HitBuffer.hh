@@ -0,0 +1,263 @@
+// A buffer for the hits that come out of the converters, which puts them
+// in time order on their way to the sorted tree. The hits of each SFP and
+// board arrive almost in time order, so each of these streams is kept in
+// order by itself and the streams are merged with a heap. Hits are only
+// written once they are older than the newest hit by the sorting window.
+// If a hit comes later than that, it is kept aside and the window is made
+// wide enough for it next time. If the window doesn't fit in memory, the
+// hits are sorted in runs that go to temporary files instead. These, and
+// the late hits, are merged in to the tree at the end, reading each file
+// in order.
+// The sorted tree can have data packets, or a flat branch for each part
+// of the hit, which is much quicker to read back
+
+#ifndef __HITBUFFER_HH
+#define __HITBUFFER_HH
+
+#include <iostream>
+#include <vector>
+#include <memory>
+#include <limits>
+#include <algorithm>
+#include <array>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+
+#include "TTree.h"
+
+// Data packets header
+#ifndef __DATAPACKETS_HH
+# include "DataPackets.hh"
+#endif
+
+// Binary file that the sorted hits can be copied to
+class MiniballHitFile;
+
+// Queue that the sorted hits can be passed to another thread by
+class MiniballHitQueue;
+
+
+// One hit as it is kept in the buffer, and in the flat sorted tree
+struct MiniballHit {
+	Long64_t	time;			///< timestamp of the hit
+	ULong64_t	eventid;		///< MBS event ID
+	Float_t		energy;			///< calibrated energy
+	UInt_t		Qint;			///< charge as 32-bit integer
+	Float_t		Qhalf;			///< charge as 16-bit float
+	UShort_t	Qshort;			///< charge as 16-bit integer
+	UChar_t		sfp;			///< SFP ID
+	UChar_t		board;			///< board ID
+	UChar_t		ch;				///< channel ID, FEBEX hits only
+	UChar_t		code;			///< info code, info hits only
+	UChar_t		flags;			///< what sort of hit and its flags
+	UShort_t	trace_length;	///< number of trace samples
+};
+
+// The hits of one SFP and board that are waiting to be written
+struct MiniballHitStream {
+	std::vector<MiniballHit> hits;				///< in time order from head
+	std::vector<unsigned long> trace_start;		///< first sample of each hit
+	std::vector<unsigned short> samples;		///< trace samples of the hits
+	unsigned long head;							///< next hit to be written
+};
+
+// Sort key of a waiting hit. The time has its sign bit flipped, so that
+// it sorts as unsigned, and the entry counts through the streams in turn
+struct MiniballHitKey {
+	ULong64_t	time;
+	UInt_t		entry;
+};
+
+// A sorted run of hits in a temporary file, with the next hit to merge
+struct MiniballHitRun {
+	FILE *fp;
+	MiniballHit hit;
+	std::vector<unsigned short> trace;
+};
+
+
+class MiniballHitBuffer {
+
+public:
+
+	MiniballHitBuffer();
+	~MiniballHitBuffer();
+
+	// Tree to write the sorted hits to, as data packets. This also
+	// starts again with empty buffers
+	void SetOutput( TTree *t, MiniballDataPackets *p );
+
+	// Make flat branches in the tree and write the sorted hits to them.
+	// The trace branch is only there if any traces are written
+	void Branch( TTree *t, bool traces = true );
+	inline bool IsFlat(){ return flat; };
+
+	// Put a hit from data packets in to the flat format
+	static void FromPacket( const MiniballDataPackets *p, MiniballHit &h,
+							std::vector<unsigned short> *trace = nullptr );
+
+	// Number of trace samples that fit in a hit. Longer traces are cut
+	// to the first 65535 samples, with a warning the first time
+	static UShort_t TraceLength( std::size_t n );
+
+	// Also write each sorted hit to a binary hit file, or not if nullptr.
+	// The file is started again if everything has to be merged again
+	inline void SetHitFile( MiniballHitFile *f ){ hit_file = f; };
+
+	// Also push each sorted hit on to a queue, or not if nullptr. Hits
+	// that have already been pushed aren't pushed again by a merge, so
+	// any that came too late are passed on out of order. Once the hits
+	// start to spill, nothing more is pushed until the runs are merged by
+	// Flush, so the events are built after the conversion, not alongside
+	inline void SetHitQueue( MiniballHitQueue *q ){ hit_queue = q; };
+
+	// One stream for each SFP and board, plus one for anything else
+	void SetStreams( unsigned int nsfp, unsigned int nboards );
+
+	// Add a hit to the buffer, which writes out the older hits when it's full
+	void AddFebex( std::shared_ptr<FebexData> data );
+	void AddInfo( std::shared_ptr<InfoData> data );
+
+	// Write all of the hits in the buffer to the tree, merging any runs
+	// that were spilled. The tree is replaced by a new one if some of the
+	// hits came too late for it, so get it again afterwards
+	void Flush();
+	inline TTree* GetTree(){ return tree; };
+
+	// Number of hits in the buffer
+	inline unsigned long GetSize(){ return nbuffered; };
+
+	// Number of hits to keep before writing out the older ones
+	inline void SetFlushSize( unsigned long n ){ flush_size = n > 0 ? n : 1; };
+
+	// Hits older than the newest one by more than this are written, in ns
+	inline void SetWindow( double w ){ window = w > 0 ? w : 0; };
+	inline double GetWindow(){ return window; };
+
+	// Threads for sorting everything in the buffer at once
+	inline void SetThreads( unsigned int n ){ nthreads = n > 0 ? n : 1; };
+
+	// Memory for the hits before they are spilled to a file, in bytes,
+	// and the directory for the files
+	inline void SetMemory( double m ){ memory = m > 0 ? m : 0; };
+	inline void SetTempDir( std::string dir ){ temp_dir = dir; };
+
+	// False if a hit came after a later one had been written, so that
+	// the tree has to be merged with the late hits again
+	inline bool IsOrdered(){ return ordered; };
+	inline unsigned long GetLateHits(){ return nlate; };
+	inline unsigned long GetNumberOfRuns(){ return runs.size(); };
+
+	// Once the hits in the tree have been used, order starts again
+	inline void ResetOrder(){
+		last_time = std::numeric_limits<Long64_t>::min();
+		ordered = true;
+		nlate = 0;
+	};
+
+	// Flags of each hit
+	enum flag_t {
+		FLAG_FEBEX  = 0x01,	// FEBEX data, otherwise info data
+		FLAG_THRES  = 0x02,	// over threshold
+		FLAG_VETO   = 0x04,	// veto bit
+		FLAG_FAIL   = 0x08,	// fail bit
+		FLAG_PILEUP = 0x10	// pileup flag
+	};
+
+private:
+
+	// Put a hit in its place in a stream
+	void Add( unsigned int s, const MiniballHit &h, const unsigned short *trace );
+	void Insert( MiniballHitStream &st, const MiniballHit &h, const unsigned short *trace );
+
+	// Keep a hit that came after a later one was written, to merge at the end
+	void Late( const MiniballHit &h, const unsigned short *trace );
+
+	// Stream of an SFP and board
+	inline unsigned int GetStream( unsigned char sfp, unsigned char board ){
+		if( sfp < nsfp && board < nboards ) return sfp * nboards + board;
+		return streams.size() - 1;
+	};
+
+	// Merge the streams and write all of the hits up to a time, to the
+	// tree or to a run file
+	void Write( Long64_t until, FILE *fp = nullptr );
+
+	// Write all of the hits, sorting their keys instead of merging
+	void WriteAll( FILE *fp = nullptr );
+
+	// Stable sort of the keys by time, a byte at a time, with each
+	// thread counting and moving its own part of the keys
+	static void RadixSort( std::vector<MiniballHitKey> &keys,
+						   std::vector<MiniballHitKey> &tmp,
+						   ULong64_t differ, unsigned int nthreads );
+
+	// Write one hit to the tree or to a run file
+	void Emit( const MiniballHit &h, const unsigned short *trace, FILE *fp );
+
+	// Make a data packet of one hit and fill the tree, and push it to
+	// the queue unless it has been pushed already
+	void WriteHit( const MiniballHit &h, const unsigned short *trace, bool push = true );
+
+	// Drop the hits at the front of a stream that have been written
+	void Compact( MiniballHitStream &st );
+
+	// Write everything in the buffer as a sorted run to a new file
+	bool Spill();
+
+	// Merge the runs, and the tree if it's out of order, in to the tree
+	void Merge();
+
+	// Next hit of a run, or from the tree being merged
+	bool ReadRun( MiniballHitRun &run );
+	bool ReadTree( TTree *t, Long64_t i, MiniballHitRun &run );
+
+	TTree *tree;						///< tree to write to
+	MiniballDataPackets *packet;		///< packet of the tree's branch
+	bool flat;							///< flat branches instead of packets
+	bool flat_traces;					///< with a trace branch
+	MiniballHit hit;					///< hit in the flat branches
+	std::vector<unsigned short> hit_trace;	///< trace in the flat branches
+	MiniballHitFile *hit_file;			///< binary copy of the sorted hits
+	MiniballHitQueue *hit_queue;		///< queue for the sorted hits
+
+	std::vector<MiniballHitStream> streams;
+	MiniballHitStream late;		///< hits that came too late, in time order
+	unsigned int nsfp, nboards;
+	std::vector<std::pair<Long64_t,unsigned int>> heap;	///< first hit of each stream
+
+	// For sorting all of the hits at once
+	std::vector<MiniballHitKey> keys, keys_tmp;
+	std::vector<unsigned long> key_offset;	///< first entry of each stream
+	unsigned int nthreads;
+
+	double window;				///< sorting window in ns
+	Long64_t newest;			///< latest time that was added
+	Long64_t last_time;			///< time of the last hit written
+	bool ordered;				///< false when a hit was too late
+	unsigned long nlate;		///< number of hits that were too late
+	unsigned long nbuffered;	///< number of hits waiting
+	unsigned long nadded;		///< hits added since they were last written
+	unsigned long flush_size;
+
+	// Spilling to files
+	bool spilling;				///< hits go to runs instead of the tree
+	double memory;				///< bytes to use for hits before spilling
+	double nbytes;				///< bytes used by the waiting hits
+	std::string temp_dir;		///< where the run files go
+	std::vector<MiniballHitRun> runs;
+
+	std::vector<unsigned short> swap_trace;		///< to borrow the trace of a hit
+
+	// Packets that are written to the tree
+	std::shared_ptr<FebexData> febex_data;
+	std::shared_ptr<InfoData> info_data;
+
+};
+
+#endif
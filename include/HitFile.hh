@@ -0,0 +1,124 @@
+// A class to write and read the time sorted hits in our own binary format,
+// next to the ROOT file, so that the event builder can be run again
+// without having to read the mb_sort tree back. The file is a header and
+// then one fixed size record for each hit, little-endian as on the machines
+// we run on, with no traces. It can be compressed in blocks, each of which
+// is a gzip stream of its own, and it's read with MiniballDataFile either way
+
+#ifndef __HITFILE_HH
+#define __HITFILE_HH
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+
+// Settings header
+#ifndef __SETTINGS_HH
+# include "Settings.hh"
+#endif
+
+// Data file header
+#ifndef __DATAFILE_HH
+# include "DataFile.hh"
+#endif
+
+// Hit buffer header, for the hits
+#ifndef __HITBUFFER_HH
+# include "HitBuffer.hh"
+#endif
+
+
+// Header at the start of the file, the same size as one hit
+struct MiniballHitFileHeader {
+	char		magic[8];		///< MAGIC, with the version number
+	UInt_t		byte_order;		///< always 1, to spot the wrong endianness
+	UInt_t		record_size;	///< size of each hit in bytes
+	ULong64_t	settings_hash;	///< from SettingsHash when it was written
+	ULong64_t	nhits;			///< number of hits in the file
+	ULong64_t	nfebex;			///< how many of them are FEBEX hits
+};
+
+
+class MiniballHitFile {
+
+public:
+
+	MiniballHitFile();
+	~MiniballHitFile();
+
+	// Write a new file, compressed with a zlib level from 1 to 9 or not at
+	// all with 0. The counts in the header are only filled in by Close, so
+	// an unfinished file looks empty
+	bool Create( std::string _filename, ULong64_t hash, int level = 0 );
+	void Write( const MiniballHit &h );
+
+	// Throw away all of the hits written so far and start again
+	void Rewind();
+
+	// Open a file to read the hits back
+	bool Open( std::string _filename );
+
+	void Close();
+
+	inline bool IsOpen(){ return output_file || input_file.IsOpen(); };
+	inline ULong64_t GetEntries(){ return header.nhits; };
+	inline ULong64_t GetSettingsHash(){ return header.settings_hash; };
+	inline bool IsCompressed(){ return input_file.IsCompressed(); };
+
+	// Pointer to a hit, or nullptr past the end. It stays valid until a
+	// hit from another block is asked for. Blocks are read from the front
+	// of the file to the back, and can't be gone back to once left
+	const MiniballHit* GetHit( ULong64_t i );
+
+	// Drop the blocks that have been left from memory and the page cache.
+	// Only for a single reader that goes through the file once, anyone
+	// reading parts of it again would have to get them from the disk
+	inline void SetReleaseBlocks( bool r ){ release_blocks = r; };
+
+	// Hash of the settings that change how the hits are interpreted
+	static ULong64_t SettingsHash( std::shared_ptr<MiniballSettings> set );
+
+	// Name of the hit file for a given ROOT file
+	static inline std::string GetHitFileName( std::string root_file_name ){
+		return root_file_name.substr( 0, root_file_name.find_last_of( '.' ) ) + ".hits";
+	};
+
+private:
+
+	// Write the block of hits, or the header, as a gzip stream if compressed
+	bool WriteBlock( const char *src, size_t n, int lvl );
+
+	// Write the header again with the counts at the end
+	bool WriteHeader();
+
+	std::string filename;
+	MiniballHitFileHeader header;
+
+	// Writing
+	FILE *output_file;
+	int level;						///< zlib level, 0 for no compression
+	long header_bytes;				///< bytes that the header takes up in the file
+	std::vector<MiniballHit> block;	///< hits waiting to be written
+	std::vector<unsigned char> zbuf;	///< compressed block
+
+	// Reading
+	MiniballDataFile input_file;
+	const MiniballHit *current;		///< first hit of the current block
+	ULong64_t current_block;		///< block of the file that current is in
+	bool have_block;				///< current points to a block
+	bool release_blocks;			///< drop the blocks that have been left
+
+	// First 8 bytes of a hit file, the number is the version
+	static constexpr const char *MAGIC = "MBHITS01";
+
+	// Hits in each block that is compressed, or read at once. The header
+	// takes up the first record of the first block
+	static const unsigned long BLOCK_HITS = 0x4000;
+
+};
+
+#endif
@@ -0,0 +1,83 @@
+// A queue to hand the time sorted hits from the converter straight to the
+// event builder on another thread, without them going through a file.
+// Hits are passed in blocks, so that the lock is only taken once for
+// each block, and the queue only holds a few blocks so that the converter
+// waits for the event builder if it gets too far ahead. The blocks are
+// kept and used again. Traces aren't passed on, since they're not needed
+
+#ifndef __HITQUEUE_HH
+#define __HITQUEUE_HH
+
+#include <iostream>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+
+// Hit buffer header, for the hits
+#ifndef __HITBUFFER_HH
+# include "HitBuffer.hh"
+#endif
+
+
+class MiniballHitQueue {
+
+public:
+
+	MiniballHitQueue();
+	~MiniballHitQueue() {};
+
+	// Start again with an empty queue, which holds this many blocks. The
+	// check is made for each block, never for more hits than that, but the
+	// block being filled and the one being read are on top of these, so
+	// the converter can be up to nblocks+2 blocks ahead of the builder
+	void Open( unsigned int nblocks = 16 );
+
+	// Add a hit, waiting for space in the queue when a block is full
+	void Push( const MiniballHit &h );
+
+	// No more hits are coming, so send the last block. It can be closed
+	// again, but nothing can be pushed until it's opened again
+	void Close();
+
+	// Pointer to a hit, waiting for it to arrive, or nullptr once the
+	// queue has been closed and there are no more. It stays valid until
+	// a hit from another block is asked for. The hits have to be asked
+	// for in order, since the blocks are used again once they are left
+	const MiniballHit* GetHit( unsigned long i );
+
+	// Number of hits that have been sent so far, which is all of them
+	// once the queue is closed
+	inline unsigned long GetEntries(){
+		std::lock_guard<std::mutex> lock( mtx );
+		return nhits;
+	};
+
+private:
+
+	// Move the block being filled on to the queue
+	void Send();
+
+	std::mutex mtx;
+	std::condition_variable cv;
+
+	// Pushing
+	std::vector<MiniballHit> filling;	///< block being filled
+	unsigned long nhits;				///< hits pushed so far
+	bool closed;						///< no more hits are coming
+
+	// Queue
+	std::deque<std::vector<MiniballHit>> full;		///< blocks waiting to be read
+	std::vector<std::vector<MiniballHit>> spare;	///< blocks that can be used again
+	unsigned int max_blocks;						///< most blocks to wait in the queue
+
+	// Reading
+	std::vector<MiniballHit> reading;	///< block being read
+	unsigned long read_first;			///< number of the first hit in it
+
+	// Hits in each block
+	static const unsigned long BLOCK_HITS = 0x4000;
+
+};
+
+#endif
@@ -1,6 +1,10 @@
 #ifndef __MBSCONVERTER_HH
 #define __MBSCONVERTER_HH
 
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
 // MiniballConverter header
 #ifndef __CONVERTER_HH
 # include "Converter.hh"
@@ -11,6 +15,53 @@
 # include "MbsFormat.hh"
 #endif
 
+// A trace that was unpacked and analysed on a worker thread
+struct MiniballMbsTrace {
+	UInt_t start;							///< position of the first sample word
+	std::vector<unsigned short> samples;	///< unpacked trace samples
+	std::vector<float> mwd_energy;			///< energies from the MWD of the trace
+	std::vector<float> mwd_time;			///< CFD times from the MWD of the trace
+};
+
+// Where the parts of one channel are in the data of an MBS event,
+// as found by FindChannel
+struct MiniballMbsChannel {
+	UInt_t id;				///< channel header word
+	unsigned char sfp;		///< SFP ID from the header
+	unsigned char board;	///< board ID from the header
+	unsigned char ch;		///< channel ID from the header, 255 for the special channel
+	UInt_t body;			///< position of the first word after the length
+	UInt_t nwords;			///< hits of the special channel or words of the trace
+	UInt_t trace_header;	///< header word of a trace
+	UInt_t first;			///< position of the first hit or trace word
+	UInt_t trailer;			///< position of the trailer
+};
+
+// An MBS event that was copied in to a batch
+struct MiniballMbsEvent {
+	std::vector<UInt_t> words;	///< trigger, counter and data words
+	ULong_t eventid;			///< MBS event ID
+	unsigned long mbsevt;		///< event number in the file
+	UInt_t buffer;				///< buffer that the event starts in
+	UInt_t position;			///< position that the event starts at
+	bool process;				///< false if it's only needed for the MBS info
+	unsigned int first_trace;	///< first of the traces of this event
+	unsigned int ntraces;		///< number of traces of this event
+};
+
+// A batch of events that are prepared together on a worker thread.
+// Only the traces are unpacked and analysed by the workers, everything
+// that depends on the previous events is done when they are processed
+// in order
+struct MiniballMbsBatch {
+	bool ready;								///< true once the worker has finished
+	std::vector<MiniballMbsEvent> events;	///< events in the order they were read
+	unsigned int nevents;					///< events used, the rest are kept for reuse
+	std::vector<MiniballMbsTrace> traces;	///< traces of all the events
+	unsigned int ntraces;					///< traces used, the rest are kept for reuse
+};
+
+
 class MiniballMbsConverter : public MiniballConverter {
 
 public:
@@ -21,6 +72,8 @@ public:
 			data = nullptr;
 			n_double_hits = 0;
 			n_single_hits = 0;
+			follow_evt = 0;
+			prepared_event = nullptr;
 	};
 	~MiniballMbsConverter() {};
 	
@@ -28,7 +81,11 @@ public:
 	int ConvertFile( std::string input_file_name,
 					unsigned long start_block = 0,
 					long end_block = -1 );
+	int FollowFile( std::string input_file_name );
+	int FollowEventServer( std::string server, unsigned short port );
 
+	void ConvertEvent( unsigned long mbsevt, UInt_t evt_buffer,
+					   UInt_t evt_pos, bool process = true );
 	void ProcessBlock( unsigned long nblock );
 	void ProcessFebexData( UInt_t &pos );
 	bool GetFebexChanID( unsigned int x );
@@ -36,9 +93,19 @@ public:
 
 	void SetMBSEvent( const MBSEvent *myev ){ ev = myev; };
 
+	// Parallel decoding of batches of events on worker threads
+	void PrepareEvent( MiniballMbsBatch &batch, MiniballMbsEvent &evt );
+	void StartWorkers();
+	void QueueEvent( unsigned long mbsevt, bool process );
+	void StopWorkers();
+
 
 private:
 
+	// MBS input file
+	MBS mbs;
+	unsigned long follow_evt; ///< next event number when following a file
+
 	// MBS Event holder and data pointers
 	const MBSEvent *ev;
 	const UInt_t *data;
@@ -48,6 +115,57 @@ private:
 	unsigned long n_single_hits;
 	unsigned long n_double_hits;
 
+	// Batches of events being prepared by the worker threads, used as a
+	// ring so that the workers can only get so far ahead of the output
+	static const unsigned int BATCH_SIZE = 64;
+	std::vector<MiniballMbsBatch> prepared;
+	MiniballMbsEvent *prepared_event;	///< event currently being processed
+	MiniballMbsBatch *prepared_batch;	///< batch of the current event
+	unsigned int prepared_trace;		///< next trace to take from prepared_event
+	MBSEvent batch_evt;					///< points at the words of prepared_event
+	std::vector<std::thread> workers;
+	std::mutex prepared_mutex;
+	std::condition_variable prepared_cv;
+	unsigned long next_fill;			///< batch that is being filled
+	unsigned long next_prepare;			///< next batch for a worker to take
+	unsigned long next_process;			///< next batch to process in order
+	bool stop_workers;
+
+	// MWD results of a trace that is analysed here
+	std::vector<float> mwd_energy;
+	std::vector<float> mwd_time;
+
+	// What FindChannel found at a position in the data
+	enum channel_status_t {
+		CHANNEL_OK,				// everything is where it should be
+		CHANNEL_PADDING,		// nothing but padding is left
+		CHANNEL_BAD_TAG,		// the channel header doesn't start with 0x34
+		CHANNEL_BAD_ID,			// the SFP, board or channel doesn't exist
+		CHANNEL_BAD_LENGTH,		// the channel is longer than the data that's left
+		CHANNEL_BAD_HEADER,		// the trace header is wrong
+		CHANNEL_BAD_TRAILER		// the trailer is wrong, but the rest can be read
+	};
+
+	// Check the tag and the IDs of a channel header
+	channel_status_t CheckChannelID( UInt_t x );
+
+	// Find the parts of the channel at pos in the n words of d and move pos
+	// past it, or to the end if it can't be read. This is the only place
+	// that knows the layout of a channel, so that the events are read the
+	// same way by ProcessFebexData and on the worker threads
+	channel_status_t FindChannel( const UInt_t *d, size_t n, UInt_t &pos,
+								  MiniballMbsChannel &chan );
+
+	// Unpack the samples of a trace with the given header word
+	static void UnpackTrace( const UInt_t *words, UInt_t nwords, UInt_t trace_header,
+							 std::vector<unsigned short> &samples );
+
+	// Loop run by each of the worker threads
+	void PrepareWorker();
+
+	// Process the events of the next batch, once it's ready
+	void ProcessBatch();
+
 };
 
 #endif
@@ -10,12 +10,28 @@
 #include <string>
 #include <ctime>
 #include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <chrono>
+#include <atomic>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 #include <sys/mman.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include <netdb.h>
+#include <poll.h>
+#include <fcntl.h>
 #include <unistd.h>
 
+// Mapped data file header
+#ifndef __DATAFILE_HH
+# include "DataFile.hh"
+#endif
 
 
 // String
@@ -111,56 +127,104 @@ typedef struct {
 	UShort_t i_subtype;  // Subtype
 } s_evhe;
 
+// Information sent by an MBS stream server when a client connects
+typedef struct {
+	UInt_t l_testbit;    // 1 if the server has the same byte order as us
+	UInt_t l_bufsize;    // Buffer size in bytes
+	UInt_t l_bufs;       // Number of buffers in each stream
+	UInt_t l_streams;    // Number of streams, not used
+} s_tcpinfo;
+
 
 //-----------------------------------------------------------------------------
 // MBS event class
+// Most events are inside a single buffer, so the event just points at
+// the words where they are. Only events that are split over more than
+// one buffer are copied, to put the pieces back together
 class MBSEvent {
 	
 private:
 
-	std::vector<UInt_t> data;
+	const UInt_t *words;		// trigger, counter and data words
+	size_t nwords;				// number of words
+	std::vector<UInt_t> data;	// space for events that are split
 	ULong_t eventid;
 
 public:
 	
+	MBSEvent(){ Clear(); eventid = 0; };
+
 	// Get the trigger
 	UInt_t GetTrigger() const {
-		if( data.size() < 1 ) return(0);
-		return( data[0] >> 16 );
+		if( nwords < 1 ) return(0);
+		return( words[0] >> 16 );
 	};
 	
 	// Get the counter
 	UInt_t GetCount() const {
-		if( data.size() < 2 ) return(0);
-		return( data[1] );
+		if( nwords < 2 ) return(0);
+		return( words[1] );
 	};
 	
 	// Get the number of actual 32-bit data words
 	size_t GetNData() const {
-		return( data.size() < 2 ? 0 : data.size() - 2 );
+		return( nwords < 2 ? 0 : nwords - 2 );
 	};
 	
 	// Get the actual data (without the trigger and counter) as 32-bit words
 	const UInt_t *GetData() const {
-		if( data.size() < 2 ) return(nullptr);
-		return( &data[2] );
+		if( nwords < 2 ) return(nullptr);
+		return( &words[2] );
 	};
 	
+	// Get all of the words, including the trigger and counter
+	const UInt_t *GetWords() const { return words; };
+	size_t GetNWords() const { return nwords; };
+	
 	// Get event id
 	ULong_t GetEventID() const { return eventid; };
 
 	// set event id
 	void SetEventID( unsigned long long id ){ eventid = id; };
 
+	// Point at n words of an event that is all in one place, which
+	// must stay there until we are finished with the event
+	void SetView( const UInt_t *w, size_t n ) {
+		words = w;
+		nwords = n;
+	};
+
 	// Store the data - first the trigger, then the counter, then the actual
 	// event data
 	void Store( UInt_t datum ) {
 		data.push_back(datum);
+		words = data.data();
+		nwords = data.size();
+	};
+	
+	// Swap the stored data with another event, to move an event
+	// without copying it. Not for events that point at a buffer
+	void Swap( MBSEvent &other ) {
+		data.swap( other.data );
+		std::swap( eventid, other.eventid );
+		words = data.data();
+		nwords = data.size();
+		other.words = other.data.data();
+		other.nwords = other.data.size();
+	};
+
+	// Store n words in one go
+	void Store( const UInt_t *w, size_t n ) {
+		data.insert( data.end(), w, w + n );
+		words = data.data();
+		nwords = data.size();
 	};
 	
 	// Clear the event
 	void Clear() {
 		data.clear();
+		words = nullptr;
+		nwords = 0;
 	};
 	
 	// Show the contents of the event
@@ -185,22 +249,54 @@ private:
 	std::string filename;
 	std::string server;
 	unsigned short port;
-	FILE *fp;
-	UInt_t socket_id;
-	Int_t server_id;
+	MiniballDataFile input_file;
+	Int_t socket_id;
 	UInt_t current_buffer;
 	UInt_t pos;
+	UInt_t evt_buffer;	// buffer where the last event started
+	UInt_t evt_pos;		// position where the last event started
 	MBSEvent evt;
+	s_filhe filhe;	// copy of the file header
 	s_filhe *fh;
 	s_bufhe *bh;
 	//s_vehe *eh;
 	//s_evhe *sh;
 	UInt_t used; // Bytes used in buffer including header
 
-	const UChar_t *ptr;
-	size_t len;
+	const UChar_t *buf;	// start of the current buffer
 	Int_t current;
 	UInt_t bufsize;
+
+	// Events from the stream server are received on their own thread
+	// and wait in a queue until they are taken by the converter
+	s_tcpinfo tcpinfo;					// what the server told us
+	std::vector<UChar_t> stream_buf;	// space for one buffer
+	std::thread stream_thread;
+	std::mutex stream_mutex;
+	std::condition_variable stream_cv;
+	std::deque<MBSEvent> stream_queue;	// complete events
+	size_t stream_queue_size;			// most events to ask for
+	std::atomic<bool> stream_stop;		// tell the thread to finish
+	bool stream_end;					// the server has gone
+	MBSEvent stream_frag;				// event split over buffers
+	UInt_t stream_frag_slen;			// subevent length of the split event
+	bool flag_stream_frag;				// true when there is a split event
+	UInt_t stream_last_buf;				// number of the last buffer
+	unsigned long stream_lost;			// split events that were lost
+
+	// Thread that reads the stream and unpacks the events
+	void StreamWorker();
+
+	// Read n bytes from the server, waiting for them without blocking
+	// so that we can be stopped. Returns false if there's no more data
+	bool ReadStream( void *dest, size_t n );
+
+	// Send a request to the server
+	bool SendRequest( const char *request );
+
+	// Unpack the events of a buffer from the stream in to the queue
+	void UnpackStreamBuffer( const UChar_t *b );
+	void PushStreamEvent( MBSEvent &e );
 	
 public:
 
@@ -208,7 +304,7 @@ public:
 	MBS();
 	
 	// Destructor
-	~MBS(){};
+	~MBS(){ CloseEventServer(); };
 	
 	// Open and close functions
 	void OpenFile( std::string _filename );
@@ -217,17 +313,45 @@ public:
 	void CloseEventServer();
 
 	void SetBufferSize( unsigned int size ){ bufsize = size; };
+
+	// Is there a file open and what is it called
+	bool IsOpen(){ return input_file.IsOpen(); };
+	std::string GetFileName(){ return filename; };
+
+	// Map anything that was added to the file since it was opened
+	bool Refresh();
+
+	// Compressed files don't know their size until the end
+	bool IsCompressed(){ return input_file.IsCompressed(); };
+	float GetProgress(){ return input_file.GetProgress(); };
 	
+	// Size of the file in bytes, not known yet if it's compressed
+	unsigned long long GetFileSize(){
+		return( input_file.IsCompressed() ? 0 : input_file.GetSize() );
+	};
+
 	// Get number of buffers
-	UInt_t GetNBuffers() const {
-		return( len ? len / bufsize - 1 : 0 );
+	UInt_t GetNBuffers() {
+		return( input_file.GetSize() ? input_file.GetSize() / bufsize - 1 : 0 );
 	};
 	
 	// Get the buffer count
 	UInt_t GetBufferCount(){ return current_buffer; };
+
+	// Where the last event started, as a buffer number and a byte offset
+	UInt_t GetEventBuffer(){ return evt_buffer; };
+	UInt_t GetEventPosition(){ return evt_pos; };
+
+	// Time spent waiting for the file to be read
+	double GetWaitTime(){ return input_file.GetWaitTime(); };
 	
 	// Get the nth buffer
 	const UChar_t* GetBuffer( UInt_t i );
+
+	// Data at the current position, which is inside the current buffer
+	const UInt_t* GetCurrentData() {
+		return( (const UInt_t *)( buf + pos - current_buffer * bufsize ) );
+	};
 	
 	// Get the next buffer
 	const UChar_t* GetNextBuffer() {
@@ -236,17 +360,30 @@ public:
 	
 	// Get the next buffer from the stream
 	const UChar_t* GetBufferFromStream();
+
+	// Is there a connection to an event server and has it finished
+	bool IsStreamOpen(){ return socket_id >= 0; };
+	bool IsStreamEnd();
+
+	// Number of events to keep before we stop asking for more
+	void SetStreamQueueSize( size_t n ){ stream_queue_size = n; };
 	
 	// Get the next event from file
 	const MBSEvent* GetNextEvent();
 	
-	// Get the next event from stream
-	const MBSEvent* GetNextEventFromStream();
+	// Go to a position in a buffer, e.g. the start of an event from an index
+	void Seek( UInt_t buffer, UInt_t position );
+
+	// Go back to a position in a buffer, used when an event is not complete
+	const MBSEvent* Rewind( UInt_t buffer, UInt_t position );
+	
+	// Get the next event from stream, waiting up to the timeout
+	// in ms for one to arrive. Returns nullptr if there isn't one
+	const MBSEvent* GetNextEventFromStream( int timeout = 0 );
 	
 	// Show the file header
 	void ShowFileHeader() {
-		if(!fp) return;
-		fh = (s_filhe *)ptr;
+		if( !input_file.IsOpen() ) return;
 		fh->Show();
 	};
 			
@@ -0,0 +1,69 @@
+// A stand-in for an MBS stream server, which replays .lmd files over TCP
+// in the same way as the DAQ does. This is so that the event server
+// client can be tried out without needing the real DAQ
+
+#ifndef __MBSSERVER_HH
+#define __MBSSERVER_HH
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cerrno>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+// MBS Data Format header
+#ifndef __MBSFORMAT_HH
+# include "MbsFormat.hh"
+#endif
+
+
+class MBSReplayServer {
+
+public:
+
+	MBSReplayServer();
+	~MBSReplayServer(){ Close(); };
+
+	// Listen for a client on a port of this machine
+	bool Listen( unsigned short port );
+
+	// Wait for a client and send it all of the buffers in the files,
+	// then close the connection. Returns the number of buffers sent
+	long Serve( std::vector<std::string> filenames );
+
+	void Close();
+
+	void SetBufferSize( unsigned int size ){ bufsize = size; };
+	void SetBuffersPerStream( unsigned int n ){ bufs_per_stream = n > 0 ? n : 1; };
+
+private:
+
+	// Wait for the next request from the client
+	bool GetRequest( std::string &request );
+
+	// Send n bytes to the client
+	bool Send( const void *src, size_t n );
+
+	// Send the next stream of buffers, padded with empty ones at the end
+	bool SendStream();
+
+	int listen_id;						///< socket that we listen on
+	int client_id;						///< socket of the connected client
+	unsigned int bufsize;				///< size of the MBS buffers
+	unsigned int bufs_per_stream;		///< buffers sent for each request
+
+	// Files that are being replayed
+	std::vector<std::string> files;
+	unsigned int current_file;
+	unsigned long current_buffer;
+	MiniballDataFile input_file;
+	std::vector<UChar_t> empty_buf;		///< sent when there's no more data
+	long nsent;							///< buffers with data sent so far
+
+};
+
+#endif
@@ -1,31 +1,73 @@
 #ifndef __MIDASCONVERTER_HH
 #define __MIDASCONVERTER_HH
 
+#include <climits>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
 // MiniballConverter header
 #ifndef __CONVERTER_HH
 # include "Converter.hh"
 #endif
 
+// Mapped data file header
+#ifndef __DATAFILE_HH
+# include "DataFile.hh"
+#endif
+
+
+// A trace that was unpacked on a worker thread
+struct MiniballMidasTrace {
+	UInt_t start;							///< position of the trace header word
+	UInt_t end;								///< position to carry on from after the trace
+	std::vector<unsigned short> samples;	///< unpacked trace samples
+	std::vector<float> mwd_energy;			///< energies from the MWD of the trace
+};
+
+// A block that was prepared on a worker thread. The words are already
+// swapped in to the right order and the traces have been unpacked, but
+// nothing that depends on previous blocks (timestamps, partial hits) is
+// worked out until the block is processed in order
+struct MiniballMidasBlock {
+	unsigned long nblock;					///< block number in the file
+	bool ready;								///< true once the worker has finished
+	std::vector<ULong64_t> buffer;			///< space for the words if they need swapping
+	const ULong64_t *words;					///< data words in the right order
+	std::vector<MiniballMidasTrace> traces;	///< traces in the order they appear
+	unsigned int ntraces;					///< traces used, the rest are kept for reuse
+};
+
 
 class MiniballMidasConverter : public MiniballConverter {
 
 public:
 	
 	MiniballMidasConverter( std::shared_ptr<MiniballSettings> myset )
-		: MiniballConverter( myset ) {};
+		: MiniballConverter( myset ) {
+			header = nullptr;
+			data = nullptr;
+			prepared_block = nullptr;
+			prepared_trace = 0;
+			file_swap = 0;
+			input_file.SetBlockSize( DATA_BLOCK_SIZE );
+	};
 	~MiniballMidasConverter() {};
 
 	int ConvertFile( std::string input_file_name,
 					unsigned long start_block = 0,
 					long end_block = -1 );
-	int ConvertBlock( char *input_block, long nblock );
+	int ConvertBlock( const char *input_block, long nblock );
+	int FollowFile( std::string input_file_name );
+	unsigned long ConvertBlocks( unsigned long first_block,
+								 unsigned long last_block );
 
 	bool ProcessCurrentBlock( long nblock );
 
-	void SetBlockHeader( char *input_header );
+	void SetBlockHeader( const char *input_header );
 	void ProcessBlockHeader( unsigned long nblock );
 
-	void SetBlockData( char *input_data );
+	void SetBlockData( const char *input_data );
 	void ProcessBlockData( unsigned long nblock );
 
 	bool GetFebexChanID();
@@ -34,6 +76,11 @@ public:
 	void FinishFebexData();
 	void ProcessInfoData();
 
+	// Parallel decoding of blocks on worker threads
+	void PrepareBlock( const char *input_block, MiniballMidasBlock &blk );
+	void StartWorkers( unsigned long first_block, unsigned long last_block );
+	void StopWorkers();
+
 
 
 private:
@@ -45,9 +92,10 @@ private:
 		SWAP_ENDIAN = 4   // We need to swap endianness
 	};
 	Int_t swap;
+	Int_t file_swap; //! swap mode of the whole file, once it's known
 
 	// Swap endianness of a 32-bit integer 0x01234567 -> 0x67452301
-	inline UInt_t Swap32(UInt_t datum) {
+	static inline UInt_t Swap32(UInt_t datum) {
 		return(((datum & 0xFF000000) >> 24) |
 			   ((datum & 0x00FF0000) >>  8) |
 			   ((datum & 0x0000FF00) <<  8) |
@@ -56,14 +104,14 @@ private:
 	
 	// Swap the two halves of a 64-bit integer 0x0123456789ABCDEF ->
 	// 0x89ABCDEF01234567
-	inline ULong64_t SwapWords(ULong64_t datum) {
+	static inline ULong64_t SwapWords(ULong64_t datum) {
 		return(((datum & 0xFFFFFFFF00000000LL) >> 32) |
 			   ((datum & 0x00000000FFFFFFFFLL) << 32));
 	};
 	
 	// Swap endianness of a 64-bit integer 0x0123456789ABCDEF ->
 	// 0xEFCDAB8967452301
-	inline ULong64_t Swap64(ULong64_t datum) {
+	static inline ULong64_t Swap64(ULong64_t datum) {
 		return(((datum & 0xFF00000000000000LL) >> 56) |
 			   ((datum & 0x00FF000000000000LL) >> 40) |
 			   ((datum & 0x0000FF0000000000LL) >> 24) |
@@ -74,20 +122,42 @@ private:
 			   ((datum & 0x00000000000000FFLL) << 56));
 	};
 	
-	// Get nth word
-	inline ULong64_t GetWord( UInt_t n = 0 ){
+	// Get nth word from some data that is already in the right order
+	inline ULong64_t ReadWord( const ULong64_t *words, UInt_t n ){
 
 		// If word number is out of range, return zero
 		if( n >= WORD_SIZE ) return(0);
-
-		// Perform byte swapping according to swap mode
-		ULong64_t result = data[n];
-		if (swap & SWAP_ENDIAN) result = Swap64(result);
-		if (swap & SWAP_WORDS)  result = SwapWords(result);
-		return(result);
+		return(words[n]);
 		
 	};
 
+	// Get nth word of the current block
+	inline ULong64_t GetWord( UInt_t n = 0 ){
+		return ReadWord( data, n );
+	};
+
+	// Swap a block of n words in one go, specialised for each swap mode
+	template<Int_t mode>
+	static void SwapBlock( const ULong64_t *in, ULong64_t *out, UInt_t n );
+
+	// Put the words of a block in to the right order for a given swap mode.
+	// Returns a pointer to the words, which is the input if nothing was done
+	const ULong64_t* SwapBlockData( const ULong64_t *in, ULong64_t *out, Int_t mode );
+
+	// Work out the swap mode from the data words of a block
+	Int_t FindSwapMode( const ULong64_t *words, UShort_t data_endian );
+
+	// The same from a whole block, with its header, as it is in the file
+	Int_t FindSwapMode( const char *input_block );
+
+	// Unpack the samples of the trace with its header at word pos
+	// and return the position of the last word of the trace
+	int UnpackTrace( const ULong64_t *words, int pos,
+					 UInt_t ns, std::vector<unsigned short> &samples );
+
+	// Loop run by each of the worker threads
+	void PrepareWorker();
+
 	
 	// Set the size of the block and its components.
 	static const int HEADER_SIZE = 24; // Size of header in bytes
@@ -96,8 +166,14 @@ private:
 	static const int WORD_SIZE = MAIN_SIZE / sizeof(ULong64_t);
 
 	// Set the arrays for the block components.
+	// These are only used when a block is copied in with SetBlockHeader
+	// and SetBlockData, or when the data words need to be swapped,
+	// otherwise we point straight at the input data
 	char block_header[HEADER_SIZE];
-	char block_data[MAIN_SIZE];
+	ULong64_t block_data[WORD_SIZE];
+
+	// Pointer to the header of the current block
+	const char *header;
 	
 	// Data words - 1 word of 64 bits (8 bytes)
 	ULong64_t word;
@@ -107,7 +183,7 @@ private:
 	UInt_t word_1;
 	
 	// Pointer to the data words
-	ULong64_t *data;
+	const ULong64_t *data;
 	
 	// End of data in  a block looks like:
 	// word_0 = 0xFFFFFFFF, word_1 = 0xFFFFFFFF.
@@ -122,6 +198,23 @@ private:
 	UShort_t header_MyEndian; // 2 byte. If 1 then correct endianess.
 	UShort_t header_DataEndian; // 2 byte.
 	UInt_t header_DataLen; // 4 byte.
+
+	// Memory mapped input file
+	MiniballDataFile input_file; //!
+	unsigned long follow_block; //! next block to convert when following a file
+
+	// Blocks being prepared by the worker threads, used as a ring
+	// so that the workers can only get so far ahead of the output
+	std::vector<MiniballMidasBlock> prepared; //!
+	MiniballMidasBlock *prepared_block; //! block currently being processed
+	unsigned int prepared_trace; //! next trace to take from prepared_block
+	std::vector<std::thread> workers; //!
+	std::mutex prepared_mutex; //!
+	std::condition_variable prepared_cv; //!
+	unsigned long next_prepare;		//! next block for a worker to take
+	unsigned long next_process;		//! next block to process in order
+	unsigned long last_prepare;		//! no more blocks from here
+	bool stop_workers; //!
 	
 };
 
@@ -27,12 +27,12 @@ public:
 	inline void SetSegment( unsigned char s ){ seg = s; };
 	
 	// Return functions
-	inline float 				GetEnergy(){ return energy; };
-	inline float 				GetSegmentEnergy(){ return seg_energy; };
-	inline unsigned long long	GetTime(){ return time; };
-	inline unsigned char		GetCluster(){ return clu; };
-	inline unsigned char		GetCrystal(){ return cry; };
-	inline unsigned char		GetSegment(){ return seg; };
+	inline float 				GetEnergy() const { return energy; };
+	inline float 				GetSegmentEnergy() const { return seg_energy; };
+	inline unsigned long long	GetTime() const { return time; };
+	inline unsigned char		GetCluster() const { return clu; };
+	inline unsigned char		GetCrystal() const { return cry; };
+	inline unsigned char		GetSegment() const { return seg; };
 
 private:
 
@@ -82,16 +82,16 @@ public:
 	inline void SetStripN( unsigned char s ){ nstrip = s; };
 
 	// Return functions
-	inline float 				GetEnergy(){ return GetEnergyP(); };
-	inline unsigned long long	GetTime(){ return GetTimeP(); };
-	inline float 				GetEnergyP(){ return penergy; };
-	inline float 				GetEnergyN(){ return nenergy; };
-	inline unsigned long long	GetTimeP(){ return ptime; };
-	inline unsigned long long	GetTimeN(){ return ntime; };
-	inline unsigned char		GetDetector(){ return det; };
-	inline unsigned char		GetSector(){ return sec; };
-	inline unsigned char		GetStripP(){ return pstrip; };
-	inline unsigned char		GetStripN(){ return nstrip; };
+	inline float 				GetEnergy() const { return GetEnergyP(); };
+	inline unsigned long long	GetTime() const { return GetTimeP(); };
+	inline float 				GetEnergyP() const { return penergy; };
+	inline float 				GetEnergyN() const { return nenergy; };
+	inline unsigned long long	GetTimeP() const { return ptime; };
+	inline unsigned long long	GetTimeN() const { return ntime; };
+	inline unsigned char		GetDetector() const { return det; };
+	inline unsigned char		GetSector() const { return sec; };
+	inline unsigned char		GetStripP() const { return pstrip; };
+	inline unsigned char		GetStripN() const { return nstrip; };
 
 
 private:
@@ -125,9 +125,9 @@ public:
 	inline void SetDetector( unsigned char d ){ det = d; };
 	
 	// Return functions
-	inline float 				GetEnergy(){ return energy; };
-	inline unsigned long long	GetTime(){ return time; };
-	inline unsigned char		GetDetector(){ return det; };
+	inline float 				GetEnergy() const { return energy; };
+	inline unsigned long long	GetTime() const { return time; };
+	inline unsigned char		GetDetector() const { return det; };
 
 private:
 
@@ -156,9 +156,9 @@ public:
 	inline void SetSegment( unsigned char s ){ seg = s; };
 	
 	// Return functions
-	inline float 				GetEnergy(){ return energy; };
-	inline unsigned long long	GetTime(){ return time; };
-	inline unsigned char		GetSegment(){ return seg; };
+	inline float 				GetEnergy() const { return energy; };
+	inline unsigned long long	GetTime() const { return time; };
+	inline unsigned char		GetSegment() const { return seg; };
 
 private:
 
@@ -192,11 +192,11 @@ public:
 	inline void	SetEnergies( std::vector<float> x ){ energy = x; };
 	inline void	SetIDs( std::vector<unsigned char> x ){ id = x; };
 
-	inline unsigned long	GetTime(){ return detime; };
-	inline unsigned long	GetdETime(){ return detime; };
-	inline unsigned long	GetETime(){ return etime; };
-	inline std::vector<float>			GetEnergies(){ return energy; };
-	inline std::vector<unsigned char>	GetIDs(){ return id; };
+	inline unsigned long	GetTime() const { return detime; };
+	inline unsigned long	GetdETime() const { return detime; };
+	inline unsigned long	GetETime() const { return etime; };
+	inline std::vector<float>			GetEnergies() const { return energy; };
+	inline std::vector<unsigned char>	GetIDs() const { return id; };
 
 	inline float GetEnergy( unsigned char i ){
 		if( i < energy.size() ) return energy.at(i);
@@ -259,12 +259,12 @@ public:
 	void AddEvt( std::shared_ptr<SpedeEvt> event );
 	void AddEvt( std::shared_ptr<IonChamberEvt> event );
 
-	inline unsigned int GetGammaRayMultiplicity(){ return gamma_event.size(); };
-	inline unsigned int GetGammaRayAddbackMultiplicity(){ return gamma_ab_event.size(); };
-	inline unsigned int GetParticleMultiplicity(){ return particle_event.size(); };
-	inline unsigned int GetBeamDumpMultiplicity(){ return bd_event.size(); };
-	inline unsigned int GetSpedeMultiplicity(){ return spede_event.size(); };
-	inline unsigned int GetIonChamberMultiplicity(){ return ic_event.size(); };
+	inline unsigned int GetGammaRayMultiplicity() const { return gamma_event.size(); };
+	inline unsigned int GetGammaRayAddbackMultiplicity() const { return gamma_ab_event.size(); };
+	inline unsigned int GetParticleMultiplicity() const { return particle_event.size(); };
+	inline unsigned int GetBeamDumpMultiplicity() const { return bd_event.size(); };
+	inline unsigned int GetSpedeMultiplicity() const { return spede_event.size(); };
+	inline unsigned int GetIonChamberMultiplicity() const { return ic_event.size(); };
 
 	inline std::shared_ptr<GammaRayEvt> GetGammaRayEvt( unsigned int i ){
 		if( i < gamma_event.size() ) return std::make_shared<GammaRayEvt>( gamma_event.at(i) );
@@ -291,6 +291,14 @@ public:
 		else return nullptr;
 	};
 
+	// Look at an event in place, without making a copy of it
+	inline const GammaRayEvt& GetGammaRayEvtRef( unsigned int i ) const { return gamma_event.at(i); };
+	inline const GammaRayAddbackEvt& GetGammaRayAddbackEvtRef( unsigned int i ) const { return gamma_ab_event.at(i); };
+	inline const ParticleEvt& GetParticleEvtRef( unsigned int i ) const { return particle_event.at(i); };
+	inline const BeamDumpEvt& GetBeamDumpEvtRef( unsigned int i ) const { return bd_event.at(i); };
+	inline const SpedeEvt& GetSpedeEvtRef( unsigned int i ) const { return spede_event.at(i); };
+	inline const IonChamberEvt& GetIonChamberEvtRef( unsigned int i ) const { return ic_event.at(i); };
+
 	void ClearEvt();
 	
 	// ISOLDE timestamping
@@ -298,9 +306,9 @@ public:
 	inline void SetT1( unsigned long t ){ t1 = t; return; };
 	inline void SetSC( unsigned long t ){ sc = t; return; };
 
-	inline unsigned long GetEBIS(){ return ebis; };
-	inline unsigned long GetT1(){ return t1; };
-	inline unsigned long GetSC(){ return sc; };
+	inline unsigned long GetEBIS() const { return ebis; };
+	inline unsigned long GetT1() const { return t1; };
+	inline unsigned long GetSC() const { return sc; };
 
 	
 private:
@@ -10,6 +10,14 @@
 #include "TSystem.h"
 #include "TEnv.h"
 
+/// What a FEBEX channel is connected to, packed in to one entry of the
+/// channel map so that everything about a hit comes from one look up
+struct MiniballChannel {
+	unsigned char	type;		///< detector type, from MiniballSettings::channel_t
+	unsigned char	flags;		///< trace and timing signal flags, from MiniballSettings::channel_flag_t
+	short			id[4];		///< detector IDs, in the same order as the Get...() functions, or -1
+};
+
 /// A class to read in the settings file in ROOT's TConfig format.
 /// This has the number of modules, channels and things
 /// It also defines which detectors are which
@@ -72,6 +80,51 @@ public:
 	void SetBlockSize( unsigned int size ){ block_size = size; };
 	inline unsigned int GetBlockSize(){ return block_size; };
 	inline unsigned int IsFebexOnly(){ return flag_febex_only; };
+	inline double GetSortWindow(){ return sort_window; };
+	inline double GetSortMemory(){ return sort_memory; };
+	inline bool FlatSortedTree(){ return flag_flat_sort; };
+	inline bool WriteHitFile(){ return flag_hit_file; };
+	inline int GetHitFileCompression(){ return hit_file_level; };
+	inline bool WriteSortedTree(){ return flag_sorted_tree; };
+
+	// Traces
+	inline bool WriteTraces(){ return trace_write; };
+	inline unsigned int GetTraceDownscale(){ return trace_downscale; };
+	inline bool WriteTrace( unsigned int sfp, unsigned int board, unsigned int ch ){
+		if( sfp < n_febex_sfp && board < n_febex_board && ch < n_febex_ch )
+			return trace_ch[sfp][board][ch];
+		else return false;
+	};
+
+
+	// Everything about a channel at once, from the packed channel map.
+	// Channels outside of the FEBEX system are not connected to anything
+	inline const MiniballChannel& GetChannel( unsigned int sfp, unsigned int board, unsigned int ch ){
+		if( sfp < n_febex_sfp && board < n_febex_board && ch < n_febex_ch )
+			return channel_map[ ( sfp * n_febex_board + board ) * n_febex_ch + ch ];
+		return no_channel;
+	};
+
+	// Detector types in the channel map, where the IDs are
+	//   Miniball: cluster, crystal, segment
+	//   CD: detector, sector, side, strip
+	//   SPEDE: segment; beam dump: detector; IonChamber: layer
+	enum channel_t {
+		CHANNEL_NONE		= 0,
+		CHANNEL_MINIBALL	= 1,
+		CHANNEL_CD			= 2,
+		CHANNEL_SPEDE		= 3,
+		CHANNEL_BEAMDUMP	= 4,
+		CHANNEL_IONCHAMBER	= 5
+	};
+
+	// Flags of each channel
+	enum channel_flag_t {
+		CHANNEL_TRACE	= 0x01,	// write traces from this channel
+		CHANNEL_PULSER	= 0x02,	// pulser signal
+		CHANNEL_EBIS	= 0x04,	// EBIS signal
+		CHANNEL_T1		= 0x08	// T1 signal
+	};
 
 
 	// Miniball array
@@ -80,7 +133,7 @@ public:
 	inline unsigned int GetNumberOfMiniballSegments(){ return n_mb_segment; };
 	bool IsMiniball( unsigned int sfp, unsigned int board, unsigned int ch );
 	int GetMiniballID( unsigned int sfp, unsigned int board, unsigned int ch,
-					  std::vector<std::vector<std::vector<int>>> vector );
+					  const std::vector<std::vector<std::vector<int>>> &vector );
 	inline int GetMiniballCluster( unsigned int sfp, unsigned int board, unsigned int ch ){
 		return GetMiniballID( sfp, board, ch, mb_cluster );
 	};
@@ -102,7 +155,7 @@ public:
 	inline unsigned int GetNumberOfCDNStrips(){ return n_cd_nstrip; };
 	bool IsCD( unsigned int sfp, unsigned int board, unsigned int ch );
 	int GetCDID( unsigned int sfp, unsigned int board, unsigned int ch,
-					  std::vector<std::vector<std::vector<int>>> vector );
+					  const std::vector<std::vector<std::vector<int>>> &vector );
 	inline int GetCDDetector( unsigned int sfp, unsigned int board, unsigned int ch ){
 		return GetCDID( sfp, board, ch, cd_det );
 	};
@@ -142,6 +195,9 @@ private:
 
 	std::string fInputFile;
 
+	// Fill the packed channel map from the separate maps of each detector
+	void MakeChannelMap();
+
 	// FEBEX settings
 	unsigned int n_febex_sfp;		///< Number of SFPs in acquisition
 	unsigned int n_febex_board;		///< Maximum number of boards per SFP
@@ -204,6 +260,10 @@ private:
 	std::vector<unsigned int> ic_ch;						///< A list of channel numbers for each IonChamber segment
 	std::vector<std::vector<std::vector<int>>> ic_layer;	///< A channel map for the IonChamber segments (-1 if not a IonChamber, otherwise layer number, i.e dE (gas) = 0, E (Si) = 1)
 
+	// Packed channel map
+	std::vector<MiniballChannel> channel_map;	//! All of the detector maps in one, indexed by sfp, board and channel
+	MiniballChannel no_channel;					//! Entry for channels outside of the map
+
 
 	// Info code settings
 	unsigned int sync_code;				///< Medium significant bits of the timestamp are here
@@ -240,6 +300,17 @@ private:
 	// Data format
 	unsigned int block_size;		///< not yet implemented, needs C++ style reading of data files
 	bool flag_febex_only;			///< when there is only FEBEX data in the file
+	double sort_window;				///< hits are time ordered within this window in ns
+	double sort_memory;				///< MB of hits kept while sorting before they go to files
+	bool flag_flat_sort;			///< write the sorted hits as flat branches instead of data packets
+	bool flag_hit_file;				///< also write the sorted hits to a binary file for the event builder
+	int hit_file_level;				///< zlib level for the hit file, 0 for no compression
+	bool flag_sorted_tree;			///< write the mb_sort tree when the events are built while converting
+
+	// Traces
+	bool trace_write;				///< write traces to the output tree, otherwise only use them for the MWD
+	unsigned int trace_downscale;	///< only write every Nth trace of each channel
+	std::vector<std::vector<std::vector<bool>>> trace_ch;	///< write traces from this channel, defaults to trace_write
 
 	
 };
@@ -8,6 +8,7 @@
 #include "Histogrammer.hh"
 #include "DataSpy.hh"
 #include "MbsFormat.hh"
+#include "MbsServer.hh"
 #include "MiniballGUI.hh"
 
 #include "mb_sort.hh"
@@ -27,6 +28,7 @@ bool flag_source = false;
 
 // select what steps of the analysis to be forced
 std::vector<bool> force_convert;
+std::vector<bool> piped_events;
 bool force_sort = false;
 bool force_events = false;
 
@@ -43,6 +45,21 @@ bool flag_mbs = false;
 bool flag_spy = false;
 int open_spy_data = -1;
 
+// MBS event server for the DataSpy, or to replay files as one
+std::string mbs_server = "localhost";
+int mbs_port = 6002;
+bool flag_replay = false;
+
+// Number of threads for the conversion
+int nthreads = 1;
+
+// Build the events while converting, without reading the sorted hits back
+bool flag_pipe = false;
+
+// Convert only part of a file, using the index
+std::vector<long long> block_range;
+std::vector<double> time_range;
+
 // Monitoring input file
 bool flag_monitor = false;
 int mon_time = -1; // update time in seconds
@@ -131,18 +148,14 @@ void* monitor_run( void* ptr ){
 	if( flag_spy && !flag_mbs ) myspy.Open( file_id ); /// open the data spy
 	int spy_length = 0;
 	
-	// GSI MBS EventServer
-	MBS mbs;
-	if( flag_spy && flag_mbs ) mbs.OpenEventServer( "localhost", 8030 );
-
 	// Data/Event counters
-	int start_block = 0, start_subevt = 0;
 	int nblocks = 0, nsubevts = 0;
 	unsigned long nbuild = 0;
 
 	// Converter setup
 	if( !flag_spy ) curFileMon = input_names.at(0); // maybe change in GUI later?
 	if( flag_source ) conv_mon->SourceOnly();
+	conv_mon->SetNumberOfThreads( nthreads );
 	conv_mon->AddCalibration( calfiles->mycal );
 	conv_mon->SetOutput( "monitor_singles.root" );
 	conv_mon->MakeTree();
@@ -166,16 +179,16 @@ void* monitor_run( void* ptr ){
 			// Convert - from MIDAS file
 			if( !flag_spy && !flag_mbs ) {
 				
-				nblocks = conv_midas_mon->ConvertFile( curFileMon, start_block );
-				start_block = nblocks;
+				// Only the new blocks since last time
+				nblocks = conv_midas_mon->FollowFile( curFileMon );
 
 			}
 
 			// Convert - from MBS file
 			else if( !flag_spy && flag_mbs ) {
 				
-				nsubevts = conv_mbs_mon->ConvertFile( curFileMon, start_subevt );
-				start_subevt = nsubevts;
+				// Only the new events since last time
+				nsubevts = conv_mbs_mon->FollowFile( curFileMon );
 				
 			}
 			
@@ -211,10 +224,14 @@ void* monitor_run( void* ptr ){
 			// Convert - from MBS event server
 			else if( flag_spy && flag_mbs ){
 				
-				// First check if we have data
+				// Convert the events that arrived since last time
 				std::cout << "Looking for data from MBSEventServer" << std::endl;
-				conv_mbs_mon->SetMBSEvent( mbs.GetNextEventFromStream() );
-				conv_mbs_mon->ProcessBlock(0);
+				nsubevts = conv_mbs_mon->FollowEventServer( mbs_server, mbs_port );
+				if( nsubevts <= 0 && bFirstRun ) {
+					std::cout << "No data yet on first pass" << std::endl;
+					gSystem->Sleep( 2e3 );
+					continue;
+				}
 				conv_mon->SortTree();
 
 			}
@@ -256,6 +273,9 @@ void* monitor_run( void* ptr ){
 				}
 			
 			}
+
+			// The sorted hits have been used, so start again with the next ones
+			conv_mon->ResetSortedTree();
 			
 			// This makes things unresponsive!
 			// Unless we are threading?
@@ -267,7 +287,6 @@ void* monitor_run( void* ptr ){
 	
 	// Close the dataSpy before exiting (no point really)
 	if( flag_spy && !flag_mbs ) myspy.Close( file_id );
-	if( flag_spy && flag_mbs ) mbs.CloseEventServer();
 
 	// Close all outputs (we never reach here anyway)
 	conv_mon->CloseOutput();
@@ -311,6 +330,37 @@ void start_http(){
 	
 }
 
+// Input files can be compressed, in which case we want
+// the name without the .gz or .zst on the end
+std::string strip_compression( std::string name ){
+
+	for( std::string ext : { ".gz", ".zst" } )
+		if( name.length() > ext.length() &&
+		    name.compare( name.length() - ext.length(), ext.length(), ext ) == 0 )
+			return name.substr( 0, name.length() - ext.length() );
+
+	return name;
+
+}
+
+// Start of the names of the output files for an input file, which says
+// which part of it was converted, so that it doesn't replace the whole run
+std::string output_base( std::string name ){
+
+	name = strip_compression( name );
+	name = name.substr( 0, name.find_last_of(".") );
+
+	std::stringstream ss;
+	ss << name;
+	if( time_range.size() == 2 )
+		ss << "_time" << time_range[0] << "-" << time_range[1];
+	else if( block_range.size() == 2 )
+		ss << "_blocks" << block_range[0] << "-" << block_range[1];
+
+	return ss.str();
+
+}
+
 void do_convert() {
 	
 	//------------------------//
@@ -326,16 +376,59 @@ void do_convert() {
 	std::string name_input_file;
 	std::string name_output_file;
 
+	// Event builder that takes the sorted hits straight from the converter
+	std::unique_ptr<MiniballEventBuilder> eb;
+	MiniballHitQueue hit_queue;
+	std::thread eb_thread;
+
+	// Start building the events once the converter has made its tree,
+	// and finish them once the converter has sorted all of the hits
+	auto start_build = [&]( MiniballConverter &conv ){
+
+		std::string name_events_file = name_output_file.substr( 0,
+										name_output_file.find_last_of(".") );
+		name_events_file += "_events.root";
+		std::cout << name_input_file << " --> ";
+		std::cout << name_events_file << std::endl;
+
+		// Both threads use ROOT at once
+		ROOT::EnableThreadSafety();
+
+		// The calibration has a random number generator, so it needs its own
+		eb = std::make_unique<MiniballEventBuilder>( myset );
+		if( overwrite_cal )
+			eb->AddCalibration( std::make_shared<MiniballCalibration>( mycal->InputFile(), myset ) );
+
+		hit_queue.Open();
+		eb->SetInputQueue( &hit_queue );
+		eb->SetOutput( name_events_file );
+
+		// Back to the converter's file for anything that it makes
+		conv.GetFile()->cd();
+
+		eb_thread = std::thread( &MiniballEventBuilder::BuildEvents, eb.get() );
+
+	};
+
+	auto finish_build = [&](){
+
+		hit_queue.Close();
+		eb_thread.join();
+		eb->CloseOutput();
+		eb.reset();
+
+	};
+
 	// Check each file
 	for( unsigned int i = 0; i < input_names.size(); i++ ){
 
 		name_input_file = input_names.at(i);
-		name_output_file = name_input_file.substr( 0,
-								name_input_file.find_last_of(".") );
+		name_output_file = output_base( name_input_file );
 		if( flag_source ) name_output_file = name_output_file + "_source.root";
 		else name_output_file = name_output_file + ".root";
 
 		force_convert.push_back( false );
+		piped_events.push_back( false );
 
 		// If input doesn't exist, skip it
 		ftest.open( name_input_file.data() );
@@ -366,18 +459,77 @@ void do_convert() {
 			
 			std::cout << name_input_file << " --> ";
 			std::cout << name_output_file << std::endl;
+
+			// Find the part of the file to convert from the index
+			unsigned long start_block = 0;
+			long end_block = -1;
+			if( block_range.size() == 2 || time_range.size() == 2 ) {
+
+				MiniballDataIndex index;
+				unsigned long first, last;
+				bool found;
+
+				if( !index.Read( MiniballDataIndex::GetIndexName( name_input_file ) ) ) {
+
+					std::cerr << "No index for " << name_input_file;
+					std::cerr << ", convert the whole file once first" << std::endl;
+					continue;
+
+				}
+
+				if( time_range.size() == 2 )
+					found = index.FindTimeRange( time_range[0], time_range[1], first, last );
+				else
+					found = index.FindBlockRange( block_range[0], block_range[1], first, last );
+
+				if( !found ) {
+
+					std::cerr << "Nothing in the requested range of " << name_input_file << std::endl;
+					continue;
+
+				}
+
+				// MBS files are converted by event, MIDAS files by block
+				if( flag_mbs ) {
+
+					start_block = index.GetEntry( first ).event;
+					if( last+1 < index.GetNumberOfEntries() )
+						end_block = index.GetEntry( last+1 ).event - 1;
+
+				}
+
+				else {
+
+					start_block = index.GetEntry( first ).block;
+					end_block = index.GetEntry( last ).block;
+
+				}
+
+			}
+
+			// Start reading the next file while we convert this one
+			if( i+1 < input_names.size() )
+				MiniballDataFile::WillNeed( input_names.at(i+1) );
+
+			// Events are built at the same time, unless it's a source run
+			bool pipe = flag_pipe && !flag_source;
+			piped_events.at(i) = pipe;
 			
 			if( flag_mbs ) {
 			
 				if( flag_source ) conv_mbs.SourceOnly();
+				conv_mbs.SetNumberOfThreads( nthreads );
+				conv_mbs.SetHitQueue( pipe ? &hit_queue : nullptr );
 				conv_mbs.SetOutput( name_output_file );
 				conv_mbs.MakeTree();
 				conv_mbs.MakeHists();
 				conv_mbs.AddCalibration( mycal );
-				conv_mbs.ConvertFile( name_input_file );
+				if( pipe ) start_build( conv_mbs );
+				conv_mbs.ConvertFile( name_input_file, start_block, end_block );
 
 				// Sort the tree before writing and closing
 				if( !flag_source ) conv_mbs.SortTree();
+				if( pipe ) finish_build();
 				conv_mbs.CloseOutput();
 				
 			}
@@ -385,14 +537,18 @@ void do_convert() {
 			else {
 				
 				if( flag_source ) conv_midas.SourceOnly();
+				conv_midas.SetNumberOfThreads( nthreads );
+				conv_midas.SetHitQueue( pipe ? &hit_queue : nullptr );
 				conv_midas.SetOutput( name_output_file );
 				conv_midas.MakeTree();
 				conv_midas.MakeHists();
 				conv_midas.AddCalibration( mycal );
-				conv_midas.ConvertFile( name_input_file );
+				if( pipe ) start_build( conv_midas );
+				conv_midas.ConvertFile( name_input_file, start_block, end_block );
 
 				// Sort the tree before writing and closing
 				if( !flag_source ) conv_midas.SortTree();
+				if( pipe ) finish_build();
 				conv_midas.CloseOutput();
 				
 			}
@@ -422,12 +578,13 @@ bool do_build() {
 	// Update calibration file if given
 	if( overwrite_cal ) eb.AddCalibration( mycal );
 
+	// Build the events on more than one thread
+	eb.SetNumberOfThreads( nthreads );
+
 	// Do event builder for each file individually
 	for( unsigned int i = 0; i < input_names.size(); i++ ){
 
-		name_input_file = input_names.at(i);
-		name_input_file = name_input_file.substr( 0,
-								name_input_file.find_last_of(".") );
+		name_input_file = output_base( input_names.at(i) );
 		name_output_file = name_input_file + "_events.root";
 		name_input_file += ".root";
 
@@ -445,6 +602,10 @@ bool do_build() {
 			return_flag = true;
 			
 		}
+
+		// Nothing to do if the events were built while converting,
+		// unless they should be built again anyway with -e
+		if( piped_events.at(i) && !flag_events ) continue;
 		
 		// We need to do event builder if we just converted it
 		// specific request to do new event build with -e
@@ -470,11 +631,37 @@ bool do_build() {
 
 		}
 
+		// The sorted hits might only have gone to the event builder while
+		// converting, so leave the events file that it made alone
+		if( force_events ) {
+
+			rtest = new TFile( name_input_file.data() );
+			if( !rtest->IsZombie() && !rtest->Get("mb_sort") ) {
+
+				std::cerr << "No mb_sort tree in " << name_input_file;
+				std::cerr << ", set WriteSortedTree to build the events from it again" << std::endl;
+				force_events = false;
+
+			}
+			rtest->Close();
+
+		}
+
 		if( force_events ) {
 
 			std::cout << name_input_file << " --> ";
 			std::cout << name_output_file << std::endl;
 
+			// Start reading the next converted file while we build this one,
+			// and its hit file, which is read instead if there is one
+			if( i+1 < input_names.size() ) {
+
+				std::string name_next_file = output_base( input_names.at(i+1) ) + ".root";
+				MiniballDataFile::WillNeed( name_next_file );
+				MiniballDataFile::WillNeed( MiniballHitFile::GetHitFileName( name_next_file ) );
+
+			}
+
 			eb.SetInputFile( name_input_file );
 			eb.SetOutput( name_output_file );
 			eb.BuildEvents();
@@ -506,9 +693,7 @@ void do_hist() {
 	// We are going to chain all the event files now
 	for( unsigned int i = 0; i < input_names.size(); i++ ){
 
-		name_input_file = input_names.at(i);
-		name_input_file = name_input_file.substr( 0,
-								name_input_file.find_last_of(".") );
+		name_input_file = output_base( input_names.at(i) );
 		name_input_file += "_events.root";
 		name_hist_files.push_back( name_input_file );
 
@@ -543,6 +728,13 @@ int main( int argc, char *argv[] ){
 	interface->Add("-source", "Flag to define an source only run", &flag_source );
     interface->Add("-mbs", "Flag to define input as MBS data type", &flag_mbs );
     interface->Add("-spy", "Flag to run the DataSpy", &flag_spy );
+	interface->Add("-mbs-server", "MBS event server for the DataSpy (default localhost)", &mbs_server );
+	interface->Add("-mbs-port", "Port of the MBS event server (default 6002)", &mbs_port );
+	interface->Add("-replay", "Replay the MBS input files as an event server on -mbs-port", &flag_replay );
+	interface->Add("-block-range", "First and last block (or MBS buffer) to convert, to files named _blocksA-B", &block_range );
+	interface->Add("-time-range", "Start and stop time to convert in seconds from the start of the file, to files named _timeA-B", &time_range );
+	interface->Add("-t", "Number of threads for the data conversion and event building (default 1)", &nthreads );
+	interface->Add("-pipe", "Build the events while converting, straight from the sorted hits (after the conversion if the hits don't fit in memory)", &flag_pipe );
 	interface->Add("-m", "Monitor input file every X seconds", &mon_time );
 	interface->Add("-p", "Port number for web server (default 8030)", &port_num );
 	interface->Add("-d", "Data directory to add to the monitor", &datadir_name );
@@ -576,11 +768,39 @@ int main( int argc, char *argv[] ){
 			
 	}
 	
+	// Stand-in for an MBS event server, serving the input files
+	if( flag_replay ) {
+		
+		MBSReplayServer replay;
+		if( !replay.Listen( mbs_port ) ) return 1;
+		replay.Serve( input_names );
+		
+		return 0;
+		
+	}
+	
+	// Check the ranges make sense and force the conversion
+	if( block_range.size() || time_range.size() ) {
+		
+		if( ( block_range.size() && block_range.size() != 2 ) ||
+		    ( time_range.size() && time_range.size() != 2 ) ) {
+			
+			std::cout << "A range needs a start and a stop value" << std::endl;
+			return 1;
+			
+		}
+		
+		flag_convert = true;
+		std::cout << "Converting only part of the input, using the index" << std::endl;
+		
+	}
+	
 	// Check if it should be MBS format
 	if( !flag_mbs && !flag_spy ){
 		
-		std::string extension = input_names.at(0).substr( input_names.at(0).find_last_of(".")+1,
-														 input_names.at(0).length()-input_names.at(0).find_last_of(".")-1 );
+		std::string first_name = strip_compression( input_names.at(0) );
+		std::string extension = first_name.substr( first_name.find_last_of(".")+1,
+												   first_name.length()-first_name.find_last_of(".")-1 );
 		
 		if( extension == "lmd" ) {
 			
@@ -597,8 +817,14 @@ int main( int argc, char *argv[] ){
 		
 		flag_monitor = true;
 		if( mon_time < 0 ) mon_time = 30;
-		std::cout << "Getting data from shared memory every " << mon_time;
-		std::cout << " seconds using DataSpy" << std::endl;
+		if( flag_mbs ) {
+			std::cout << "Getting data from the MBS event server " << mbs_server;
+			std::cout << ":" << mbs_port << " every " << mon_time << " seconds" << std::endl;
+		}
+		else {
+			std::cout << "Getting data from shared memory every " << mon_time;
+			std::cout << " seconds using DataSpy" << std::endl;
+		}
 		
 	}
 	
@@ -618,11 +844,9 @@ int main( int argc, char *argv[] ){
 	}
 	
 	// Check the ouput file name
-	if( output_name.length() == 0 ) {
+	if( output_name.length() == 0 && input_names.size() ) {
 		
-		output_name = input_names.at(0);
-		output_name = output_name.substr( 0,
-								output_name.find_last_of(".") );
+		output_name = output_base( input_names.at(0) );
 		output_name += "_hists.root";
 	
 	}
@@ -679,13 +903,6 @@ int main( int argc, char *argv[] ){
 	//-------------------//
 	if( flag_monitor || flag_spy ) {
 		
-		if( flag_mbs && flag_spy ){
-			
-			std::cout << "MBS data spy not yet supported (but it will be)" << std::endl;
-			return 0;
-			
-		}
-		
 		// Make some data for the thread
 		thread_data data;
 		data.mycal = mycal;
@@ -8,7 +8,7 @@ void mwd_plots( std::string filename = "test/R4_13.root", unsigned int sfp = 0,
 	TFile *f = new TFile( filename.data() );
 	
 	// Get Tree
-	TTree *t = (TTree*)f->Get("mb");
+	TTree *t = (TTree*)f->Get("mb_sort");
 	
 	// Settings file - needed for calibration, just use defaults
 	std::shared_ptr<MiniballSettings> myset = std::make_shared<MiniballSettings>( "default" );
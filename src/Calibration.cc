@@ -229,7 +229,7 @@ float MiniballCalibration::FebexEnergy( unsigned int sfp, unsigned int board, un
 	
 }
 
-FebexMWD MiniballCalibration::DoMWD( unsigned int sfp, unsigned int board, unsigned int ch, std::vector<unsigned short> trace ) {
+FebexMWD MiniballCalibration::DoMWD( unsigned int sfp, unsigned int board, unsigned int ch, const std::vector<unsigned short> &trace ) {
 	
 	// Create a FebexMWD class to hold the info
 	FebexMWD mwd;
@@ -1,17 +1,26 @@
 // An abstract class for the MBS or MIDAS data conversion
 #include "Converter.hh"
 
+// SSE2 is always there on x86-64, so the trace unpacking can use it
+#if defined(__SSE2__)
+# include <emmintrin.h>
+# define TRACE_SIMD_UNPACK
+#endif
+
 MiniballConverter::MiniballConverter( std::shared_ptr<MiniballSettings> myset ) {
 
 	// We need to do initialise, but only after Settings are added
 	set = myset;
 
+	my_tm_stp = 0;
+	my_good_tm_stp = 0;
 	my_tm_stp_msb = 0;
 	my_tm_stp_hsb = 0;
 
 	ctr_febex_hit.resize( set->GetNumberOfFebexSfps() );
 	ctr_febex_pause.resize( set->GetNumberOfFebexSfps() );
 	ctr_febex_resume.resize( set->GetNumberOfFebexSfps() );
+	ctr_febex_trace.resize( set->GetNumberOfFebexSfps() );
 
 	// Start counters at zero
 	for( unsigned int i = 0; i < set->GetNumberOfFebexSfps(); ++i ) {
@@ -19,6 +28,9 @@ MiniballConverter::MiniballConverter( std::shared_ptr<MiniballSettings> myset )
 		ctr_febex_hit[i].resize( set->GetNumberOfFebexBoards() );
 		ctr_febex_pause[i].resize( set->GetNumberOfFebexBoards() );
 		ctr_febex_resume[i].resize( set->GetNumberOfFebexBoards() );
+		ctr_febex_trace[i].resize( set->GetNumberOfFebexBoards() );
+		for( unsigned int j = 0; j < set->GetNumberOfFebexBoards(); ++j )
+			ctr_febex_trace[i][j].resize( set->GetNumberOfFebexChannels() );
 
 	}
 	
@@ -28,6 +40,16 @@ MiniballConverter::MiniballConverter( std::shared_ptr<MiniballSettings> myset )
 	// No progress bar by default
 	_prog_ = false;
 
+	// Decode in a single thread by default
+	nthreads = 1;
+
+	// Hits only go to the tree unless we're given a queue
+	hit_queue = nullptr;
+
+	// Not writing an index until asked
+	flag_index = false;
+	flag_index_entry = false;
+
 }
 
 void MiniballConverter::StartFile(){
@@ -41,6 +63,8 @@ void MiniballConverter::StartFile(){
 			ctr_febex_hit[i][j] = 0;	// hits on each module
 			ctr_febex_pause[i][j] = 0;
 			ctr_febex_resume[i][j] = 0;
+			for( unsigned int k = 0; k < set->GetNumberOfFebexChannels(); ++k )
+				ctr_febex_trace[i][j][k] = 0;
 			
 		}
 
@@ -48,15 +72,238 @@ void MiniballConverter::StartFile(){
 
 	ctr_febex_ext = 0;	// pulser trigger
 
+	// Start the clock for this file
+	start_time = std::chrono::steady_clock::now();
+
 	return;
 	
 }
 
+// Print how long we waited for data to be read from the input file,
+// to tell if the conversion is limited by the disk or by the decoding
+void MiniballConverter::PrintWaitTime( double wait_time ){
+
+	std::chrono::duration<double> total = std::chrono::steady_clock::now() - start_time;
+
+	std::cout << std::endl << " Waiting for input = " << std::setprecision(4);
+	std::cout << wait_time << " s of " << total.count() << " s";
+	if( total.count() > 0 )
+		std::cout << " (" << 100.0 * wait_time / total.count() << "%)";
+	std::cout << std::endl;
+
+	return;
+
+}
+
+// Start writing the index for an input file
+bool MiniballConverter::StartIndex( std::string input_file_name ){
+
+	flag_index = index.Create( MiniballDataIndex::GetIndexName( input_file_name ) );
+	flag_index_entry = false;
+
+	return flag_index;
+
+}
+
+// Finish the last entry and close the index
+void MiniballConverter::FinishIndex(){
+
+	if( !flag_index ) return;
+
+	FinishIndexEntry();
+	index.Close();
+	flag_index = false;
+
+	return;
+
+}
+
+// Start an entry for a new block, storing the state of the decoder
+void MiniballConverter::StartIndexEntry( unsigned long long offset,
+										 unsigned long long block,
+										 unsigned long long event ){
+
+	if( !flag_index ) return;
+
+	// Finish the previous one if it's still open
+	FinishIndexEntry();
+
+	MiniballDataIndex::ClearEntry( index_entry );
+	index_entry.offset = offset;
+	index_entry.block = block;
+	index_entry.event = event;
+	index_entry.tm_stp = my_tm_stp;
+	index_entry.good_tm_stp = my_good_tm_stp;
+	index_entry.tm_stp_msb = my_tm_stp_msb;
+	index_entry.tm_stp_hsb = my_tm_stp_hsb;
+
+	// The hit that isn't finished yet
+	index_entry.hit_time = febex_data->GetTime();
+	index_entry.hit_eventid = febex_data->GetEventID();
+	index_entry.hit_energy = febex_data->GetEnergy();
+	index_entry.hit_Qhalf = febex_data->GetQhalf();
+	index_entry.hit_Qint = febex_data->GetQint();
+	index_entry.hit_Qshort = febex_data->GetQshort();
+	index_entry.hit_sfp = febex_data->GetSfp();
+	index_entry.hit_board = febex_data->GetBoard();
+	index_entry.hit_ch = febex_data->GetChannel();
+	index_entry.hit_bits = febex_data->IsOverThreshold() | febex_data->IsVeto() << 1 |
+						   febex_data->IsFail() << 2 | febex_data->IsPileUp() << 3;
+	index_entry.febex_flags = flag_febex_data0 | flag_febex_data1 << 1 |
+							  flag_febex_data2 << 2 | flag_febex_data3 << 3 |
+							  flag_febex_trace << 4;
+	index_entry.adc_data_lsb = my_adc_data_lsb;
+	index_entry.adc_data_hsb = my_adc_data_hsb;
+	index_entry.energy = my_energy;
+	flag_index_entry = true;
+
+	return;
+
+}
+
+// Write the current entry to the index
+void MiniballConverter::FinishIndexEntry(){
+
+	if( !flag_index || !flag_index_entry ) return;
+
+	index.Add( index_entry );
+	flag_index_entry = false;
+
+	return;
+
+}
+
+// Put the decoder back in to the state it was at the start of an entry
+void MiniballConverter::RestoreIndexEntry( const MiniballDataIndexEntry &entry ){
+
+	my_tm_stp = entry.tm_stp;
+	my_good_tm_stp = entry.good_tm_stp;
+	my_tm_stp_msb = entry.tm_stp_msb;
+	my_tm_stp_hsb = entry.tm_stp_hsb;
+
+	// The hit that wasn't finished yet
+	febex_data->SetTime( entry.hit_time );
+	febex_data->SetEventID( entry.hit_eventid );
+	febex_data->SetEnergy( entry.hit_energy );
+	febex_data->SetQhalf( entry.hit_Qhalf );
+	febex_data->SetQint( entry.hit_Qint );
+	febex_data->SetQshort( entry.hit_Qshort );
+	febex_data->SetSfp( entry.hit_sfp );
+	febex_data->SetBoard( entry.hit_board );
+	febex_data->SetChannel( entry.hit_ch );
+	febex_data->SetThreshold( entry.hit_bits & 0x1 );
+	febex_data->SetVeto( entry.hit_bits & 0x2 );
+	febex_data->SetFail( entry.hit_bits & 0x4 );
+	febex_data->SetPileUp( entry.hit_bits & 0x8 );
+	flag_febex_data0 = entry.febex_flags & 0x1;
+	flag_febex_data1 = entry.febex_flags & 0x2;
+	flag_febex_data2 = entry.febex_flags & 0x4;
+	flag_febex_data3 = entry.febex_flags & 0x8;
+	flag_febex_trace = entry.febex_flags & 0x10;
+	my_adc_data_lsb = entry.adc_data_lsb;
+	my_adc_data_hsb = entry.adc_data_hsb;
+	my_energy = entry.energy;
+
+	return;
+
+}
+
+// Decide if the trace of a hit is written out or only used for the MWD,
+// from the channel selection and the downscale factor in the settings
+bool MiniballConverter::KeepTrace( unsigned char sfp, unsigned char board, unsigned char ch ){
+
+	if( !( set->GetChannel( sfp, board, ch ).flags & MiniballSettings::CHANNEL_TRACE ) ) return false;
+	if( set->GetTraceDownscale() <= 1 ) return true;
+
+	return( ctr_febex_trace[sfp][board][ch]++ % set->GetTraceDownscale() == 0 );
+
+}
+
+// Unpack four 14-bit samples from each 64-bit MIDAS word. The samples are
+// the four 16-bit parts of the word from the top down, so with SSE2 we just
+// reverse the 16-bit parts of each word and mask them, two words at a time
+void MiniballConverter::UnpackSamples64( const ULong64_t *words, UInt_t nwords,
+										 unsigned short *samples ){
+
+	UInt_t i = 0;
+
+#ifdef TRACE_SIMD_UNPACK
+	const __m128i mask = _mm_set1_epi16( 0x3FFF );
+	for( ; i + 2 <= nwords; i += 2 ) {
+
+		__m128i w = _mm_loadu_si128( (const __m128i*)( words + i ) );
+		w = _mm_shufflelo_epi16( w, _MM_SHUFFLE( 0, 1, 2, 3 ) );
+		w = _mm_shufflehi_epi16( w, _MM_SHUFFLE( 0, 1, 2, 3 ) );
+		_mm_storeu_si128( (__m128i*)( samples + 4*i ), _mm_and_si128( w, mask ) );
+
+	}
+#endif
+
+	for( ; i < nwords; ++i ) {
+
+		samples[4*i]   = ( words[i] >> 48 ) & 0x3FFF;
+		samples[4*i+1] = ( words[i] >> 32 ) & 0x3FFF;
+		samples[4*i+2] = ( words[i] >> 16 ) & 0x3FFF;
+		samples[4*i+3] = words[i] & 0x3FFF;
+
+	}
+
+	return;
+
+}
+
+// Unpack two samples from each 32-bit MBS word, which are already the
+// two 16-bit halves in the right order, so it's only a mask with SSE2
+void MiniballConverter::UnpackSamples32( const UInt_t *words, UInt_t nwords,
+										 UShort_t mask, unsigned short *samples ){
+
+	UInt_t i = 0;
+
+#ifdef TRACE_SIMD_UNPACK
+	const __m128i vmask = _mm_set1_epi16( mask );
+	for( ; i + 4 <= nwords; i += 4 ) {
+
+		__m128i w = _mm_loadu_si128( (const __m128i*)( words + i ) );
+		_mm_storeu_si128( (__m128i*)( samples + 2*i ), _mm_and_si128( w, vmask ) );
+
+	}
+#endif
+
+	for( ; i < nwords; ++i ) {
+
+		samples[2*i]   = words[i] & mask;
+		samples[2*i+1] = ( words[i] >> 16 ) & mask;
+
+	}
+
+	return;
+
+}
+
 void MiniballConverter::SetOutput( std::string output_file_name ){
 	
 	// Open output file
 	output_file = new TFile( output_file_name.data(), "recreate", "FEBEX raw data file" );
 
+	// Hits that don't fit in memory while sorting go next to it
+	hits.SetTempDir( output_file_name.substr( 0, output_file_name.find_last_of( '/' ) + 1 ) );
+
+	// Binary copy of the sorted hits, otherwise make sure that there
+	// isn't an old one that the event builder would read instead
+	std::string hit_file_name = MiniballHitFile::GetHitFileName( output_file_name );
+	if( set->WriteHitFile() &&
+		hit_file.Create( hit_file_name, MiniballHitFile::SettingsHash( set ),
+						 set->GetHitFileCompression() ) )
+		hits.SetHitFile( &hit_file );
+
+	else {
+
+		hit_file.Close();
+		std::remove( hit_file_name.data() );
+		hits.SetHitFile( nullptr );
+
+	}
+
 	return;
 
 };
@@ -67,24 +314,52 @@ void MiniballConverter::MakeTree() {
 	// Create Root tree
 	const int splitLevel = 2; // don't split branches = 0, full splitting = 99
 	const int bufsize = sizeof(FebexData) + sizeof(InfoData);
-	output_tree = new TTree( "mb", "mb" );
 	mbsinfo_tree = new TTree( "mbsinfo", "mbsinfo" );
 	data_packet = std::make_unique<MiniballDataPackets>();
 	mbsinfo_packet = std::make_unique<MBSInfoPackets>();
-	output_tree->Branch( "data", "MiniballDataPackets", data_packet.get(), bufsize, splitLevel );
 	mbsinfo_tree->Branch( "mbsinfo", "MBSInfoPackets", mbsinfo_packet.get(), sizeof(MBSInfoPackets), 0 );
-	
-	sorted_tree = (TTree*)output_tree->CloneTree(0);
-	sorted_tree->SetName("mb_sort");
-	sorted_tree->SetTitle( "Time sorted, calibrated Miniball data" );
-	sorted_tree->SetDirectory( output_file->GetDirectory("/") );
-	output_tree->SetDirectory( output_file->GetDirectory("/") );
+
 	mbsinfo_tree->SetDirectory( output_file->GetDirectory("/") );
-	
-	output_tree->SetAutoFlush(-10e6);
-	sorted_tree->SetAutoFlush(-10e6);
 	mbsinfo_tree->SetAutoFlush(-10e6);
 
+	hits.SetStreams( set->GetNumberOfFebexSfps(), set->GetNumberOfFebexBoards() );
+	hits.SetWindow( set->GetSortWindow() );
+	hits.SetMemory( set->GetSortMemory() * 1024. * 1024. );
+
+	// Hits go straight to the sorted tree, time ordered by the buffer,
+	// unless they only go to an event builder through the queue
+	sorted_tree = nullptr;
+	if( !hit_queue || set->WriteSortedTree() ) {
+
+		sorted_tree = new TTree( "mb_sort", "Time sorted, calibrated Miniball data" );
+		sorted_tree->SetDirectory( output_file->GetDirectory("/") );
+		sorted_tree->SetAutoFlush(-10e6);
+
+	}
+
+	// Either a flat branch for each part of the hits, with traces only
+	// if some are written, or the hits in data packets
+	if( !sorted_tree ) hits.SetOutput( nullptr, nullptr );
+
+	else if( set->FlatSortedTree() ) {
+
+		bool traces = false;
+		for( unsigned int i = 0; i < set->GetNumberOfFebexSfps(); ++i )
+			for( unsigned int j = 0; j < set->GetNumberOfFebexBoards(); ++j )
+				for( unsigned int k = 0; k < set->GetNumberOfFebexChannels(); ++k )
+					if( set->WriteTrace( i, j, k ) ) traces = true;
+
+		hits.Branch( sorted_tree, traces );
+
+	}
+
+	else {
+
+		sorted_tree->Branch( "data", "MiniballDataPackets", data_packet.get(), bufsize, splitLevel );
+		hits.SetOutput( sorted_tree, data_packet.get() );
+
+	}
+
 	febex_data = std::make_shared<FebexData>();
 	info_data = std::make_shared<InfoData>();
 	
@@ -322,87 +597,29 @@ void MiniballConverter::ResetHists() {
 
 unsigned long long MiniballConverter::SortTree(){
 	
-	// Reset the sorted tree so it's empty before we start
-	sorted_tree->Reset();
-	
-	// Make the index for the MBS info tree
-	mbsinfo_tree->BuildIndex( "mbsinfo.GetEventID()" );
-	
-	// Load the full tree if possible
-	//output_tree->SetMaxVirtualSize(200e6); // 200 MB
-	//sorted_tree->SetMaxVirtualSize(200e6); // 200 MB
-	//output_tree->LoadBaskets(200e6); 	 // Load 6 MB of data to memory
-	
-	// Check we have entries and build time-ordered index
-	if( output_tree->GetEntries() ){
+	// Write out the hits that are still in the buffer, which are merged
+	// with any that were spilled to files. The tree might be a new one
+	hits.Flush();
+	sorted_tree = hits.GetTree();
 
-		std::cout << "Building time-ordered index of events..." << std::endl;
-		output_tree->BuildIndex( "data.GetTime()" );
+	// That's all of the hits for an event builder on the queue
+	if( hit_queue ) hit_queue->Close();
 
-	}
-	else return 0;
-	
-	// Get index and prepare for sorting
-	TTreeIndex *att_index = (TTreeIndex*)output_tree->GetTreeIndex();
-	unsigned long long nb_idx = att_index->GetN();
-	std::cout << " Sorting: size of the sorted index = " << nb_idx << std::endl;
+	// Make the index for the MBS info tree
+	mbsinfo_tree->BuildIndex( "mbsinfo.GetEventID()" );
 
-	// Loop on t_raw entries and fill t
-	for( unsigned long i = 0; i < nb_idx; ++i ) {
-		
-		// Clean up old data
-		data_packet->ClearData();
-		
-		// Get time-ordered event index
-		unsigned long long idx = att_index->GetIndex()[i];
-		
-		// Check if the input or output trees are filling
-		//if( output_tree->MemoryFull(30e6) )
-		//	output_tree->DropBaskets();
-		//if( sorted_tree->MemoryFull(30e6) )
-		//	sorted_tree->FlushBaskets();
-		
-		// Get entry from unsorted tree and fill to sorted tree
-		output_tree->GetEntry( idx );
-		sorted_tree->Fill();
-
-		// Optimise filling tree
-		//if( i == 100 ) sorted_tree->OptimizeBaskets(30e6);	 // sorted tree basket size max 30 MB
-
-		// Progress bar
-		bool update_progress = false;
-		if( nb_idx < 200 )
-			update_progress = true;
-		else if( i % (nb_idx/100) == 0 || i+1 == nb_idx )
-			update_progress = true;
-		
-		if( update_progress ) {
-			
-			// Percent complete
-			float percent = (float)(i+1)*100.0/(float)nb_idx;
-			
-			// Progress bar in GUI
-			if( _prog_ ) {
-				
-				prog->SetPosition( percent );
-				gSystem->ProcessEvents();
-				
-			}
-			
-			// Progress bar in terminal
-			std::cout << " " << std::setw(6) << std::setprecision(4);
-			std::cout << percent << "%    \r";
-			std::cout.flush();
+	// Progress bar in GUI
+	if( _prog_ ) {
 
-		}
+		prog->SetPosition( 100 );
+		gSystem->ProcessEvents();
 
 	}
 	
-	// Reset the output tree so it's empty after we've finished
-	output_tree->FlushBaskets();
-	output_tree->Reset();
+	// The hits only went to the queue
+	if( !sorted_tree ) return hit_queue->GetEntries();
 
-	return nb_idx;
+	return sorted_tree->GetEntries();
 	
 }
 
@@ -0,0 +1,584 @@
+#include "DataFile.hh"
+
+// Decompression libraries are only needed here, so keep them out of the
+// header where the dictionary generator would have to find them too
+#include <zlib.h>
+#ifdef HAVE_ZSTD
+# include <zstd.h>
+#endif
+
+MiniballDataFile::MiniballDataFile() {
+
+	fd = -1;
+	ptr = nullptr;
+	len = 0;
+
+	// Read 64 MB ahead by default
+	ra_window = 0x4000000;
+	ra_begin = 0;
+	ra_ready = 0;
+	ra_request = 0;
+	ra_stop = false;
+	wait_time = 0;
+	released = 0;
+
+	// Not compressed until we find out otherwise
+	compressed = false;
+	format = FORMAT_NONE;
+	chunk_size = RA_CHUNK;
+	block_size = 1;
+	ring_base = 0;
+	ring_end = 0;
+	zpos = 0;
+	zlen = 0;
+	stream_end = false;
+
+}
+
+MiniballDataFile::~MiniballDataFile() {
+
+	Close();
+
+}
+
+// Open the file and map it into virtual memory
+bool MiniballDataFile::Open( std::string _filename ){
+
+	// Close file if already open
+	if( fd >= 0 ) Close();
+
+	// Open file
+	fd = open( _filename.data(), O_RDONLY );
+	if( fd < 0 ) {
+		std::cerr << "Unable to open " << _filename << std::endl;
+		return false;
+	}
+
+	// Store filename
+	filename = _filename;
+
+	// Get length of file
+	struct stat st;
+	if( fstat( fd, &st ) < 0 ) {
+
+		std::cerr << __FUNCTION__ << ": Unable to get size of " << _filename << std::endl;
+		close(fd);
+		fd = -1;
+		return false;
+
+	}
+	len = st.st_size;
+
+	// Nothing has been read yet
+	ra_request = 0;
+	wait_time = 0;
+	released = 0;
+
+	// Check the magic bytes to see if the file is compressed
+	unsigned char magic[4] = { 0, 0, 0, 0 };
+	ssize_t nmagic = pread( fd, magic, 4, 0 );
+	format = FORMAT_NONE;
+	if( nmagic >= 2 && magic[0] == 0x1f && magic[1] == 0x8b )
+		format = FORMAT_GZIP;
+	else if( nmagic == 4 && magic[0] == 0x28 && magic[1] == 0xb5 &&
+			 magic[2] == 0x2f && magic[3] == 0xfd )
+		format = FORMAT_ZSTD;
+
+	// Compressed files are decompressed on a thread instead of being mapped
+	if( format != FORMAT_NONE ) {
+
+#ifndef HAVE_ZSTD
+		if( format == FORMAT_ZSTD ) {
+
+			std::cerr << __FUNCTION__ << ": " << _filename;
+			std::cerr << " is compressed with zstd, but we were built without it" << std::endl;
+			close(fd);
+			fd = -1;
+			len = 0;
+			return false;
+
+		}
+#endif
+
+		compressed = true;
+		zlen = len;
+		zpos = 0;
+		len = 0;
+
+		// Chunks are a whole number of blocks, and the ring covers
+		// the read ahead window, but always has at least two chunks
+		chunk_size = RA_CHUNK - RA_CHUNK % block_size;
+		if( chunk_size == 0 ) chunk_size = block_size;
+		unsigned long long nchunks = ra_window / chunk_size;
+		if( nchunks < 2 ) nchunks = 2;
+		ring.assign( nchunks, std::vector<char>( chunk_size ) );
+		ring_base = 0;
+		ring_end = 0;
+		stream_end = false;
+
+		// We still read the compressed file from front to back
+#ifdef POSIX_FADV_SEQUENTIAL
+		posix_fadvise( fd, 0, zlen, POSIX_FADV_SEQUENTIAL );
+#endif
+
+		ra_stop = false;
+		ra_thread = std::thread( &MiniballDataFile::Decompress, this );
+		return true;
+
+	}
+
+	// An empty file is not an error, there is just nothing to map yet
+	if( len == 0 ) return true;
+
+	// Map into virtual memory
+	void *map = mmap( nullptr, len, PROT_READ, MAP_SHARED, fd, 0 );
+	if( map == MAP_FAILED ) {
+
+		std::cerr << __FUNCTION__ << ": Error mapping file " << _filename << std::endl;
+		close(fd);
+		fd = -1;
+		len = 0;
+		return false;
+
+	}
+	ptr = (const char*)map;
+
+	// We read the data front to back, so tell the kernel to read ahead
+	// aggressively and to drop pages behind us when it needs to
+	madvise( map, len, MADV_SEQUENTIAL );
+#ifdef POSIX_FADV_SEQUENTIAL
+	posix_fadvise( fd, 0, len, POSIX_FADV_SEQUENTIAL );
+#endif
+
+	// Start reading ahead from the beginning of the file
+	StartReadAhead( 0 );
+
+	return true;
+
+}
+
+// Unmap and close the file
+void MiniballDataFile::Close() {
+
+	// Stop the read ahead first, it's still using the mapping
+	StopReadAhead();
+
+	if( ptr ) munmap( (void*)ptr, len );
+	if( fd >= 0 ) close(fd);
+
+	fd = -1;
+	ptr = nullptr;
+	len = 0;
+
+	// Free the decompressed data
+	ring.clear();
+	compressed = false;
+	format = FORMAT_NONE;
+
+}
+
+// Map the file again if it has grown since we last looked
+bool MiniballDataFile::Refresh(){
+
+	// We can't follow a compressed file while it is being written
+	if( fd < 0 || compressed ) return false;
+
+	// Check the new length of the file
+	struct stat st;
+	if( fstat( fd, &st ) < 0 || (size_t)st.st_size <= len ) return false;
+
+	// Stop the read ahead while we move the mapping
+	StopReadAhead();
+	if( ptr ) munmap( (void*)ptr, len );
+	ptr = nullptr;
+	len = st.st_size;
+
+	// Map the whole file again
+	void *map = mmap( nullptr, len, PROT_READ, MAP_SHARED, fd, 0 );
+	if( map == MAP_FAILED ) {
+
+		std::cerr << __FUNCTION__ << ": Error mapping file " << filename << std::endl;
+		len = 0;
+		return false;
+
+	}
+	ptr = (const char*)map;
+	madvise( map, len, MADV_SEQUENTIAL );
+
+	// Carry on reading ahead from where we had got to
+	StartReadAhead( ra_request );
+
+	return true;
+
+}
+
+// Start the read ahead thread from a given position in the file
+void MiniballDataFile::StartReadAhead( unsigned long long offset ){
+
+	unsigned long long page = sysconf( _SC_PAGESIZE );
+	ra_begin = offset - offset % page;
+	ra_ready = ra_begin;
+	ra_request = offset;
+	ra_stop = false;
+	ra_thread = std::thread( &MiniballDataFile::ReadAhead, this );
+
+	return;
+
+}
+
+// Stop the read ahead thread and wait for it to finish
+void MiniballDataFile::StopReadAhead(){
+
+	if( !ra_thread.joinable() ) return;
+
+	std::unique_lock<std::mutex> lock( ra_mutex );
+	ra_stop = true;
+	lock.unlock();
+	ra_cv.notify_all();
+	ra_thread.join();
+
+	return;
+
+}
+
+// Get a pointer to a block, waiting for it to be read in if needed
+const char* MiniballDataFile::GetBlock( unsigned long long offset,
+									   unsigned long long size ){
+
+	// Compressed files have to wait for the decompression instead
+	if( compressed ) {
+
+		std::unique_lock<std::mutex> lock( ra_mutex );
+
+		// We can only hand out blocks that are inside one chunk
+		// of the ring and haven't been released already
+		if( offset < ring_base || size > chunk_size ||
+			offset / chunk_size != ( offset + size - 1 ) / chunk_size ||
+			offset + size > ring_base + ring.size() * chunk_size ) {
+
+			std::cerr << __FUNCTION__ << ": Block at " << offset;
+			std::cerr << " is outside of the decompressed data in ";
+			std::cerr << filename << std::endl;
+			return nullptr;
+
+		}
+
+		// Wait for the decompression to get there
+		if( offset + size > ring_end && !stream_end ) {
+
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			ra_cv.wait( lock, [&]{
+				return ra_stop || stream_end || offset + size <= ring_end;
+			} );
+			std::chrono::duration<double> waited = std::chrono::steady_clock::now() - start;
+			wait_time += waited.count();
+
+		}
+
+		// End of the file
+		if( offset + size > ring_end ) return nullptr;
+
+		return ring[ ( offset / chunk_size ) % ring.size() ].data() + offset % chunk_size;
+
+	}
+
+	if( !ptr || offset + size > len ) return nullptr;
+
+	std::unique_lock<std::mutex> lock( ra_mutex );
+
+	// Behind the read ahead, just hand it over, it's probably there anyway
+	if( offset < ra_begin ) return ptr + offset;
+
+	// If we jumped further than the read ahead can see, start again from here
+	if( offset > ra_ready + ra_window ) {
+
+		unsigned long long page = sysconf( _SC_PAGESIZE );
+		ra_begin = offset - offset % page;
+		ra_ready = ra_begin;
+
+	}
+
+	// Let the read ahead know how far we've got
+	if( offset + size > ra_request ) {
+
+		ra_request = offset + size;
+		ra_cv.notify_all();
+
+	}
+
+	// Wait for the read ahead to catch up with us
+	if( offset + size > ra_ready ) {
+
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		ra_cv.wait( lock, [&]{
+			return ra_stop || offset + size <= ra_ready || offset < ra_begin;
+		} );
+		std::chrono::duration<double> waited = std::chrono::steady_clock::now() - start;
+		wait_time += waited.count();
+
+	}
+
+	return ptr + offset;
+
+}
+
+// Loop for the read ahead thread, which reads the file one chunk at a time,
+// keeping ra_window bytes ahead of the furthest block that was asked for
+void MiniballDataFile::ReadAhead(){
+
+	unsigned long long page = sysconf( _SC_PAGESIZE );
+	std::unique_lock<std::mutex> lock( ra_mutex );
+
+	while( true ) {
+
+		ra_cv.wait( lock, [&]{
+			return ra_stop || ( ra_ready < len && ra_ready < ra_request + ra_window );
+		} );
+		if( ra_stop ) return;
+
+		unsigned long long start = ra_ready;
+		unsigned long long size = len - start;
+		if( size > RA_CHUNK ) size = RA_CHUNK;
+		lock.unlock();
+
+		// Ask for the whole chunk at once, then touch every page
+		// so that it is mapped before the decoder gets there
+		madvise( (void*)( ptr + start ), size, MADV_WILLNEED );
+		volatile char touch = 0;
+		for( unsigned long long i = 0; i < size; i += page )
+			touch = touch ^ ptr[start+i];
+
+		// Move the window on, unless someone jumped while we were reading
+		lock.lock();
+		if( ra_ready == start ) ra_ready = start + size;
+		ra_cv.notify_all();
+
+	}
+
+}
+
+// Check if there is data up to a given offset
+bool MiniballDataFile::IsAvailable( unsigned long long end ){
+
+	if( !compressed ) return end <= len;
+
+	std::unique_lock<std::mutex> lock( ra_mutex );
+
+	// The decompressor can't get further than the end of the ring
+	if( end > ring_base + ring.size() * chunk_size ) return false;
+
+	ra_cv.wait( lock, [&]{
+		return ra_stop || stream_end || end <= ring_end;
+	} );
+
+	return end <= ring_end;
+
+}
+
+// Let the decompressor reuse the chunks before a given offset
+void MiniballDataFile::Release( unsigned long long offset ){
+
+	// Drop the pages that we've finished with from the mapping and from
+	// the page cache, so that a big file doesn't push everything else out
+	// of memory. It's done a chunk at a time to keep the system calls down
+	if( !compressed ) {
+
+		if( !ptr ) return;
+		if( offset > len ) offset = len;
+
+		unsigned long long page = sysconf( _SC_PAGESIZE );
+		unsigned long long end = offset - offset % page;
+		if( end < released + RA_CHUNK ) return;
+
+		madvise( (void*)( ptr + released ), end - released, MADV_DONTNEED );
+#ifdef POSIX_FADV_DONTNEED
+		posix_fadvise( fd, released, end - released, POSIX_FADV_DONTNEED );
+#endif
+		released = end;
+
+		return;
+
+	}
+
+	std::unique_lock<std::mutex> lock( ra_mutex );
+	unsigned long long base = offset - offset % chunk_size;
+	if( base > ring_base ) {
+
+		ring_base = base;
+		ra_cv.notify_all();
+
+	}
+
+	return;
+
+}
+
+// How far through the file we are, in percent
+float MiniballDataFile::GetProgress(){
+
+	std::unique_lock<std::mutex> lock( ra_mutex );
+	if( compressed ) return zlen ? (float)zpos * 100.0 / (float)zlen : 100.0;
+	return len ? (float)ra_request * 100.0 / (float)len : 100.0;
+
+}
+
+// Loop for the decompression thread, which fills the ring one chunk at a
+// time. If the start of the ring was released past the data that we have,
+// because someone jumped forward, the chunks are decompressed and dropped
+void MiniballDataFile::Decompress(){
+
+	// Each format gets a function that fills a chunk as far as it can
+	// and keeps track of how much of the compressed file was read
+	std::function<unsigned long long( char*, unsigned long long )> fill;
+
+	// gzip, including files that are several gzip streams one after another
+	gzFile gz = nullptr;
+	if( format == FORMAT_GZIP ) {
+
+		gz = gzdopen( dup(fd), "rb" );
+		if( !gz ) {
+
+			std::cerr << __FUNCTION__ << ": Unable to read " << filename << std::endl;
+			std::unique_lock<std::mutex> lock( ra_mutex );
+			stream_end = true;
+			ra_cv.notify_all();
+			return;
+
+		}
+		gzbuffer( gz, 0x40000 );
+
+		fill = [&]( char *out, unsigned long long size ){
+
+			unsigned long long done = 0;
+			while( done < size ) {
+
+				int got = gzread( gz, out + done, size - done );
+				if( got < 0 ) {
+
+					int err;
+					std::cerr << __FUNCTION__ << ": Error decompressing " << filename;
+					std::cerr << ": " << gzerror( gz, &err ) << std::endl;
+					break;
+
+				}
+				else if( got == 0 ) break;
+				done += got;
+
+			}
+
+			std::unique_lock<std::mutex> lock( ra_mutex );
+			zpos = gzoffset( gz );
+			return done;
+
+		};
+
+	}
+
+#ifdef HAVE_ZSTD
+	// zstd, reading the compressed file ourselves
+	ZSTD_DStream *zds = nullptr;
+	std::vector<char> zbuf;
+	ZSTD_inBuffer zin = { nullptr, 0, 0 };
+	bool zdone = false;
+	if( format == FORMAT_ZSTD ) {
+
+		zds = ZSTD_createDStream();
+		ZSTD_initDStream( zds );
+		zbuf.resize( ZSTD_DStreamInSize() );
+		zin.src = zbuf.data();
+
+		fill = [&]( char *out, unsigned long long size ){
+
+			ZSTD_outBuffer zout = { out, (size_t)size, 0 };
+			while( zout.pos < zout.size ) {
+
+				// Get more of the compressed file when we've used it all
+				if( zin.pos == zin.size && !zdone ) {
+
+					ssize_t got = read( fd, zbuf.data(), zbuf.size() );
+					if( got > 0 ) {
+
+						zin.size = got;
+						zin.pos = 0;
+						std::unique_lock<std::mutex> lock( ra_mutex );
+						zpos += got;
+
+					}
+					else zdone = true;
+
+				}
+
+				// Once the input is finished, carry on until nothing more comes out
+				size_t before = zout.pos;
+				size_t ret = ZSTD_decompressStream( zds, &zout, &zin );
+				if( ZSTD_isError( ret ) ) {
+
+					std::cerr << __FUNCTION__ << ": Error decompressing " << filename;
+					std::cerr << ": " << ZSTD_getErrorName( ret ) << std::endl;
+					break;
+
+				}
+				if( zdone && zout.pos == before ) break;
+
+			}
+
+			return (unsigned long long)zout.pos;
+
+		};
+
+	}
+#endif
+
+	std::unique_lock<std::mutex> lock( ra_mutex );
+
+	while( !stream_end ) {
+
+		// Wait for space in the ring
+		ra_cv.wait( lock, [&]{
+			return ra_stop || ring_end < ring_base + ring.size() * chunk_size;
+		} );
+		if( ra_stop ) break;
+
+		// A whole chunk is decompressed at once, outside of the lock
+		char *chunk = ring[ ( ring_end / chunk_size ) % ring.size() ].data();
+		lock.unlock();
+		unsigned long long got = fill( chunk, chunk_size );
+		lock.lock();
+
+		// A short chunk means we got to the end of the file
+		ring_end += got;
+		if( got < chunk_size ) {
+
+			stream_end = true;
+			len = ring_end;
+
+		}
+		ra_cv.notify_all();
+
+	}
+
+	lock.unlock();
+
+	if( gz ) gzclose( gz );
+#ifdef HAVE_ZSTD
+	if( zds ) ZSTD_freeDStream( zds );
+#endif
+
+	return;
+
+}
+
+// Give the kernel a hint to start reading the beginning of a file
+void MiniballDataFile::WillNeed( std::string _filename, unsigned long long bytes ){
+
+#ifdef POSIX_FADV_WILLNEED
+	int wfd = open( _filename.data(), O_RDONLY );
+	if( wfd < 0 ) return;
+	posix_fadvise( wfd, 0, bytes, POSIX_FADV_WILLNEED );
+	close( wfd );
+#else
+	(void)_filename;
+	(void)bytes;
+#endif
+
+}
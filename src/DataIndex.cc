@@ -0,0 +1,153 @@
+#include "DataIndex.hh"
+
+MiniballDataIndex::MiniballDataIndex() {}
+
+MiniballDataIndex::~MiniballDataIndex() {
+
+	Close();
+
+}
+
+// Open a new index file for writing
+bool MiniballDataIndex::Create( std::string _filename ){
+
+	// Close file if already open
+	Close();
+
+	index_file.open( _filename, std::ios::out | std::ios::binary | std::ios::trunc );
+	if( !index_file.is_open() ) {
+
+		std::cerr << "Unable to write index file " << _filename << std::endl;
+		return false;
+
+	}
+
+	filename = _filename;
+	entries.clear();
+	index_file.write( MAGIC, 8 );
+
+	return true;
+
+}
+
+// Add an entry to the index
+void MiniballDataIndex::Add( const MiniballDataIndexEntry &entry ){
+
+	if( index_file.is_open() )
+		index_file.write( (const char*)&entry, sizeof(entry) );
+
+	return;
+
+}
+
+// Close the index file that we are writing
+void MiniballDataIndex::Close(){
+
+	if( index_file.is_open() ) index_file.close();
+
+	return;
+
+}
+
+// Read all of the entries from an index file
+bool MiniballDataIndex::Read( std::string _filename ){
+
+	std::ifstream input_file( _filename, std::ios::in | std::ios::binary );
+	if( !input_file.is_open() ) return false;
+
+	// Check it's really an index
+	char magic[8];
+	input_file.read( magic, 8 );
+	if( !input_file.good() || std::strncmp( magic, MAGIC, 8 ) != 0 ) {
+
+		std::cerr << _filename << " is not a valid index file" << std::endl;
+		return false;
+
+	}
+
+	// Read all of the entries
+	entries.clear();
+	MiniballDataIndexEntry entry;
+	while( input_file.read( (char*)&entry, sizeof(entry) ) )
+		entries.push_back( entry );
+
+	filename = _filename;
+
+	return true;
+
+}
+
+// Get the earliest timestamp in the whole file
+unsigned long long MiniballDataIndex::GetFirstTime(){
+
+	unsigned long long first_time = -1;
+	for( unsigned long i = 0; i < entries.size(); ++i )
+		if( HasTime( entries[i] ) && entries[i].first_time < first_time )
+			first_time = entries[i].first_time;
+
+	return first_time;
+
+}
+
+// Find the entries with timestamps between start and stop seconds from the
+// beginning of the file. Hits from different SFPs overlap in time, so we
+// look for the first and the last entry that has anything in the range
+bool MiniballDataIndex::FindTimeRange( double start, double stop,
+									   unsigned long &first, unsigned long &last ){
+
+	// Timestamps are in ns
+	unsigned long long first_time = GetFirstTime();
+	unsigned long long start_time = first_time + (unsigned long long)( start * 1e9 );
+	unsigned long long stop_time  = first_time + (unsigned long long)( stop * 1e9 );
+
+	bool found = false;
+	for( unsigned long i = 0; i < entries.size(); ++i ) {
+
+		if( !HasTime( entries[i] ) ) continue;
+		if( entries[i].last_time < start_time ) continue;
+		if( entries[i].first_time > stop_time ) continue;
+
+		if( !found ) first = i;
+		last = i;
+		found = true;
+
+	}
+
+	return found;
+
+}
+
+// Find the entries for blocks between start and stop
+bool MiniballDataIndex::FindBlockRange( unsigned long long start, unsigned long long stop,
+										unsigned long &first, unsigned long &last ){
+
+	bool found = false;
+	for( unsigned long i = 0; i < entries.size(); ++i ) {
+
+		if( entries[i].block < start || entries[i].block > stop ) continue;
+
+		if( !found ) first = i;
+		last = i;
+		found = true;
+
+	}
+
+	return found;
+
+}
+
+// Find the last entry that starts at or before a given MBS event
+bool MiniballDataIndex::FindEvent( unsigned long long event, unsigned long &entry ){
+
+	bool found = false;
+	for( unsigned long i = 0; i < entries.size(); ++i ) {
+
+		if( entries[i].event > event ) break;
+		entry = i;
+		found = true;
+
+	}
+
+	return found;
+
+}
@@ -23,8 +23,9 @@ void MiniballDataPackets::SetData( std::shared_ptr<FebexData> data ){
 	// We only want to have one element per Tree entry
 	ClearData();
 	
-	// Make a copy of the input data and push it back
-	FebexData fill_data;
+	// Make a copy of the input data in place, so the trace is only copied once
+	febex_packets.emplace_back();
+	FebexData &fill_data = febex_packets.back();
 	
 	fill_data.SetTime( data->GetTime() );
 	fill_data.SetEventID( data->GetEventID() );
@@ -41,8 +42,6 @@ void MiniballDataPackets::SetData( std::shared_ptr<FebexData> data ){
 	fill_data.SetFail( data->IsFail() );
 	fill_data.SetPileUp( data->IsPileUp() );
 
-	febex_packets.push_back( fill_data );
-
 }
 
 void MiniballDataPackets::SetData( std::shared_ptr<InfoData> data ){
@@ -51,15 +50,14 @@ void MiniballDataPackets::SetData( std::shared_ptr<InfoData> data ){
 	// We only want to have one element per Tree entry
 	ClearData();
 	
-	// Make a copy of the input data and push it back
-	InfoData fill_data;
+	// Make a copy of the input data in place
+	info_packets.emplace_back();
+	InfoData &fill_data = info_packets.back();
 	fill_data.SetTime( data->GetTime() );
 	fill_data.SetEventID( data->GetEventID() );
 	fill_data.SetCode( data->GetCode() );
 	fill_data.SetSfp( data->GetSfp() );
 	fill_data.SetBoard( data->GetBoard() );
-
-	info_packets.push_back( fill_data );
 	
 }
 
@@ -73,31 +71,31 @@ void MiniballDataPackets::ClearData(){
 	
 }
 
-unsigned long long MiniballDataPackets::GetEventID(){
+unsigned long long MiniballDataPackets::GetEventID() const {
 		
-	if( IsFebex() ) return GetFebexData()->GetEventID();
-	if( IsInfo() ) return GetInfoData()->GetEventID();
+	if( IsFebex() ) return febex_packets[0].GetEventID();
+	if( IsInfo() ) return info_packets[0].GetEventID();
 
 	return 0;
 	
 }
 
-long long MiniballDataPackets::GetTime(){
+long long MiniballDataPackets::GetTime() const {
 		
-	if( IsFebex() ) return GetFebexData()->GetTime();
-	if( IsInfo() ) return GetInfoData()->GetTime();
+	if( IsFebex() ) return febex_packets[0].GetTime();
+	if( IsInfo() ) return info_packets[0].GetTime();
 
 	return 0;
 	
 }
 
-UInt_t MiniballDataPackets::GetTimeMSB(){
+UInt_t MiniballDataPackets::GetTimeMSB() const {
 	
 	return ( (this->GetTime() >> 32) & 0x0000FFFF );
 	
 }
 
-UInt_t MiniballDataPackets::GetTimeLSB(){
+UInt_t MiniballDataPackets::GetTimeLSB() const {
 	
 	return (UInt_t)this->GetTime();
 	
@@ -107,8 +105,7 @@ void FebexData::ClearData(){
 	
 	time = 0;
 	eventid = 0;
-	trace.clear();
-	std::vector<unsigned short>().swap(trace);
+	trace.clear(); // keep the space for the next trace
 	Qint = 0;
 	Qhalf = 0.;
 	Qshort = 0;
@@ -10,10 +10,18 @@ MiniballEventBuilder::MiniballEventBuilder( std::shared_ptr<MiniballSettings> my
 	
 	// No input file at the start by default
 	flag_input_file = false;
+	flag_hit_file = false;
+	hit_queue = nullptr;
 	
 	// Progress bar starts as false
 	_prog_ = false;
 
+	// Build on a single thread by default
+	nthreads = 1;
+	flag_worker = false;
+	n_slice_evts = 0;
+	flag_time_first = true;
+
 	// Start at MBS event 0
 	preveventid = 0;
 
@@ -52,6 +60,74 @@ MiniballEventBuilder::MiniballEventBuilder( std::shared_ptr<MiniballSettings> my
 		
 }
 
+MiniballEventBuilder::~MiniballEventBuilder(){
+
+	// Everything else belongs to the output file, but a
+	// worker has its own histograms and input file to clean up
+	if( !flag_worker ) return;
+
+	delete tdiff;
+	delete tdiff_clean;
+	delete pulser_period;
+	delete ebis_period;
+	delete t1_period;
+	delete sc_period;
+	delete pulser_freq;
+	delete ebis_freq;
+	delete t1_freq;
+	delete sc_freq;
+	delete mb_td_core_seg;
+	delete mb_td_core_core;
+
+	for( unsigned int i = 0; i < mb_en_core_seg.size(); ++i ) {
+
+		for( unsigned int j = 0; j < mb_en_core_seg[i].size(); ++j ) {
+
+			delete mb_en_core_seg[i][j];
+			delete mb_en_core_seg_ebis_on[i][j];
+
+		}
+
+	}
+
+	for( unsigned int i = 0; i < cd_pen_id.size(); ++i ) {
+
+		for( unsigned int j = 0; j < cd_pen_id[i].size(); ++j ) {
+
+			delete cd_pen_id[i][j];
+			delete cd_nen_id[i][j];
+			delete cd_pn_1v1[i][j];
+			delete cd_pn_1v2[i][j];
+			delete cd_pn_2v1[i][j];
+			delete cd_pn_2v2[i][j];
+			delete cd_pn_td[i][j];
+			delete cd_pp_td[i][j];
+			delete cd_nn_td[i][j];
+			delete cd_pn_mult[i][j];
+
+		}
+
+	}
+
+	delete ic_td;
+	delete ic_dE;
+	delete ic_E;
+	delete ic_dE_E;
+
+	if( flag_input_file ) {
+
+		input_tree->ResetBranchAddresses();
+		mbsinfo_tree->ResetBranchAddresses();
+		input_file->Close();
+		delete input_file;
+		hit_file.Close();
+		delete in_data;
+		delete mbs_info;
+
+	}
+
+}
+
 void MiniballEventBuilder::StartFile(){
 	
 	// Call for every new file
@@ -63,8 +139,11 @@ void MiniballEventBuilder::StartFile(){
 	time_first		= 0;
 	pulser_time		= 0;
 	pulser_prev		= 0;
+	ebis_time		= 0;
 	ebis_prev		= 0;
+	t1_time			= 0;
 	t1_prev			= 0;
+	sc_time			= 0;
 	sc_prev			= 0;
 
 	n_febex_data	= 0;
@@ -122,11 +201,66 @@ void MiniballEventBuilder::SetInputFile( std::string input_file_name ) {
 		
 	}
 	
+	// The hits might have gone straight to the event builder instead
+	if( !input_file->Get("mb_sort") ) {
+
+		std::cerr << "No mb_sort tree in " << input_file_name;
+		std::cerr << ", set WriteSortedTree to build the events from it again" << std::endl;
+		input_file->Close();
+		delete input_file;
+		input_tree = nullptr;
+		flag_input_file = false;
+		return;
+
+	}
+
 	flag_input_file = true;
+	this->input_file_name = input_file_name;
 	
 	// Set the input tree
 	SetInputTree( (TTree*)input_file->Get("mb_sort") );
 	SetMBSInfoTree( (TTree*)input_file->Get("mbsinfo") );
+
+	// Read the hits from the hit file instead if there is one. It has to
+	// have the same hits as the tree, with the same settings
+	flag_hit_file = false;
+	std::string hit_file_name = MiniballHitFile::GetHitFileName( input_file_name );
+	if( access( hit_file_name.data(), R_OK ) == 0 && hit_file.Open( hit_file_name ) ) {
+
+		if( hit_file.GetSettingsHash() != MiniballHitFile::SettingsHash( set ) ) {
+
+			if( !flag_worker )
+				std::cout << hit_file_name << " was written with different settings" << std::endl;
+
+		}
+
+		else if( (Long64_t)hit_file.GetEntries() != input_tree->GetEntries() ) {
+
+			if( !flag_worker )
+				std::cout << hit_file_name << " doesn't match the mb_sort tree" << std::endl;
+
+		}
+
+		else flag_hit_file = true;
+
+		// The workers say nothing, since we've already been told
+		if( flag_hit_file ) {
+
+			if( !flag_worker )
+				std::cout << "Reading hits from " << hit_file_name << std::endl;
+
+		}
+
+		else {
+
+			if( !flag_worker )
+				std::cout << "Reading hits from the mb_sort tree instead" << std::endl;
+			hit_file.Close();
+
+		}
+
+	}
+
 	StartFile();
 
 	return;
@@ -138,12 +272,94 @@ void MiniballEventBuilder::SetInputTree( TTree *user_tree ){
 	// Find the tree and set branch addresses
 	input_tree = user_tree;
 	in_data = nullptr;
-	input_tree->SetBranchAddress( "data", &in_data );
+	hit_queue = nullptr;
+
+	// Data packets, or flat branches for each part of the hit
+	flag_flat_input = !input_tree->GetBranch( "data" );
+	if( !flag_flat_input ) {
+
+		input_tree->SetBranchAddress( "data", &in_data );
+		return;
+
+	}
+
+	input_tree->SetBranchAddress( "time", &in_hit.time );
+	input_tree->SetBranchAddress( "eventid", &in_hit.eventid );
+	input_tree->SetBranchAddress( "energy", &in_hit.energy );
+	input_tree->SetBranchAddress( "Qint", &in_hit.Qint );
+	input_tree->SetBranchAddress( "sfp", &in_hit.sfp );
+	input_tree->SetBranchAddress( "board", &in_hit.board );
+	input_tree->SetBranchAddress( "ch", &in_hit.ch );
+	input_tree->SetBranchAddress( "code", &in_hit.code );
+	input_tree->SetBranchAddress( "flags", &in_hit.flags );
+
+	// Only read the branches that we need, so not the traces
+	input_tree->SetBranchStatus( "*", false );
+	input_tree->SetBranchStatus( "time", true );
+	input_tree->SetBranchStatus( "eventid", true );
+	input_tree->SetBranchStatus( "energy", true );
+	input_tree->SetBranchStatus( "Qint", true );
+	input_tree->SetBranchStatus( "sfp", true );
+	input_tree->SetBranchStatus( "board", true );
+	input_tree->SetBranchStatus( "ch", true );
+	input_tree->SetBranchStatus( "code", true );
+	input_tree->SetBranchStatus( "flags", true );
 
 	return;
 	
 }
 
+bool MiniballEventBuilder::GetInputEntry( unsigned long i ){
+
+	// Straight from the converter
+	if( hit_queue ) {
+
+		const MiniballHit *h = hit_queue->GetHit(i);
+		if( !h ) return false;
+		in_hit = *h;
+		return true;
+
+	}
+
+	// Straight from the hit file
+	if( flag_hit_file ) {
+
+		const MiniballHit *h = hit_file.GetHit(i);
+		if( !h ) return false;
+		in_hit = *h;
+		return true;
+
+	}
+
+	if( input_tree->GetEntry(i) <= 0 ) return false;
+
+	// The branches fill the hit already
+	if( flag_flat_input ) return true;
+
+	// Otherwise copy it from the data packets
+	if( !in_data->IsFebex() && !in_data->IsInfo() ) return false;
+	MiniballHitBuffer::FromPacket( in_data, in_hit );
+
+	return true;
+
+}
+
+void MiniballEventBuilder::SetInputQueue( MiniballHitQueue *q ){
+
+	// The hits come from the converter as it sorts them, so there are no
+	// trees to read, and the MBS info isn't ready until it has finished
+	hit_queue = q;
+	input_tree = nullptr;
+	mbsinfo_tree = nullptr;
+	flag_input_file = false;
+	flag_hit_file = false;
+
+	StartFile();
+
+	return;
+
+}
+
 void MiniballEventBuilder::SetMBSInfoTree( TTree *user_tree ){
 
 	// Find the tree and set branch addresses
@@ -192,56 +408,13 @@ void MiniballEventBuilder::Initialise(){
 	event_open = false;
 
 	hit_ctr = 0;
-	
-	mb_en_list.clear();
-	mb_ts_list.clear();
-	mb_clu_list.clear();
-	mb_cry_list.clear();
-	mb_seg_list.clear();
-	
-	std::vector<float>().swap(mb_en_list);
-	std::vector<unsigned long long>().swap(mb_ts_list);
-	std::vector<unsigned char>().swap(mb_clu_list);
-	std::vector<unsigned char>().swap(mb_cry_list);
-	std::vector<unsigned char>().swap(mb_seg_list);
-	
-	cd_en_list.clear();
-	cd_ts_list.clear();
-	cd_det_list.clear();
-	cd_sec_list.clear();
-	cd_side_list.clear();
-	cd_strip_list.clear();
-	
-	std::vector<float>().swap(cd_en_list);
-	std::vector<unsigned long long>().swap(cd_ts_list);
-	std::vector<unsigned char>().swap(cd_det_list);
-	std::vector<unsigned char>().swap(cd_sec_list);
-	std::vector<unsigned char>().swap(cd_side_list);
-	std::vector<unsigned char>().swap(cd_strip_list);
-	
-	bd_en_list.clear();
-	bd_ts_list.clear();
-	bd_det_list.clear();
-	
-	std::vector<float>().swap(bd_en_list);
-	std::vector<unsigned long long>().swap(bd_ts_list);
-	std::vector<unsigned char>().swap(bd_det_list);
-
-	spede_en_list.clear();
-	spede_ts_list.clear();
-	spede_seg_list.clear();
-	
-	std::vector<float>().swap(spede_en_list);
-	std::vector<unsigned long long>().swap(spede_ts_list);
-	std::vector<unsigned char>().swap(spede_seg_list);
 
-	ic_en_list.clear();
-	ic_ts_list.clear();
-	ic_id_list.clear();
-	
-	std::vector<float>().swap(ic_en_list);
-	std::vector<unsigned long long>().swap(ic_ts_list);
-	std::vector<unsigned char>().swap(ic_id_list);
+	// Only the lengths go back to zero, the space is kept for the next event
+	mb_hits.Clear();
+	cd_hits.Clear();
+	bd_hits.Clear();
+	spede_hits.Clear();
+	ic_hits.Clear();
 
 	write_evts->ClearEvt();
 	
@@ -250,6 +423,19 @@ void MiniballEventBuilder::Initialise(){
 }
 
 
+void MiniballEventBuilder::ChangeDirectory( std::string dirname ){
+
+	// Workers don't have an output file
+	if( !output_file ) return;
+
+	if( !output_file->GetDirectory( dirname.data() ) )
+		output_file->mkdir( dirname.data() );
+	output_file->cd( dirname.data() );
+
+	return;
+
+}
+
 void MiniballEventBuilder::MakeEventHists(){
 	
 	std::string hname, htitle;
@@ -259,9 +445,7 @@ void MiniballEventBuilder::MakeEventHists(){
 	// Timing histograms //
 	// ----------------- //
 	dirname =  "timing";
-	if( !output_file->GetDirectory( dirname.data() ) )
-		output_file->mkdir( dirname.data() );
-	output_file->cd( dirname.data() );
+	ChangeDirectory( dirname );
 
 	tdiff = new TH1F( "tdiff", "Time difference to first trigger;#Delta t [ns]", 1e3, -10, 1e5 );
 	tdiff_clean = new TH1F( "tdiff_clean", "Time difference to first trigger without noise;#Delta t [ns]", 1e3, -10, 1e5 );
@@ -279,9 +463,7 @@ void MiniballEventBuilder::MakeEventHists(){
 	// Miniball histograms //
 	// ------------------- //
 	dirname = "miniball";
-	if( !output_file->GetDirectory( dirname.data() ) )
-		output_file->mkdir( dirname.data() );
-	output_file->cd( dirname.data() );
+	ChangeDirectory( dirname );
 	
 	mb_td_core_seg  = new TH1F( "mb_td_core_seg",  "Time difference between core and segment in same crystal;#Delta t [ns]", 499, -2495, 2495 );
 	mb_td_core_core = new TH1F( "mb_td_core_core", "Time difference between two cores in same cluster;#Delta t [ns]", 499, -2495, 2495 );
@@ -292,9 +474,7 @@ void MiniballEventBuilder::MakeEventHists(){
 	for( unsigned int i = 0; i < set->GetNumberOfMiniballClusters(); ++i ) {
 		
 		dirname = "miniball/cluster_" + std::to_string(i);
-		if( !output_file->GetDirectory( dirname.data() ) )
-			output_file->mkdir( dirname.data() );
-		output_file->cd( dirname.data() );
+		ChangeDirectory( dirname );
 
 		mb_en_core_seg[i].resize( set->GetNumberOfMiniballCrystals() );
 		mb_en_core_seg_ebis_on[i].resize( set->GetNumberOfMiniballCrystals() );
@@ -323,9 +503,7 @@ void MiniballEventBuilder::MakeEventHists(){
 	// CD histograms //
 	// ------------- //
 	dirname = "cd";
-	if( !output_file->GetDirectory( dirname.data() ) )
-		output_file->mkdir( dirname.data() );
-	output_file->cd( dirname.data() );
+	ChangeDirectory( dirname );
 
 	cd_pen_id.resize( set->GetNumberOfCDDetectors() );
 	cd_nen_id.resize( set->GetNumberOfCDDetectors() );
@@ -433,9 +611,7 @@ void MiniballEventBuilder::MakeEventHists(){
 	// IonChamber histograms //
 	// --------------------- //
 	dirname = "ic";
-	if( !output_file->GetDirectory( dirname.data() ) )
-		output_file->mkdir( dirname.data() );
-	output_file->cd( dirname.data() );
+	ChangeDirectory( dirname );
 
 	ic_td = new TH1F( "ic_td", "Time difference between signals in the ion chamber;#Delta t [ns]", 499, -2495, 2495 );
 	ic_dE = new TH1F( "ic_dE", "Ionisation chamber;Energy in first layer (Gas) (arb. units);Counts", 4096, 0, 10000 );
@@ -459,14 +635,20 @@ void MiniballEventBuilder::GammaRayFinder() {
 	float AbSumEnergy; // add core energies for addback
 	unsigned char seg_mul; // segment multiplicity
 	unsigned char ab_mul; // addback multiplicity
-	std::vector<unsigned char> ab_index; // index of addback already used
-	bool skip_event; // has this event been used already
-	
+
+	// Put the hits in to buckets for each crystal, in the order that they
+	// came, so each core only has to look at the hits of its own crystal
+	unsigned int ncry = set->GetNumberOfMiniballCrystals();
+	mb_crystals.key.resize( mb_hits.size() );
+	for( unsigned int i = 0; i < mb_hits.size(); ++i )
+		mb_crystals.key[i] = mb_hits.clu.at(i) * ncry + mb_hits.cry.at(i);
+	mb_crystals.Sort( set->GetNumberOfMiniballClusters() * ncry );
+
 	// Loop over all the events in Miniball detectors
-	for( unsigned int i = 0; i < mb_en_list.size(); ++i ) {
+	for( unsigned int i = 0; i < mb_hits.size(); ++i ) {
 	
 		// Check if it's a core event
-		if( mb_seg_list.at(i) != 0 ) continue;
+		if( mb_hits.seg.at(i) != 0 ) continue;
 		
 		// Reset addback variables
 		MaxSegId = 0; // initialise as core (if no segment hit (dead), use core!)
@@ -474,103 +656,107 @@ void MiniballEventBuilder::GammaRayFinder() {
 		SegSumEnergy = 0.;
 		seg_mul = 0;
 		
-		// Loop again to find the matching segments
-		for( unsigned int j = 0; j < mb_en_list.size(); ++j ) {
+		// Loop over the hits of the same crystal and cluster to find the segments
+		unsigned int b = mb_crystals.key[i];
+		for( unsigned int k = mb_crystals.begin(b); k < mb_crystals.end(b); ++k ) {
 
-			// Skip if it's not the same crystal and cluster
-			if( mb_clu_list.at(i) != mb_clu_list.at(j) ||
-			    mb_cry_list.at(i) != mb_cry_list.at(j) ) continue;
+			unsigned int j = mb_crystals.index[k];
 			
 			// Fill the segment spectra with core energies
-			mb_en_core_seg[mb_clu_list.at(i)][mb_cry_list.at(i)]->Fill( mb_seg_list.at(j), mb_en_list.at(i) );
-			if( mb_ts_list.at(j) - ebis_time < 1.5e6 )
-				mb_en_core_seg_ebis_on[mb_clu_list.at(i)][mb_cry_list.at(i)]->Fill( mb_seg_list.at(j), mb_en_list.at(i) );
+			mb_en_core_seg[mb_hits.clu.at(i)][mb_hits.cry.at(i)]->Fill( mb_hits.seg.at(j), mb_hits.en.at(i) );
+			if( mb_hits.ts.at(j) - ebis_time < 1.5e6 )
+				mb_en_core_seg_ebis_on[mb_hits.clu.at(i)][mb_hits.cry.at(i)]->Fill( mb_hits.seg.at(j), mb_hits.en.at(i) );
 
 			// Skip if it's a core again, also fill time diff plot
-			if( i == j || mb_seg_list.at(j) == 0 ) {
+			if( i == j || mb_hits.seg.at(j) == 0 ) {
 				
 				// Fill the time difference spectrum
-				mb_td_core_core->Fill( (long long)mb_ts_list.at(i) - (long long)mb_ts_list.at(j) );
+				mb_td_core_core->Fill( (long long)mb_hits.ts.at(i) - (long long)mb_hits.ts.at(j) );
 				continue;
 			
 			}
 			
 			// Increment the segment multiplicity and sum energy
 			seg_mul++;
-			SegSumEnergy += mb_en_list.at(j);
+			SegSumEnergy += mb_hits.en.at(j);
 			
 			// Is this bigger than the current maximum energy?
-			if( mb_en_list.at(j) > MaxSegEnergy ){
+			if( mb_hits.en.at(j) > MaxSegEnergy ){
 				
-				MaxSegEnergy = mb_en_list.at(j);
-				MaxSegId = mb_seg_list.at(j);
+				MaxSegEnergy = mb_hits.en.at(j);
+				MaxSegId = mb_hits.seg.at(j);
 				
 			}
 			
 			// Fill the time difference spectrum
-			mb_td_core_seg->Fill( (long long)mb_ts_list.at(i) - (long long)mb_ts_list.at(j) );
+			mb_td_core_seg->Fill( (long long)mb_hits.ts.at(i) - (long long)mb_hits.ts.at(j) );
 			
 		} // j: matching segments
 		
 		// Build the single crystal gamma-ray event
 		gamma_ctr++;
-		gamma_evt->SetEnergy( mb_en_list.at(i) );
+		gamma_evt->SetEnergy( mb_hits.en.at(i) );
 		gamma_evt->SetSegmentEnergy( MaxSegEnergy );
-		gamma_evt->SetCluster( mb_clu_list.at(i) );
-		gamma_evt->SetCrystal( mb_cry_list.at(i) );
+		gamma_evt->SetCluster( mb_hits.clu.at(i) );
+		gamma_evt->SetCrystal( mb_hits.cry.at(i) );
 		gamma_evt->SetSegment( MaxSegId );
-		gamma_evt->SetTime( mb_ts_list.at(i) );
+		gamma_evt->SetTime( mb_hits.ts.at(i) );
 		write_evts->AddEvt( gamma_evt );
 
 	} // i: core events
 	
 	
+	// Put the gamma rays in to buckets for each cluster, in their order,
+	// and nothing has been used for addback yet
+	unsigned int ngamma = write_evts->GetGammaRayMultiplicity();
+	ab_clusters.key.resize( ngamma );
+	for( unsigned int i = 0; i < ngamma; ++i )
+		ab_clusters.key[i] = write_evts->GetGammaRayEvtRef(i).GetCluster();
+	ab_clusters.Sort( set->GetNumberOfMiniballClusters() );
+	ab_used.assign( ngamma, false );
+
 	// Loop over all the gamma-ray singles for addback
-	for( unsigned int i = 0; i < write_evts->GetGammaRayMultiplicity(); ++i ) {
+	for( unsigned int i = 0; i < ngamma; ++i ) {
+
+		// Check we haven't already used this event
+		if( ab_used[i] ) continue;
 
 		// Reset addback variables
-		AbSumEnergy = write_evts->GetGammaRayEvt(i)->GetEnergy();
-		MaxCryId = write_evts->GetGammaRayEvt(i)->GetCrystal();
-		MaxSegId = write_evts->GetGammaRayEvt(i)->GetSegment();
+		const GammaRayEvt &gi = write_evts->GetGammaRayEvtRef(i);
+		AbSumEnergy = gi.GetEnergy();
+		MaxCryId = gi.GetCrystal();
+		MaxSegId = gi.GetSegment();
 		MaxEnergy = AbSumEnergy;
-		MaxSegEnergy = write_evts->GetGammaRayEvt(i)->GetSegmentEnergy();
-		MaxTime = write_evts->GetGammaRayEvt(i)->GetTime();
+		MaxSegEnergy = gi.GetSegmentEnergy();
+		MaxTime = gi.GetTime();
 		ab_mul = 1;	// this is already the first event
 		
-		// Check we haven't already used this event
-		skip_event = false;
-		for( unsigned int k = 0; k < ab_index.size(); ++k )
-			if( ab_index.at(k) == i ) skip_event = true;
-		if( skip_event ) continue;
-
-		// Loop to find a matching event for addback
-		for( unsigned int j = i+1; j < write_evts->GetGammaRayMultiplicity(); ++j ) {
-
-			// Make sure we are in the same cluster
-			// In the future we might consider a more intelligent
-			// algorithm, which uses the line-of-sight idea
-			if( write_evts->GetGammaRayEvt(i)->GetCluster() !=
-				write_evts->GetGammaRayEvt(j)->GetCluster() ) continue;
-			
+		// Loop over the later gamma rays in the same cluster for addback
+		// In the future we might consider a more intelligent
+		// algorithm, which uses the line-of-sight idea
+		unsigned int b = ab_clusters.key[i];
+		for( unsigned int k = ab_clusters.begin(b); k < ab_clusters.end(b); ++k ) {
+
+			unsigned int j = ab_clusters.index[k];
+			if( j <= i ) continue;
+
 			// Check we haven't already used this event
-			skip_event = false;
-			for( unsigned int k = 0; k < ab_index.size(); ++k )
-				if( ab_index.at(k) == j ) skip_event = true;
-			if( skip_event ) continue;
+			if( ab_used[j] ) continue;
 			
 			// Then we can add them back
+			const GammaRayEvt &gj = write_evts->GetGammaRayEvtRef(j);
 			ab_mul++;
-			AbSumEnergy += write_evts->GetGammaRayEvt(j)->GetEnergy();
-			ab_index.push_back(j);
+			AbSumEnergy += gj.GetEnergy();
+			ab_used[j] = true;
 
 			// Is this bigger than the current maximum energy?
-			if( write_evts->GetGammaRayEvt(j)->GetEnergy() > MaxEnergy ){
+			if( gj.GetEnergy() > MaxEnergy ){
 				
-				MaxEnergy = write_evts->GetGammaRayEvt(j)->GetEnergy();
-				MaxSegEnergy = write_evts->GetGammaRayEvt(j)->GetEnergy();
-				MaxCryId = write_evts->GetGammaRayEvt(j)->GetCrystal();
-				MaxSegId = write_evts->GetGammaRayEvt(j)->GetSegment();
-				MaxTime = write_evts->GetGammaRayEvt(j)->GetTime();
+				MaxEnergy = gj.GetEnergy();
+				MaxSegEnergy = gj.GetEnergy();
+				MaxCryId = gj.GetCrystal();
+				MaxSegId = gj.GetSegment();
+				MaxTime = gj.GetTime();
 
 			}
 
@@ -580,7 +766,7 @@ void MiniballEventBuilder::GammaRayFinder() {
 		gamma_ab_ctr++;
 		gamma_ab_evt->SetEnergy( AbSumEnergy );
 		gamma_ab_evt->SetSegmentEnergy( MaxSegEnergy );
-		gamma_ab_evt->SetCluster( write_evts->GetGammaRayEvt(i)->GetCluster() );
+		gamma_ab_evt->SetCluster( gi.GetCluster() );
 		gamma_ab_evt->SetCrystal( MaxCryId );
 		gamma_ab_evt->SetSegment( MaxSegId );
 		gamma_ab_evt->SetTime( MaxTime );
@@ -595,40 +781,34 @@ void MiniballEventBuilder::GammaRayFinder() {
 
 void MiniballEventBuilder::ParticleFinder() {
 
-	// Variables for the finder algorithm
-	std::vector<unsigned char> pindex;
-	std::vector<unsigned char> nindex;
-
 	// Loop over each detector and sector
 	for( unsigned int i = 0; i < set->GetNumberOfCDDetectors(); ++i ){
 
 		for( unsigned int j = 0; j < set->GetNumberOfCDSectors(); ++j ){
 			
 			// Reset variables for a new detector element
-			pindex.clear();
-			nindex.clear();
-			std::vector<unsigned char>().swap(pindex);
-			std::vector<unsigned char>().swap(nindex);
+			cd_pindex.clear();
+			cd_nindex.clear();
 			int pmax_idx = -1, nmax_idx = -1;
 			float pmax_en = -999., nmax_en = -999.;
 			float psum_en, nsum_en;
 			
 			// Calculate p/n side multiplicities and get indicies
-			for( unsigned int k = 0; k < cd_en_list.size(); ++k ){
+			for( unsigned int k = 0; k < cd_hits.size(); ++k ){
 				
 				// Test that we have the correct detector and quadrant
-				if( i != cd_det_list.at(k) || j != cd_sec_list.at(k) )
+				if( i != cd_hits.det.at(k) || j != cd_hits.sec.at(k) )
 					continue;
 
 				// Check max energy and push back the multiplicity
-				if( cd_side_list.at(k) == 0 ) {
+				if( cd_hits.side.at(k) == 0 ) {
 				
-					pindex.push_back(k);
+					cd_pindex.push_back(k);
 					
 					// Check if it is max energy
-					if( cd_en_list.at(k) > pmax_en ){
+					if( cd_hits.en.at(k) > pmax_en ){
 					
-						pmax_en = cd_en_list.at(k);
+						pmax_en = cd_hits.en.at(k);
 						pmax_idx = k;
 					
 					}
@@ -636,14 +816,14 @@ void MiniballEventBuilder::ParticleFinder() {
 				
 				} // p-side
 				
-				else if( cd_side_list.at(k) == 1 ) {
+				else if( cd_hits.side.at(k) == 1 ) {
 					
-					nindex.push_back(k);
+					cd_nindex.push_back(k);
 				
 					// Check if it is max energy
-					if( cd_en_list.at(k) > nmax_en ){
+					if( cd_hits.en.at(k) > nmax_en ){
 					
-						nmax_en = cd_en_list.at(k);
+						nmax_en = cd_hits.en.at(k);
 						nmax_idx = k;
 					
 					}
@@ -654,34 +834,34 @@ void MiniballEventBuilder::ParticleFinder() {
 			
 			
 			// Plot multiplcities
-			if( pindex.size() || nindex.size() )
-				cd_pn_mult[i][j]->Fill( pindex.size(), nindex.size() );
+			if( cd_pindex.size() || cd_nindex.size() )
+				cd_pn_mult[i][j]->Fill( cd_pindex.size(), cd_nindex.size() );
 			
 			// Plot time differences
-			for( unsigned int p1 = 0; p1 < pindex.size(); ++p1 ){
+			for( unsigned int p1 = 0; p1 < cd_pindex.size(); ++p1 ){
 
-				for( unsigned int n1 = 0; n1 < nindex.size(); ++n1 ){
+				for( unsigned int n1 = 0; n1 < cd_nindex.size(); ++n1 ){
 					
-					cd_pn_td[i][j]->Fill( (double)cd_ts_list.at( pindex[p1] ) -
-										  (double)cd_ts_list.at( nindex[n1] ) );
+					cd_pn_td[i][j]->Fill( (double)cd_hits.ts.at( cd_pindex[p1] ) -
+										  (double)cd_hits.ts.at( cd_nindex[n1] ) );
 					
 				} // n1
 				
-				for( unsigned int p2 = p1+1; p2 < pindex.size(); ++p2 ){
+				for( unsigned int p2 = p1+1; p2 < cd_pindex.size(); ++p2 ){
 					
-					cd_pp_td[i][j]->Fill( (double)cd_ts_list.at( pindex[p1] ) -
-										  (double)cd_ts_list.at( pindex[p2] ) );
+					cd_pp_td[i][j]->Fill( (double)cd_hits.ts.at( cd_pindex[p1] ) -
+										  (double)cd_hits.ts.at( cd_pindex[p2] ) );
 					
 				} // p2
 				
 			} // p1
 			
-			for( unsigned int n1 = 0; n1 < nindex.size(); ++n1 ){
+			for( unsigned int n1 = 0; n1 < cd_nindex.size(); ++n1 ){
 
-				for( unsigned int n2 = n1+1; n2 < nindex.size(); ++n2 ){
+				for( unsigned int n2 = n1+1; n2 < cd_nindex.size(); ++n2 ){
 					
-					cd_nn_td[i][j]->Fill( (double)cd_ts_list.at( nindex[n1] ) -
-										  (double)cd_ts_list.at( nindex[n2] ) );
+					cd_nn_td[i][j]->Fill( (double)cd_hits.ts.at( cd_nindex[n1] ) -
+										  (double)cd_hits.ts.at( cd_nindex[n2] ) );
 
 				} // n2
 
@@ -691,65 +871,65 @@ void MiniballEventBuilder::ParticleFinder() {
 			// Particle reconstruction //
 			// ----------------------- //
 			// 1 vs 1 - easiest situation
-			if( pindex.size() == 1 && nindex.size() == 1 ) {
+			if( cd_pindex.size() == 1 && cd_nindex.size() == 1 ) {
 
 				// Set event
-				particle_evt->SetEnergyP( cd_en_list.at( pindex[0] ) );
-				particle_evt->SetEnergyN( cd_en_list.at( nindex[0] ) );
-				particle_evt->SetTimeP( cd_ts_list.at( pindex[0] ) );
-				particle_evt->SetTimeN( cd_ts_list.at( nindex[0] ) );
+				particle_evt->SetEnergyP( cd_hits.en.at( cd_pindex[0] ) );
+				particle_evt->SetEnergyN( cd_hits.en.at( cd_nindex[0] ) );
+				particle_evt->SetTimeP( cd_hits.ts.at( cd_pindex[0] ) );
+				particle_evt->SetTimeN( cd_hits.ts.at( cd_nindex[0] ) );
 				particle_evt->SetDetector( i );
 				particle_evt->SetSector( j );
-				particle_evt->SetStripP( cd_strip_list.at( pindex[0] ) );
-				particle_evt->SetStripN( cd_strip_list.at( nindex[0] ) );
+				particle_evt->SetStripP( cd_hits.strip.at( cd_pindex[0] ) );
+				particle_evt->SetStripN( cd_hits.strip.at( cd_nindex[0] ) );
 
 				// Fill tree
 				write_evts->AddEvt( particle_evt );
 				cd_ctr++;
 
 				// Fill histograms
-				cd_pen_id[i][j]->Fill( cd_strip_list.at( pindex[0] ),
-									  cd_en_list.at( pindex[0] ) );
-				cd_nen_id[i][j]->Fill( cd_strip_list.at( nindex[0] ),
-									  cd_en_list.at( nindex[0] ) );
-				cd_pn_1v1[i][j]->Fill( cd_en_list.at( pindex[0] ),
-									  cd_en_list.at( nindex[0] ) );
+				cd_pen_id[i][j]->Fill( cd_hits.strip.at( cd_pindex[0] ),
+									  cd_hits.en.at( cd_pindex[0] ) );
+				cd_nen_id[i][j]->Fill( cd_hits.strip.at( cd_nindex[0] ),
+									  cd_hits.en.at( cd_nindex[0] ) );
+				cd_pn_1v1[i][j]->Fill( cd_hits.en.at( cd_pindex[0] ),
+									  cd_hits.en.at( cd_nindex[0] ) );
 
 			} // 1 vs 1
 			
 			// 1 vs 2 - n-side charge sharing?
-			if( pindex.size() == 1 && nindex.size() == 2 ) {
+			if( cd_pindex.size() == 1 && cd_nindex.size() == 2 ) {
 
 				// Neighbour strips
-				if( TMath::Abs( cd_strip_list.at( nindex[0] ) - cd_strip_list.at( nindex[1] ) ) == 1 ) {
+				if( TMath::Abs( cd_hits.strip.at( cd_nindex[0] ) - cd_hits.strip.at( cd_nindex[1] ) ) == 1 ) {
 
 					// Simple sum of both energies, cross-talk not included yet
-					nsum_en  = cd_en_list.at( nindex[0] );
-					nsum_en += cd_en_list.at( nindex[1] );
+					nsum_en  = cd_hits.en.at( cd_nindex[0] );
+					nsum_en += cd_hits.en.at( cd_nindex[1] );
 					
 					// Set event
-					particle_evt->SetEnergyP( cd_en_list.at( pindex[0] ) );
+					particle_evt->SetEnergyP( cd_hits.en.at( cd_pindex[0] ) );
 					particle_evt->SetEnergyN( nsum_en );
-					particle_evt->SetTimeP( cd_ts_list.at( pindex[0] ) );
-					particle_evt->SetTimeN( cd_ts_list.at( nmax_idx ) );
+					particle_evt->SetTimeP( cd_hits.ts.at( cd_pindex[0] ) );
+					particle_evt->SetTimeN( cd_hits.ts.at( nmax_idx ) );
 					particle_evt->SetDetector( i );
 					particle_evt->SetSector( j );
-					particle_evt->SetStripP( cd_strip_list.at( pindex[0] ) );
-					particle_evt->SetStripN( cd_strip_list.at( nmax_idx ) );
+					particle_evt->SetStripP( cd_hits.strip.at( cd_pindex[0] ) );
+					particle_evt->SetStripN( cd_hits.strip.at( nmax_idx ) );
 
 					// Fill tree
 					write_evts->AddEvt( particle_evt );
 					cd_ctr++;
 
 					// Fill histograms
-					cd_pen_id[i][j]->Fill( cd_strip_list.at( pindex[0] ),
-										  cd_en_list.at( pindex[0] ) );
+					cd_pen_id[i][j]->Fill( cd_hits.strip.at( cd_pindex[0] ),
+										  cd_hits.en.at( cd_pindex[0] ) );
 					cd_nen_id[i][j]->Fill( nsum_en,
-										  cd_en_list.at( nmax_idx ) );
-					cd_pn_1v2[i][j]->Fill( cd_en_list.at( pindex[0] ),
-										  cd_en_list.at( nindex[0] ) );
-					cd_pn_1v2[i][j]->Fill( cd_en_list.at( pindex[0] ),
-										  cd_en_list.at( nindex[1] ) );
+										  cd_hits.en.at( nmax_idx ) );
+					cd_pn_1v2[i][j]->Fill( cd_hits.en.at( cd_pindex[0] ),
+										  cd_hits.en.at( cd_nindex[0] ) );
+					cd_pn_1v2[i][j]->Fill( cd_hits.en.at( cd_pindex[0] ),
+										  cd_hits.en.at( cd_nindex[1] ) );
 
 				} // neighbour strips
 				
@@ -757,24 +937,24 @@ void MiniballEventBuilder::ParticleFinder() {
 				else {
 					
 					// Set event
-					particle_evt->SetEnergyP( cd_en_list.at( pindex[0] ) );
-					particle_evt->SetEnergyN( cd_en_list.at( nmax_idx ) );
-					particle_evt->SetTimeP( cd_ts_list.at( pindex[0] ) );
-					particle_evt->SetTimeN( cd_ts_list.at( nmax_idx ) );
+					particle_evt->SetEnergyP( cd_hits.en.at( cd_pindex[0] ) );
+					particle_evt->SetEnergyN( cd_hits.en.at( nmax_idx ) );
+					particle_evt->SetTimeP( cd_hits.ts.at( cd_pindex[0] ) );
+					particle_evt->SetTimeN( cd_hits.ts.at( nmax_idx ) );
 					particle_evt->SetDetector( i );
 					particle_evt->SetSector( j );
-					particle_evt->SetStripP( cd_strip_list.at( pindex[0] ) );
-					particle_evt->SetStripN( cd_strip_list.at( nmax_idx ) );
+					particle_evt->SetStripP( cd_hits.strip.at( cd_pindex[0] ) );
+					particle_evt->SetStripN( cd_hits.strip.at( nmax_idx ) );
 
 					// Fill tree
 					write_evts->AddEvt( particle_evt );
 					cd_ctr++;
 
 					// Fill histograms
-					cd_pen_id[i][j]->Fill( cd_strip_list.at( pindex[0] ),
-										  cd_en_list.at( pindex[0] ) );
-					cd_nen_id[i][j]->Fill( cd_strip_list.at( nmax_idx ),
-										  cd_en_list.at( nmax_idx ) );
+					cd_pen_id[i][j]->Fill( cd_hits.strip.at( cd_pindex[0] ),
+										  cd_hits.en.at( cd_pindex[0] ) );
+					cd_nen_id[i][j]->Fill( cd_hits.strip.at( nmax_idx ),
+										  cd_hits.en.at( nmax_idx ) );
 
 					
 				} // treat as 1 vs 1
@@ -782,24 +962,24 @@ void MiniballEventBuilder::ParticleFinder() {
 			} // 1 vs 2
 			
 			// 2 vs 1 - p-side charge sharing?
-			if( pindex.size() == 2 && nindex.size() == 1 ) {
+			if( cd_pindex.size() == 2 && cd_nindex.size() == 1 ) {
 
 				// Neighbour strips
-				if( TMath::Abs( cd_strip_list.at( pindex[0] ) - cd_strip_list.at( pindex[1] ) ) == 1 ) {
+				if( TMath::Abs( cd_hits.strip.at( cd_pindex[0] ) - cd_hits.strip.at( cd_pindex[1] ) ) == 1 ) {
 
 					// Simple sum of both energies, cross-talk not included yet
-					psum_en  = cd_en_list.at( pindex[0] );
-					psum_en += cd_en_list.at( pindex[1] );
+					psum_en  = cd_hits.en.at( cd_pindex[0] );
+					psum_en += cd_hits.en.at( cd_pindex[1] );
 					
 					// Set event
 					particle_evt->SetEnergyP( psum_en );
-					particle_evt->SetEnergyN( cd_en_list.at( nindex[0] ) );
-					particle_evt->SetTimeP( cd_ts_list.at( pmax_idx ) );
-					particle_evt->SetTimeN( cd_ts_list.at( nindex[0] ) );
+					particle_evt->SetEnergyN( cd_hits.en.at( cd_nindex[0] ) );
+					particle_evt->SetTimeP( cd_hits.ts.at( pmax_idx ) );
+					particle_evt->SetTimeN( cd_hits.ts.at( cd_nindex[0] ) );
 					particle_evt->SetDetector( i );
 					particle_evt->SetSector( j );
-					particle_evt->SetStripP( cd_strip_list.at( pmax_idx ) );
-					particle_evt->SetStripN( cd_strip_list.at( nindex[0] ) );
+					particle_evt->SetStripP( cd_hits.strip.at( pmax_idx ) );
+					particle_evt->SetStripN( cd_hits.strip.at( cd_nindex[0] ) );
 
 					// Fill tree
 					write_evts->AddEvt( particle_evt );
@@ -807,13 +987,13 @@ void MiniballEventBuilder::ParticleFinder() {
 
 					// Fill histograms
 					cd_pen_id[i][j]->Fill( psum_en,
-										  cd_en_list.at( pmax_idx ) );
-					cd_nen_id[i][j]->Fill( cd_strip_list.at( nindex[0] ),
-										  cd_en_list.at( nindex[0] ) );
-					cd_pn_2v1[i][j]->Fill( cd_en_list.at( pindex[0] ),
-										  cd_en_list.at( nindex[0] ) );
-					cd_pn_2v1[i][j]->Fill( cd_en_list.at( pindex[1] ),
-										  cd_en_list.at( nindex[0] ) );
+										  cd_hits.en.at( pmax_idx ) );
+					cd_nen_id[i][j]->Fill( cd_hits.strip.at( cd_nindex[0] ),
+										  cd_hits.en.at( cd_nindex[0] ) );
+					cd_pn_2v1[i][j]->Fill( cd_hits.en.at( cd_pindex[0] ),
+										  cd_hits.en.at( cd_nindex[0] ) );
+					cd_pn_2v1[i][j]->Fill( cd_hits.en.at( cd_pindex[1] ),
+										  cd_hits.en.at( cd_nindex[0] ) );
 
 				} // neighbour strips
 
@@ -821,24 +1001,24 @@ void MiniballEventBuilder::ParticleFinder() {
 				else {
 					
 					// Set event
-					particle_evt->SetEnergyP( cd_en_list.at( pmax_idx ) );
-					particle_evt->SetEnergyN( cd_en_list.at( nindex[0] ) );
-					particle_evt->SetTimeP( cd_ts_list.at( pmax_idx ) );
-					particle_evt->SetTimeN( cd_ts_list.at( nindex[0] ) );
+					particle_evt->SetEnergyP( cd_hits.en.at( pmax_idx ) );
+					particle_evt->SetEnergyN( cd_hits.en.at( cd_nindex[0] ) );
+					particle_evt->SetTimeP( cd_hits.ts.at( pmax_idx ) );
+					particle_evt->SetTimeN( cd_hits.ts.at( cd_nindex[0] ) );
 					particle_evt->SetDetector( i );
 					particle_evt->SetSector( j );
-					particle_evt->SetStripP( cd_strip_list.at( pmax_idx ) );
-					particle_evt->SetStripN( cd_strip_list.at( nindex[0] ) );
+					particle_evt->SetStripP( cd_hits.strip.at( pmax_idx ) );
+					particle_evt->SetStripN( cd_hits.strip.at( cd_nindex[0] ) );
 
 					// Fill tree
 					write_evts->AddEvt( particle_evt );
 					cd_ctr++;
 
 					// Fill histograms
-					cd_pen_id[i][j]->Fill( cd_strip_list.at( pmax_idx ),
-										  cd_en_list.at( pmax_idx ) );
-					cd_nen_id[i][j]->Fill( cd_strip_list.at( nindex[0] ),
-										  cd_en_list.at( nindex[0] ) );
+					cd_pen_id[i][j]->Fill( cd_hits.strip.at( pmax_idx ),
+										  cd_hits.en.at( pmax_idx ) );
+					cd_nen_id[i][j]->Fill( cd_hits.strip.at( cd_nindex[0] ),
+										  cd_hits.en.at( cd_nindex[0] ) );
 
 					
 				} // treat as 1 vs 1
@@ -846,102 +1026,102 @@ void MiniballEventBuilder::ParticleFinder() {
 			} // 2 vs 1
 			
 			// 2 vs 2 - charge sharing on both or two particles?
-			if( pindex.size() == 2 && nindex.size() == 2 ) {
+			if( cd_pindex.size() == 2 && cd_nindex.size() == 2 ) {
 
 				// Neighbour strips - p-side + n-side
-				if( TMath::Abs( cd_strip_list.at( pindex[0] ) - cd_strip_list.at( pindex[1] ) ) == 1 &&
-				    TMath::Abs( cd_strip_list.at( nindex[0] ) - cd_strip_list.at( nindex[1] ) ) == 1 ) {
+				if( TMath::Abs( cd_hits.strip.at( cd_pindex[0] ) - cd_hits.strip.at( cd_pindex[1] ) ) == 1 &&
+				    TMath::Abs( cd_hits.strip.at( cd_nindex[0] ) - cd_hits.strip.at( cd_nindex[1] ) ) == 1 ) {
 
 					// Simple sum of both energies, cross-talk not included yet
-					psum_en  = cd_en_list.at( pindex[0] );
-					psum_en += cd_en_list.at( pindex[1] );
-					nsum_en  = cd_en_list.at( nindex[0] );
-					nsum_en += cd_en_list.at( nindex[1] );
+					psum_en  = cd_hits.en.at( cd_pindex[0] );
+					psum_en += cd_hits.en.at( cd_pindex[1] );
+					nsum_en  = cd_hits.en.at( cd_nindex[0] );
+					nsum_en += cd_hits.en.at( cd_nindex[1] );
 
 					// Set event
 					particle_evt->SetEnergyP( psum_en );
 					particle_evt->SetEnergyN( nsum_en );
-					particle_evt->SetTimeP( cd_ts_list.at( pmax_idx ) );
-					particle_evt->SetTimeN( cd_ts_list.at( nmax_idx ) );
+					particle_evt->SetTimeP( cd_hits.ts.at( pmax_idx ) );
+					particle_evt->SetTimeN( cd_hits.ts.at( nmax_idx ) );
 					particle_evt->SetDetector( i );
 					particle_evt->SetSector( j );
-					particle_evt->SetStripP( cd_strip_list.at( pmax_idx ) );
-					particle_evt->SetStripN( cd_strip_list.at( nmax_idx ) );
+					particle_evt->SetStripP( cd_hits.strip.at( pmax_idx ) );
+					particle_evt->SetStripN( cd_hits.strip.at( nmax_idx ) );
 
 					// Fill tree
 					write_evts->AddEvt( particle_evt );
 					cd_ctr++;
 
 					// Fill histograms
-					cd_pen_id[i][j]->Fill( cd_strip_list.at( pmax_idx ),
+					cd_pen_id[i][j]->Fill( cd_hits.strip.at( pmax_idx ),
 										  psum_en );
-					cd_nen_id[i][j]->Fill( cd_strip_list.at( nmax_idx ),
+					cd_nen_id[i][j]->Fill( cd_hits.strip.at( nmax_idx ),
 										  nsum_en );
-					cd_pn_2v2[i][j]->Fill( cd_en_list.at( pindex[0] ),
-										  cd_en_list.at( nindex[0] ) );
-					cd_pn_2v2[i][j]->Fill( cd_en_list.at( pindex[0] ),
-										  cd_en_list.at( nindex[1] ) );
-					cd_pn_2v2[i][j]->Fill( cd_en_list.at( pindex[1] ),
-										  cd_en_list.at( nindex[0] ) );
-					cd_pn_2v2[i][j]->Fill( cd_en_list.at( pindex[1] ),
-										  cd_en_list.at( nindex[1] ) );
+					cd_pn_2v2[i][j]->Fill( cd_hits.en.at( cd_pindex[0] ),
+										  cd_hits.en.at( cd_nindex[0] ) );
+					cd_pn_2v2[i][j]->Fill( cd_hits.en.at( cd_pindex[0] ),
+										  cd_hits.en.at( cd_nindex[1] ) );
+					cd_pn_2v2[i][j]->Fill( cd_hits.en.at( cd_pindex[1] ),
+										  cd_hits.en.at( cd_nindex[0] ) );
+					cd_pn_2v2[i][j]->Fill( cd_hits.en.at( cd_pindex[1] ),
+										  cd_hits.en.at( cd_nindex[1] ) );
 
 				} // neighbour strips - p-side + n-side
 
 				// Neighbour strips - p-side only
-				else if( TMath::Abs( cd_strip_list.at( pindex[0] ) - cd_strip_list.at( pindex[1] ) ) == 1 ) {
+				else if( TMath::Abs( cd_hits.strip.at( cd_pindex[0] ) - cd_hits.strip.at( cd_pindex[1] ) ) == 1 ) {
 
 					// Simple sum of both energies, cross-talk not included yet
-					psum_en  = cd_en_list.at( pindex.at(0) );
-					psum_en += cd_en_list.at( pindex.at(1) );
+					psum_en  = cd_hits.en.at( cd_pindex.at(0) );
+					psum_en += cd_hits.en.at( cd_pindex.at(1) );
 
 					// Set event
 					particle_evt->SetEnergyP( psum_en );
 					particle_evt->SetEnergyN( nmax_en );
-					particle_evt->SetTimeP( cd_ts_list.at( pmax_idx ) );
-					particle_evt->SetTimeN( cd_ts_list.at( nmax_idx ) );
+					particle_evt->SetTimeP( cd_hits.ts.at( pmax_idx ) );
+					particle_evt->SetTimeN( cd_hits.ts.at( nmax_idx ) );
 					particle_evt->SetDetector( i );
 					particle_evt->SetSector( j );
-					particle_evt->SetStripP( cd_strip_list.at( pmax_idx ) );
-					particle_evt->SetStripN( cd_strip_list.at( nmax_idx ) );
+					particle_evt->SetStripP( cd_hits.strip.at( pmax_idx ) );
+					particle_evt->SetStripN( cd_hits.strip.at( nmax_idx ) );
 
 					// Fill tree
 					write_evts->AddEvt( particle_evt );
 					cd_ctr++;
 
 					// Fill histograms
-					cd_pen_id[i][j]->Fill( cd_strip_list.at( pmax_idx ),
+					cd_pen_id[i][j]->Fill( cd_hits.strip.at( pmax_idx ),
 										  psum_en );
-					cd_nen_id[i][j]->Fill( cd_strip_list.at( nmax_idx ),
-										  cd_en_list.at( nmax_idx ) );
+					cd_nen_id[i][j]->Fill( cd_hits.strip.at( nmax_idx ),
+										  cd_hits.en.at( nmax_idx ) );
 					
 				} // neighbour strips - p-side only
 
 				// Neighbour strips - n-side only
-				if( TMath::Abs( cd_strip_list.at( nindex[0] ) - cd_strip_list.at( nindex[1] ) ) == 1 ) {
+				if( TMath::Abs( cd_hits.strip.at( cd_nindex[0] ) - cd_hits.strip.at( cd_nindex[1] ) ) == 1 ) {
 
 					// Simple sum of both energies, cross-talk not included yet
-					nsum_en  = cd_en_list.at( nindex.at(0) );
-					nsum_en += cd_en_list.at( nindex.at(1) );
+					nsum_en  = cd_hits.en.at( cd_nindex.at(0) );
+					nsum_en += cd_hits.en.at( cd_nindex.at(1) );
 
 					// Set event
-					particle_evt->SetEnergyP( cd_en_list.at( pmax_idx ) );
+					particle_evt->SetEnergyP( cd_hits.en.at( pmax_idx ) );
 					particle_evt->SetEnergyN( nsum_en );
-					particle_evt->SetTimeP( cd_ts_list.at( pmax_idx ) );
-					particle_evt->SetTimeN( cd_ts_list.at( nmax_idx ) );
+					particle_evt->SetTimeP( cd_hits.ts.at( pmax_idx ) );
+					particle_evt->SetTimeN( cd_hits.ts.at( nmax_idx ) );
 					particle_evt->SetDetector( i );
 					particle_evt->SetSector( j );
-					particle_evt->SetStripP( cd_strip_list.at( pmax_idx ) );
-					particle_evt->SetStripN( cd_strip_list.at( nmax_idx ) );
+					particle_evt->SetStripP( cd_hits.strip.at( pmax_idx ) );
+					particle_evt->SetStripN( cd_hits.strip.at( nmax_idx ) );
 
 					// Fill tree
 					write_evts->AddEvt( particle_evt );
 					cd_ctr++;
 
 					// Fill histograms
-					cd_pen_id[i][j]->Fill( cd_strip_list.at( pmax_idx ),
-										  cd_en_list.at( pmax_idx ) );
-					cd_nen_id[i][j]->Fill( cd_strip_list.at( nmax_idx ),
+					cd_pen_id[i][j]->Fill( cd_hits.strip.at( pmax_idx ),
+										  cd_hits.en.at( pmax_idx ) );
+					cd_nen_id[i][j]->Fill( cd_hits.strip.at( nmax_idx ),
 										  nsum_en );
 
 				} // neighbour strips - n-side only
@@ -954,12 +1134,12 @@ void MiniballEventBuilder::ParticleFinder() {
 				// Set event
 				particle_evt->SetEnergyP( pmax_en );
 				particle_evt->SetEnergyN( nmax_en );
-				particle_evt->SetTimeP( cd_ts_list.at( pmax_idx ) );
-				particle_evt->SetTimeN( cd_ts_list.at( nmax_idx ) );
+				particle_evt->SetTimeP( cd_hits.ts.at( pmax_idx ) );
+				particle_evt->SetTimeN( cd_hits.ts.at( nmax_idx ) );
 				particle_evt->SetDetector( i );
 				particle_evt->SetSector( j );
-				particle_evt->SetStripP( cd_strip_list.at( pmax_idx ) );
-				particle_evt->SetStripN( cd_strip_list.at( nmax_idx ) );
+				particle_evt->SetStripP( cd_hits.strip.at( pmax_idx ) );
+				particle_evt->SetStripN( cd_hits.strip.at( nmax_idx ) );
 
 				// Fill tree
 				write_evts->AddEvt( particle_evt );
@@ -979,11 +1159,11 @@ void MiniballEventBuilder::BeamDumpFinder(){
 
 	// Build individual beam dump events
 	// Loop over all the events in beam dump detectors
-	for( unsigned int i = 0; i < bd_en_list.size(); ++i ) {
+	for( unsigned int i = 0; i < bd_hits.size(); ++i ) {
 	
-		bd_evt->SetEnergy( bd_en_list.at(i) );
-		bd_evt->SetTime( bd_ts_list.at(i) );
-		bd_evt->SetDetector( bd_det_list.at(i) );
+		bd_evt->SetEnergy( bd_hits.en.at(i) );
+		bd_evt->SetTime( bd_hits.ts.at(i) );
+		bd_evt->SetDetector( bd_hits.det.at(i) );
 		write_evts->AddEvt( bd_evt );
 		bd_ctr++;
 		
@@ -997,11 +1177,11 @@ void MiniballEventBuilder::SpedeFinder(){
 
 	// Build individual Spede events
 	// Loop over all the events in Spede detector
-	for( unsigned int i = 0; i < spede_en_list.size(); ++i ) {
+	for( unsigned int i = 0; i < spede_hits.size(); ++i ) {
 	
-		spede_evt->SetEnergy( spede_en_list.at(i) );
-		spede_evt->SetTime( spede_ts_list.at(i) );
-		spede_evt->SetSegment( spede_seg_list.at(i) );
+		spede_evt->SetEnergy( spede_hits.en.at(i) );
+		spede_evt->SetTime( spede_hits.ts.at(i) );
+		spede_evt->SetSegment( spede_hits.seg.at(i) );
 		write_evts->AddEvt( spede_evt );
 		spede_ctr++;
 
@@ -1015,61 +1195,61 @@ void MiniballEventBuilder::IonChamberFinder(){
 
 	// Build individual ion chamber events
 	// Checks to prevent re-using events
-	std::vector<unsigned int> index;
-	std::vector<unsigned int> layer;
 	bool flag_skip;
+	ic_index.clear();
+	ic_layer.clear();
 	
 	// Loop over IonChamber events
-	for( unsigned int i = 0; i < ic_en_list.size(); ++i ) {
+	for( unsigned int i = 0; i < ic_hits.size(); ++i ) {
 
 		ic_evt->ClearEvt();
 
-		if( ic_id_list[i] == 0 ){
+		if( ic_hits.id[i] == 0 ){
 			
-			ic_evt->SetdETime( ic_ts_list[i] );
-			ic_dE->Fill( ic_en_list[i] );
+			ic_evt->SetdETime( ic_hits.ts[i] );
+			ic_dE->Fill( ic_hits.en[i] );
 	
 		}
 	
-		else if( ic_id_list[i] == set->GetNumberOfIonChamberLayers()-1 ){
+		else if( ic_hits.id[i] == set->GetNumberOfIonChamberLayers()-1 ){
 		
-			ic_evt->SetETime( ic_ts_list[i] );
-			ic_E->Fill( ic_en_list[i] );
+			ic_evt->SetETime( ic_hits.ts[i] );
+			ic_E->Fill( ic_hits.en[i] );
 	
 		}
 
-		ic_evt->AddIonChamber( ic_en_list[i], ic_id_list[i] );
-		index.push_back( i );
-		layer.push_back( ic_id_list[i] );
+		ic_evt->AddIonChamber( ic_hits.en[i], ic_hits.id[i] );
+		ic_index.push_back( i );
+		ic_layer.push_back( ic_hits.id[i] );
 		
 		// Look for matching events in other layers
-		for( unsigned int j = 0; j < ic_en_list.size(); ++j ) {
+		for( unsigned int j = 0; j < ic_hits.size(); ++j ) {
 
 			// Can't be coincident with itself
 			if( i == j ) continue;
 
 			// Time difference plot
-			ic_td->Fill( (double)ic_ts_list[i] - (double)ic_ts_list[j] );
+			ic_td->Fill( (double)ic_hits.ts[i] - (double)ic_hits.ts[j] );
 			
 			// Check if we already used this hit
 			flag_skip = false;
-			for( unsigned int k = 0; k < index.size(); ++k ) {
-				if( index[k] == j ) flag_skip = true;
-				if( layer[k] == ic_id_list[j] ) flag_skip = true;
+			for( unsigned int k = 0; k < ic_index.size(); ++k ) {
+				if( ic_index[k] == j ) flag_skip = true;
+				if( ic_layer[k] == ic_hits.id[j] ) flag_skip = true;
 			}
 			
 			// Found a match
-			if( ic_id_list[j] != ic_id_list[i] && !flag_skip &&
-			   TMath::Abs( (double)ic_ts_list[i] - (double)ic_ts_list[j] ) < set->GetIonChamberHitWindow() ){
+			if( ic_hits.id[j] != ic_hits.id[i] && !flag_skip &&
+			   TMath::Abs( (double)ic_hits.ts[i] - (double)ic_hits.ts[j] ) < set->GetIonChamberHitWindow() ){
 				
-				index.push_back( j );
-				layer.push_back( ic_id_list[j] );
-				ic_evt->AddIonChamber( ic_en_list[j], ic_id_list[j] );
+				ic_index.push_back( j );
+				ic_layer.push_back( ic_hits.id[j] );
+				ic_evt->AddIonChamber( ic_hits.en[j], ic_hits.id[j] );
 				
-				if( ic_id_list[j] == 0 )
-					ic_evt->SetdETime( ic_ts_list[j] );
-				else if( ic_id_list[j] == set->GetNumberOfIonChamberLayers()-1 )
-					ic_evt->SetETime( ic_ts_list[j] );
+				if( ic_hits.id[j] == 0 )
+					ic_evt->SetdETime( ic_hits.ts[j] );
+				else if( ic_hits.id[j] == set->GetNumberOfIonChamberLayers()-1 )
+					ic_evt->SetETime( ic_hits.ts[j] );
 
 			}
 			
@@ -1092,84 +1272,68 @@ void MiniballEventBuilder::IonChamberFinder(){
 
 
 
-unsigned long MiniballEventBuilder::BuildEvents() {
-	
-	/// Function to loop over the sort tree and build array and recoil events
+void MiniballEventBuilder::BuildSlice( unsigned long first, unsigned long last ) {
 
-	// Load the full tree if possible
-	//output_tree->SetMaxVirtualSize(200e6);	// 200 MB
-	//input_tree->SetMaxVirtualSize(200e6); 	// 200 MB
-	//input_tree->LoadBaskets(200e6); 		// Load 200 MB of data to memory
+	/// Function to build the events from part of the sort tree
 
-	if( input_tree->LoadTree(0) < 0 ){
-		
-		std::cout << " Event Building: nothing to do" << std::endl;
-		return 0;
-		
-	}
-	
-	// Get ready and go
-	Initialise();
-	n_entries = input_tree->GetEntries();
+	// Workers start again with each slice
+	if( flag_worker ) StartSlice( first );
 
-	std::cout << " Event Building: number of entries in input tree = ";
-	std::cout << n_entries << std::endl;
+	// Get the first hit, the rest are read as we look ahead
+	GetInputEntry( first );
+	myeventid = in_hit.eventid;
 
-	std::cout << "\tnumber of MBS Events/triggers in input tree = ";
-	std::cout << mbsinfo_tree->GetEntries() << std::endl;
-	
-	// ------------------------------------------------------------------------ //
-	// Main loop over TTree to find events
-	// ------------------------------------------------------------------------ //
-	for( unsigned long i = 0; i < n_entries; ++i ) {
-		
-		// Current event data
-		//if( input_tree->MemoryFull(30e6) )
-		//	input_tree->DropBaskets();
-
-		// First event, yes please!
-		if( i == 0 ){
-
-			input_tree->GetEntry(i);
-			myeventid = in_data->GetEventID();
-			myeventtime = in_data->GetTime();
+	// First event, yes please!
+	if( first == 0 ){
 
-			// Try to get the MBS info event with the index
-			if( mbsinfo_tree->GetEntryWithIndex( myeventid ) < 0 ) {
+		myeventtime = in_hit.time;
 
-				// Look for the matches MBS Info event if we didn't match automatically
-				for( long j = 0; j < mbsinfo_tree->GetEntries(); ++j ){
+		// Try to get the MBS info event with the index, but not when the
+		// hits come from the queue, since the converter is still writing it
+		if( mbsinfo_tree && mbsinfo_tree->GetEntryWithIndex( myeventid ) < 0 ) {
 
-					mbsinfo_tree->GetEntry(j);
-					if( mbs_info->GetEventID() == myeventid ) {
-						myeventtime = mbs_info->GetTime();
-						break;
-					}
+			// Look for the matches MBS Info event if we didn't match automatically
+			for( long j = 0; j < mbsinfo_tree->GetEntries(); ++j ){
 
-					// Panic if we failed!
-					if( j+1 == mbsinfo_tree->GetEntries() ) {
-						std::cerr << "Didn't find matching MBS Event IDs at start of the file: ";
-						std::cerr << myeventid << std::endl;
-					}
+				mbsinfo_tree->GetEntry(j);
+				if( mbs_info->GetEventID() == myeventid ) {
+					myeventtime = mbs_info->GetTime();
+					break;
+				}
 
+				// Panic if we failed!
+				if( j+1 == mbsinfo_tree->GetEntries() ) {
+					std::cerr << "Didn't find matching MBS Event IDs at start of the file: ";
+					std::cerr << myeventid << std::endl;
 				}
 
 			}
 
-			std::cout << "MBS Trigger time = " << myeventtime << std::endl;
-
 		}
 
+		std::cout << "MBS Trigger time = " << myeventtime << std::endl;
+
+	}
+
+	// ------------------------------------------------------------------------ //
+	// Main loop over TTree to find events
+	// ------------------------------------------------------------------------ //
+	for( unsigned long i = first; i < last; ++i ) {
+		
+		// Current event data
+		//if( input_tree->MemoryFull(30e6) )
+		//	input_tree->DropBaskets();
+		
 		// Get the time of the event
-		mytime = in_data->GetTime(); // this is normal
-		//myhittime = in_data->GetTime();	// this is for is697
+		mytime = in_hit.time; // this is normal
+		//myhittime = in_hit.time;	// this is for is697
 		//mytime = myeventtime + myhittime; // this is for is697
 		
 		// check time stamp monotonically increases!
 		if( time_prev > mytime ) {
 			
 			std::cout << "Out of order event in file ";
-			std::cout << input_tree->GetName() << std::endl;
+			std::cout << ( input_tree ? input_tree->GetName() : "from the converter" ) << std::endl;
 			
 		}
 			
@@ -1190,19 +1354,18 @@ unsigned long MiniballEventBuilder::BuildEvents() {
 		// ------------------------------------------ //
 		// Find FEBEX data
 		// ------------------------------------------ //
-		if( in_data->IsFebex() ) {
+		if( in_hit.flags & MiniballHitBuffer::FLAG_FEBEX ) {
 			
 			// Get the data
-			febex_data = in_data->GetFebexData();
-			mysfp = febex_data->GetSfp();
-			myboard = febex_data->GetBoard();
-			mych = febex_data->GetChannel();
+			mysfp = in_hit.sfp;
+			myboard = in_hit.board;
+			mych = in_hit.ch;
 			if( overwrite_cal ) {
 				
 				myenergy = cal->FebexEnergy( mysfp, myboard, mych,
-									febex_data->GetQint() );
+									in_hit.Qint );
 				
-				if( febex_data->GetQint() > cal->FebexThreshold( mysfp, myboard, mych ) )
+				if( in_hit.Qint > cal->FebexThreshold( mysfp, myboard, mych ) )
 					mythres = true;
 				else mythres = false;
 
@@ -1210,8 +1373,8 @@ unsigned long MiniballEventBuilder::BuildEvents() {
 			
 			else {
 				
-				myenergy = febex_data->GetEnergy();
-				mythres = febex_data->IsOverThreshold();
+				myenergy = in_hit.energy;
+				mythres = ( in_hit.flags & MiniballHitBuffer::FLAG_THRES );
 
 			}
 			
@@ -1219,79 +1382,67 @@ unsigned long MiniballEventBuilder::BuildEvents() {
 			n_febex_data++;
 			n_sfp[mysfp]++;
 			n_board[mysfp][myboard]++;
+
+			// What sort of detector it is, and its IDs
+			const MiniballChannel &chan = set->GetChannel( mysfp, myboard, mych );
 			
 			// Is it a gamma ray from Miniball?
-			if( set->IsMiniball( mysfp, myboard, mych ) && mythres ) {
+			if( chan.type == MiniballSettings::CHANNEL_MINIBALL && mythres ) {
 				
 				// Increment counts and open the event
 				n_miniball++;
 				hit_ctr++;
 				event_open = true;
 				
-				mb_en_list.push_back( myenergy );
-				mb_ts_list.push_back( mytime );
-				mb_clu_list.push_back( set->GetMiniballCluster( mysfp, myboard, mych ) );
-				mb_cry_list.push_back( set->GetMiniballCrystal( mysfp, myboard, mych ) );
-				mb_seg_list.push_back( set->GetMiniballSegment( mysfp, myboard, mych ) );
+				mb_hits.Add( myenergy, mytime, chan.id[0], chan.id[1], chan.id[2] );
 				
 			}
 			
 			// Is it a particle from the CD?
-			else if( set->IsCD( mysfp, myboard, mych ) && mythres ) {
+			else if( chan.type == MiniballSettings::CHANNEL_CD && mythres ) {
 				
 				// Increment counts and open the event
 				n_cd++;
 				hit_ctr++;
 				event_open = true;
 				
-				cd_en_list.push_back( myenergy );
-				cd_ts_list.push_back( mytime );
-				cd_det_list.push_back( set->GetCDDetector( mysfp, myboard, mych ) );
-				cd_sec_list.push_back( set->GetCDSector( mysfp, myboard, mych ) );
-				cd_side_list.push_back( set->GetCDSide( mysfp, myboard, mych ) );
-				cd_strip_list.push_back( set->GetCDStrip( mysfp, myboard, mych ) );
+				cd_hits.Add( myenergy, mytime, chan.id[0], chan.id[1], chan.id[2], chan.id[3] );
 				
 			}
 			
 			// Is it an electron from Spede?
-			else if( set->IsSpede( mysfp, myboard, mych ) && mythres ) {
+			else if( chan.type == MiniballSettings::CHANNEL_SPEDE && mythres ) {
 				
 				// Increment counts and open the event
 				n_spede++;
 				hit_ctr++;
 				event_open = true;
 				
-				spede_en_list.push_back( myenergy );
-				spede_ts_list.push_back( mytime );
-				spede_seg_list.push_back( set->GetSpedeSegment( mysfp, myboard, mych ) );
+				spede_hits.Add( myenergy, mytime, chan.id[0] );
 				
 			}
 			
 			// Is it a gamma ray from the beam dump?
-			else if( set->IsBeamDump( mysfp, myboard, mych ) && mythres ) {
+			else if( chan.type == MiniballSettings::CHANNEL_BEAMDUMP && mythres ) {
 				
 				// Increment counts and open the event
 				n_bd++;
 				hit_ctr++;
 				event_open = true;
 				
-				bd_en_list.push_back( myenergy );
-				bd_ts_list.push_back( mytime );
-				bd_det_list.push_back( set->GetBeamDumpDetector( mysfp, myboard, mych ) );
+				bd_hits.Add( myenergy, mytime, chan.id[0] );
 				
 			}
 			
 			// Is it an IonChamber event
-			else if( set->IsIonChamber( mysfp, myboard, mych ) && mythres ) {
+			else if( chan.type == MiniballSettings::CHANNEL_IONCHAMBER && mythres ) {
 				
 				// Increment counts and open the event
 				n_ic++;
 				hit_ctr++;
 				event_open = true;
 				
-				ic_en_list.push_back( myenergy );
-				ic_ts_list.push_back( mytime );
-				ic_id_list.push_back( set->GetIonChamberLayer( mysfp, myboard, mych ) );
+				ic_hits.Add( myenergy, mytime, chan.id[0] );
 				
 			}
 
@@ -1309,18 +1460,16 @@ unsigned long MiniballEventBuilder::BuildEvents() {
 		// ------------------------------------------ //
 		// Find info events, like timestamps etc
 		// ------------------------------------------ //
-		else if( in_data->IsInfo() ) {
+		else {
 			
 			// Increment event counter
 			n_info_data++;
 			
-			info_data = in_data->GetInfoData();
-			
 			// Update EBIS time
-			if( info_data->GetCode() == set->GetEBISCode() &&
-				TMath::Abs( (double)ebis_time - (double)info_data->GetTime() ) > 1e3 ) {
+			if( in_hit.code == set->GetEBISCode() &&
+				TMath::Abs( (double)ebis_time - (double)in_hit.time ) > 1e3 ) {
 				
-				ebis_time = info_data->GetTime();
+				ebis_time = in_hit.time;
 				ebis_T = (double)ebis_time - (double)ebis_prev;
 				ebis_f = 1e9 / ebis_T;
 				if( ebis_prev != 0 ) {
@@ -1333,10 +1482,10 @@ unsigned long MiniballEventBuilder::BuildEvents() {
 			} // EBIS code
 		
 			// Update T1 time
-			if( info_data->GetCode() == set->GetT1Code() &&
-				TMath::Abs( (double)t1_time - (double)info_data->GetTime() ) > 1e3 ){
+			if( in_hit.code == set->GetT1Code() &&
+				TMath::Abs( (double)t1_time - (double)in_hit.time ) > 1e3 ){
 				
-				t1_time = info_data->GetTime();
+				t1_time = in_hit.time;
 				t1_T = (double)t1_time - (double)t1_prev;
 				t1_f = 1e9 / t1_T;
 				if( t1_prev != 0 ) {
@@ -1349,10 +1498,10 @@ unsigned long MiniballEventBuilder::BuildEvents() {
 			} // T1 code
 			
 			// Update SuperCycle time
-			if( info_data->GetCode() == set->GetSCCode() &&
-				TMath::Abs( (double)sc_time - (double)info_data->GetTime() ) > 1e3 ){
+			if( in_hit.code == set->GetSCCode() &&
+				TMath::Abs( (double)sc_time - (double)in_hit.time ) > 1e3 ){
 				
-				sc_time = info_data->GetTime();
+				sc_time = in_hit.time;
 				sc_T = (double)sc_time - (double)sc_prev;
 				sc_f = 1e9 / sc_T;
 				if( sc_prev != 0 ) {
@@ -1365,9 +1514,9 @@ unsigned long MiniballEventBuilder::BuildEvents() {
 			} // SuperCycle code
 			
 			// Update pulser time
-			if( info_data->GetCode() == set->GetPulserCode() ) {
+			if( in_hit.code == set->GetPulserCode() ) {
 				
-				pulser_time = info_data->GetTime();
+				pulser_time = in_hit.time;
 				pulser_T = (double)pulser_time - (double)pulser_prev;
 				pulser_f = 1e9 / pulser_T;
 				if( pulser_prev != 0 ) {
@@ -1380,47 +1529,47 @@ unsigned long MiniballEventBuilder::BuildEvents() {
 			} // pulser code
 
 			// Check the pause events for each module
-			if( info_data->GetCode() == set->GetPauseCode() ) {
+			if( in_hit.code == set->GetPauseCode() ) {
 				
-				if( info_data->GetSfp() < set->GetNumberOfFebexSfps() &&
-				    info_data->GetBoard() < set->GetNumberOfFebexBoards() ) {
+				if( in_hit.sfp < set->GetNumberOfFebexSfps() &&
+				    in_hit.board < set->GetNumberOfFebexBoards() ) {
 
-					n_pause[info_data->GetSfp()][info_data->GetBoard()]++;
-					flag_pause[info_data->GetSfp()][info_data->GetBoard()] = true;
-					pause_time[info_data->GetSfp()][info_data->GetBoard()] = info_data->GetTime();
+					n_pause[in_hit.sfp][in_hit.board]++;
+					flag_pause[in_hit.sfp][in_hit.board] = true;
+					pause_time[in_hit.sfp][in_hit.board] = in_hit.time;
 				
 				}
 				
 				else {
 					
-					std::cerr << "Bad pause event in SFP " << (int)info_data->GetSfp();
-					std::cerr << ", board " << (int)info_data->GetBoard() << std::endl;
+					std::cerr << "Bad pause event in SFP " << (int)in_hit.sfp;
+					std::cerr << ", board " << (int)in_hit.board << std::endl;
 				
 				}
 
 			} // pause code
 			
 			// Check the resume events for each module
-			if( info_data->GetCode() == set->GetResumeCode() ) {
+			if( in_hit.code == set->GetResumeCode() ) {
 				
-				if( info_data->GetSfp() < set->GetNumberOfFebexSfps() &&
-				    info_data->GetBoard() < set->GetNumberOfFebexBoards() ) {
+				if( in_hit.sfp < set->GetNumberOfFebexSfps() &&
+				    in_hit.board < set->GetNumberOfFebexBoards() ) {
 				
-					n_resume[info_data->GetSfp()][info_data->GetBoard()]++;
-					flag_resume[info_data->GetSfp()][info_data->GetBoard()] = true;
-					resume_time[info_data->GetSfp()][info_data->GetBoard()] = info_data->GetTime();
+					n_resume[in_hit.sfp][in_hit.board]++;
+					flag_resume[in_hit.sfp][in_hit.board] = true;
+					resume_time[in_hit.sfp][in_hit.board] = in_hit.time;
 					
 					// Work out the dead time
-					febex_dead_time[info_data->GetSfp()][info_data->GetBoard()] += resume_time[info_data->GetSfp()][info_data->GetBoard()];
-					febex_dead_time[info_data->GetSfp()][info_data->GetBoard()] -= pause_time[info_data->GetSfp()][info_data->GetBoard()];
+					febex_dead_time[in_hit.sfp][in_hit.board] += resume_time[in_hit.sfp][in_hit.board];
+					febex_dead_time[in_hit.sfp][in_hit.board] -= pause_time[in_hit.sfp][in_hit.board];
 
 					// If we have didn't get the pause, module was stuck at start of run
-					if( !flag_pause[info_data->GetSfp()][info_data->GetBoard()] ) {
+					if( !flag_pause[in_hit.sfp][in_hit.board] ) {
 
-						std::cout << "SFP " << info_data->GetSfp();
-						std::cout << ", board " << info_data->GetBoard();
+						std::cout << "SFP " << in_hit.sfp;
+						std::cout << ", board " << in_hit.board;
 						std::cout << " was blocked at start of run for ";
-						std::cout << (double)resume_time[info_data->GetSfp()][info_data->GetBoard()]/1e9;
+						std::cout << (double)resume_time[in_hit.sfp][in_hit.board]/1e9;
 						std::cout << " seconds" << std::endl;
 					
 					}
@@ -1429,15 +1578,15 @@ unsigned long MiniballEventBuilder::BuildEvents() {
 				
 				else {
 					
-					std::cerr << "Bad resume event in SFP " << (int)info_data->GetSfp();
-					std::cerr << ", board " << (int)info_data->GetBoard() << std::endl;
+					std::cerr << "Bad resume event in SFP " << (int)in_hit.sfp;
+					std::cerr << ", board " << (int)in_hit.board << std::endl;
 				
 				}
 				
 			} // resume code
 			
 			// Now reset previous timestamps
-			if( info_data->GetCode() == set->GetPulserCode() )
+			if( in_hit.code == set->GetPulserCode() )
 				pulser_prev = pulser_time;
 
 						
@@ -1445,7 +1594,7 @@ unsigned long MiniballEventBuilder::BuildEvents() {
 
 		// Sort out the timing for the event window
 		// but only if it isn't an info event, i.e only for real data
-		if( !in_data->IsInfo() ) {
+		if( in_hit.flags & MiniballHitBuffer::FLAG_FEBEX ) {
 			
 			// if this is first datum included in Event
 			if( hit_ctr == 1 && mythres ) {
@@ -1453,6 +1602,7 @@ unsigned long MiniballEventBuilder::BuildEvents() {
 				time_min	= mytime;
 				time_max	= mytime;
 				time_first	= mytime;
+				flag_time_first = true;
 				
 			}
 			
@@ -1466,11 +1616,12 @@ unsigned long MiniballEventBuilder::BuildEvents() {
 		//  check if last datum from this event and do some cleanup
 		//------------------------------
 		
-		if( input_tree->GetEntry(i+1) ) {
+		bool flag_next = GetInputEntry(i+1);
+		if( flag_next ) {
 			
 			// Get the next MBS event ID
 			preveventid = myeventid;
-			myeventid = in_data->GetEventID();
+			myeventid = in_hit.eventid;
 
 			// If the next MBS event ID is the same, carry on
 			// If not, we have to go look for the next trigger time
@@ -1479,39 +1630,43 @@ unsigned long MiniballEventBuilder::BuildEvents() {
 				// Close the event
 				flag_close_event = true;
 
-				// And find the next MBS event ID
-				if( mbsinfo_tree->GetEntryWithIndex( myeventid ) < 0 ) {
+				// And find the next MBS event ID, if we can read the MBS info
+				if( mbsinfo_tree ) {
 
-					std::cerr << "MBS Event " << myeventid << " not found by index, looking up manually" << std::endl;
+					if( mbsinfo_tree->GetEntryWithIndex( myeventid ) < 0 ) {
 
-					// Look for the matches MBS Info event if we didn't match automatically
-					for( long j = 0; j < mbsinfo_tree->GetEntries(); ++j ){
+						std::cerr << "MBS Event " << myeventid << " not found by index, looking up manually" << std::endl;
 
-						mbsinfo_tree->GetEntry(j);
-						if( mbs_info->GetEventID() == myeventid ) {
-							myeventtime = mbs_info->GetTime();
-							break;
-						}
+						// Look for the matches MBS Info event if we didn't match automatically
+						for( long j = 0; j < mbsinfo_tree->GetEntries(); ++j ){
 
-						// Panic if we failed!
-						if( j+1 == mbsinfo_tree->GetEntries() ) {
-							std::cerr << "Didn't find matching MBS Event IDs at start of the file: ";
-							std::cerr << myeventid << std::endl;
+							mbsinfo_tree->GetEntry(j);
+							if( mbs_info->GetEventID() == myeventid ) {
+								myeventtime = mbs_info->GetTime();
+								break;
+							}
+
+							// Panic if we failed!
+							if( j+1 == mbsinfo_tree->GetEntries() ) {
+								std::cerr << "Didn't find matching MBS Event IDs at start of the file: ";
+								std::cerr << myeventid << std::endl;
+							}
 						}
+
 					}
 
-				}
+					else myeventtime = mbs_info->GetTime();
 
-				else myeventtime = mbs_info->GetTime();
+				}
 
 			}
 
 			// BELOW IS THE TIME-ORDERED METHOD!
 
 			// Get next time
-			//myhittime = in_data->GetTime();
+			//myhittime = in_hit.time;
 			//mytime = myhittime + myeventtime;
-			mytime = in_data->GetTime();
+			mytime = in_hit.time;
 			time_diff = mytime - time_first;
 
 			// window = time_stamp_first + time_window
@@ -1523,11 +1678,20 @@ unsigned long MiniballEventBuilder::BuildEvents() {
 				flag_close_event = true; // set flag to close this event
 				
 			// Fill tdiff hist only for real data
-			if( !in_data->IsInfo() ) {
+			if( in_hit.flags & MiniballHitBuffer::FLAG_FEBEX ) {
 				
-				tdiff->Fill( time_diff );
-				if( !mythres )
-					tdiff_clean->Fill( time_diff );
+				// A worker doesn't know when the last event before its
+				// slice started, so these are filled once we know
+				if( !flag_time_first )
+					tdiff_pending.push_back( { mytime, !mythres } );
+				
+				else {
+					
+					tdiff->Fill( time_diff );
+					if( !mythres )
+						tdiff_clean->Fill( time_diff );
+					
+				}
 			
 			}
 
@@ -1535,9 +1699,9 @@ unsigned long MiniballEventBuilder::BuildEvents() {
 		
 		
 		//----------------------------
-		// if close this event or last entry
+		// if close this event or last entry, or the queue has run out
 		//----------------------------
-		if( flag_close_event || (i+1) == n_entries ) {
+		if( flag_close_event || (i+1) == last || ( !flag_next && hit_queue ) ) {
 
 			// If we opened the event, then sort it out
 			if( event_open ) {
@@ -1562,8 +1726,21 @@ unsigned long MiniballEventBuilder::BuildEvents() {
 					write_evts->GetParticleMultiplicity() ||
 				    write_evts->GetSpedeMultiplicity() ||
 				    write_evts->GetIonChamberMultiplicity() ||
-				    write_evts->GetBeamDumpMultiplicity() )
-					output_tree->Fill();
+				    write_evts->GetBeamDumpMultiplicity() ) {
+					
+					// Workers keep their events to be written in order
+					if( flag_worker ) {
+						
+						if( n_slice_evts < slice_evts.size() )
+							slice_evts[n_slice_evts] = *write_evts;
+						else slice_evts.push_back( *write_evts );
+						n_slice_evts++;
+						
+					}
+					
+					else output_tree->Fill();
+					
+				}
 
 
 				// Clean up if the next event is going to make the tree full
@@ -1579,34 +1756,481 @@ unsigned long MiniballEventBuilder::BuildEvents() {
 			
 		} // if close event && hit_ctr > 0
 		
-		// Progress bar
+		// That was the last hit from the queue
+		if( !flag_next && hit_queue ) break;
+
+		// Progress bar, but not from the workers or with the queue, where
+		// we don't know how many hits there will be
+		if( flag_worker || hit_queue ) continue;
+		
 		bool update_progress = false;
 		if( n_entries < 200 )
 			update_progress = true;
 		else if( i % (n_entries/100) == 0 || i+1 == n_entries )
 			update_progress = true;
 		
-		if( update_progress ) {
+		if( update_progress )
+			ShowProgress( (float)(i+1)*100.0/(float)n_entries );
+		
+	} // End of main loop over TTree to process raw FEBEX data entries (for first to last)
 
-			// Percent complete
-			float percent = (float)(i+1)*100.0/(float)n_entries;
+	return;
+
+}
+
+void MiniballEventBuilder::ShowProgress( float percent ){
+
+	// Progress bar in GUI
+	if( _prog_ ) {
+		
+		prog->SetPosition( percent );
+		gSystem->ProcessEvents();
+		
+	}
+
+	// Progress bar in terminal
+	std::cout << " " << std::setw(6) << std::setprecision(4);
+	std::cout << percent << "%    \r";
+	std::cout.flush();
+
+	return;
+
+}
+
+std::unique_ptr<MiniballEventBuilder> MiniballEventBuilder::MakeWorker(){
+
+	// A worker has the same settings, but reads the input file for itself
+	std::unique_ptr<MiniballEventBuilder> w = std::make_unique<MiniballEventBuilder>( set );
+	w->flag_worker = true;
+	w->SetInputFile( input_file_name );
+
+	// The calibration has a random number generator, so it needs its own
+	if( overwrite_cal )
+		w->AddCalibration( std::make_shared<MiniballCalibration>( cal->InputFile(), set ) );
+
+	// Read the hits from the same place as we do
+	if( w->flag_hit_file && !flag_hit_file ) {
+
+		w->hit_file.Close();
+		w->flag_hit_file = false;
+
+	}
+
+	// Event branches as in SetOutput, but without a tree
+	w->write_evts = std::make_unique<MiniballEvts>();
+	w->gamma_evt = std::make_shared<GammaRayEvt>();
+	w->gamma_ab_evt = std::make_shared<GammaRayAddbackEvt>();
+	w->particle_evt = std::make_shared<ParticleEvt>();
+	w->spede_evt = std::make_shared<SpedeEvt>();
+	w->bd_evt = std::make_shared<BeamDumpEvt>();
+	w->ic_evt = std::make_shared<IonChamberEvt>();
+	w->output_file = nullptr;
+	w->output_tree = nullptr;
+
+	// Histograms of its own that aren't in any directory, to be added to ours
+	bool add_directory = TH1::AddDirectoryStatus();
+	TH1::AddDirectory( kFALSE );
+	w->MakeEventHists();
+	TH1::AddDirectory( add_directory );
+
+	w->Initialise();
+
+	return w;
+
+}
+
+unsigned long MiniballEventBuilder::FindSliceEnd( unsigned long i ){
+
+	// Look from hit i onwards for a gap longer than the build window
+	if( i >= n_entries || !GetInputEntry( i - 1 ) ) return n_entries;
+	Long64_t t = in_hit.time;
+
+	for( ; i < n_entries; ++i ) {
+
+		if( !GetInputEntry(i) ) return n_entries;
+		if( in_hit.time - t > build_window ) return i;
+		t = in_hit.time;
+
+	}
+
+	return n_entries;
+
+}
+
+void MiniballEventBuilder::ScanInfo( unsigned long first, unsigned long last ){
+
+	info_hits.clear();
+
+	// With flat branches, only the flags are needed to know which hits to read
+	TBranch *b_flags = nullptr;
+	if( !flag_hit_file && flag_flat_input )
+		b_flags = input_tree->GetBranch( "flags" );
+
+	for( unsigned long i = first; i < last; ++i ) {
+
+		if( b_flags ) {
+
+			if( b_flags->GetEntry(i) <= 0 ) break;
+			if( in_hit.flags & MiniballHitBuffer::FLAG_FEBEX ) continue;
+
+		}
+
+		if( !GetInputEntry(i) ) break;
+		if( !( in_hit.flags & MiniballHitBuffer::FLAG_FEBEX ) )
+			info_hits.push_back( in_hit );
+
+	}
+
+	return;
+
+}
+
+void MiniballEventBuilder::UpdateInfoState( const MiniballHit &h ){
+
+	// The same as BuildSlice does with the info hits,
+	// but only the times, without counting or filling anything
+	if( h.code == set->GetEBISCode() &&
+		TMath::Abs( (double)ebis_time - (double)h.time ) > 1e3 )
+		ebis_time = ebis_prev = h.time;
+
+	if( h.code == set->GetT1Code() &&
+		TMath::Abs( (double)t1_time - (double)h.time ) > 1e3 )
+		t1_time = t1_prev = h.time;
+
+	if( h.code == set->GetSCCode() &&
+		TMath::Abs( (double)sc_time - (double)h.time ) > 1e3 )
+		sc_time = sc_prev = h.time;
+
+	if( h.code == set->GetPulserCode() )
+		pulser_time = pulser_prev = h.time;
+
+	if( h.sfp < set->GetNumberOfFebexSfps() &&
+		h.board < set->GetNumberOfFebexBoards() ) {
+
+		if( h.code == set->GetPauseCode() ) {
+
+			flag_pause[h.sfp][h.board] = true;
+			pause_time[h.sfp][h.board] = h.time;
+
+		}
+
+		if( h.code == set->GetResumeCode() ) {
+
+			flag_resume[h.sfp][h.board] = true;
+			resume_time[h.sfp][h.board] = h.time;
+
+		}
+
+	}
+
+	return;
+
+}
+
+void MiniballEventBuilder::CopyInfoState( const MiniballEventBuilder &from ){
+
+	ebis_time = from.ebis_time;
+	ebis_prev = from.ebis_prev;
+	t1_time = from.t1_time;
+	t1_prev = from.t1_prev;
+	sc_time = from.sc_time;
+	sc_prev = from.sc_prev;
+	pulser_time = from.pulser_time;
+	pulser_prev = from.pulser_prev;
+	flag_pause = from.flag_pause;
+	flag_resume = from.flag_resume;
+	pause_time = from.pause_time;
+	resume_time = from.resume_time;
+
+	return;
+
+}
+
+void MiniballEventBuilder::StartSlice( unsigned long first ){
+
+	n_slice_evts = 0;
+	tdiff_pending.clear();
+	Initialise();
+
+	// The event before the slice finished before the gap, so any time
+	// before the gap closes the next one just the same. Which time it was
+	// only matters for tdiff, so that is filled later
+	time_prev = 0;
+	if( first > 0 && GetInputEntry( first - 1 ) )
+		time_prev = in_hit.time;
+	time_first = time_prev;
+	flag_time_first = false;
+
+	return;
+
+}
+
+void MiniballEventBuilder::BuildParallel(){
+
+	// Histograms and trees can be used on different threads, so long as
+	// each one only belongs to one thread
+	ROOT::EnableThreadSafety();
+
+	// We can't jump through a compressed hit file, so read the tree instead
+	if( flag_hit_file && hit_file.IsCompressed() ) {
+
+		std::cout << "Reading hits from the mb_sort tree for the threads" << std::endl;
+		hit_file.Close();
+		flag_hit_file = false;
+
+	}
+
+	std::vector<std::unique_ptr<MiniballEventBuilder>> workers;
+	for( unsigned int i = 0; i < nthreads; ++i )
+		workers.push_back( MakeWorker() );
+
+	// A few slices for each thread, so they finish at about the same time,
+	// but not so small that the gaps are hard to find, or so big that
+	// the events of a slice take up too much memory
+	unsigned long slice_size = n_entries / ( 4 * nthreads );
+	if( slice_size < 0x10000 ) slice_size = 0x10000;
+	if( slice_size > 0x400000 ) slice_size = 0x400000;
+
+	std::vector<std::pair<unsigned long,unsigned long>> slices;
+	std::vector<std::thread> threads;
+	unsigned long next = 0;
+
+	while( next < n_entries ) {
+
+		// Cut the next slices, one for each worker
+		slices.clear();
+		while( slices.size() < workers.size() && next < n_entries ) {
+
+			unsigned long end = FindSliceEnd( next + slice_size );
+			slices.push_back( { next, end } );
+			next = end;
+
+		}
+
+		// Find the info hits in each slice
+		for( unsigned int i = 0; i < slices.size(); ++i )
+			threads.emplace_back( &MiniballEventBuilder::ScanInfo, workers[i].get(),
+								  slices[i].first, slices[i].second );
+		for( unsigned int i = 0; i < threads.size(); ++i )
+			threads[i].join();
+		threads.clear();
+
+		// Each slice starts where the info hits before it left us
+		for( unsigned int i = 0; i < slices.size(); ++i ) {
+
+			workers[i]->CopyInfoState( *this );
+			for( unsigned int j = 0; j < workers[i]->info_hits.size(); ++j )
+				UpdateInfoState( workers[i]->info_hits[j] );
+
+		}
+
+		// Build the slices
+		for( unsigned int i = 0; i < slices.size(); ++i )
+			threads.emplace_back( &MiniballEventBuilder::BuildSlice, workers[i].get(),
+								  slices[i].first, slices[i].second );
+		for( unsigned int i = 0; i < threads.size(); ++i )
+			threads[i].join();
+		threads.clear();
+
+		// Write the events in time order
+		for( unsigned int i = 0; i < slices.size(); ++i ) {
+
+			MiniballEventBuilder &w = *workers[i];
+
+			// Now we know when the last event before the slice started
+			for( unsigned int j = 0; j < w.tdiff_pending.size(); ++j ) {
+
+				time_diff = w.tdiff_pending[j].first - time_first;
+				tdiff->Fill( time_diff );
+				if( w.tdiff_pending[j].second )
+					tdiff_clean->Fill( time_diff );
+
+			}
+
+			if( w.flag_time_first ) time_first = w.time_first;
+
+			for( unsigned long j = 0; j < w.n_slice_evts; ++j ) {
+
+				*write_evts = w.slice_evts[j];
+				output_tree->Fill();
 
-			// Progress bar in GUI
-			if( _prog_ ) {
-				
-				prog->SetPosition( percent );
-				gSystem->ProcessEvents();
-				
 			}
 
-			// Progress bar in terminal
-			std::cout << " " << std::setw(6) << std::setprecision(4);
-			std::cout << percent << "%    \r";
-			std::cout.flush();
+		}
+
+		ShowProgress( (float)next*100.0/(float)n_entries );
+
+	}
+
+	// Add up what the workers found
+	for( unsigned int i = 0; i < workers.size(); ++i )
+		AddWorker( *workers[i] );
+
+	Initialise();
+
+	return;
+
+}
+
+void MiniballEventBuilder::AddWorker( const MiniballEventBuilder &w ){
+
+	// Counters
+	n_febex_data	+= w.n_febex_data;
+	n_info_data		+= w.n_info_data;
+	n_pulser		+= w.n_pulser;
+	n_ebis			+= w.n_ebis;
+	n_t1			+= w.n_t1;
+	n_sc			+= w.n_sc;
+	n_miniball		+= w.n_miniball;
+	n_cd			+= w.n_cd;
+	n_bd			+= w.n_bd;
+	n_spede			+= w.n_spede;
+	n_ic			+= w.n_ic;
+	gamma_ctr		+= w.gamma_ctr;
+	gamma_ab_ctr	+= w.gamma_ab_ctr;
+	cd_ctr			+= w.cd_ctr;
+	bd_ctr			+= w.bd_ctr;
+	spede_ctr		+= w.spede_ctr;
+	ic_ctr			+= w.ic_ctr;
+
+	for( unsigned int i = 0; i < set->GetNumberOfFebexSfps(); ++i ) {
+
+		n_sfp[i] += w.n_sfp[i];
+
+		for( unsigned int j = 0; j < set->GetNumberOfFebexBoards(); ++j ) {
+
+			n_board[i][j] += w.n_board[i][j];
+			n_pause[i][j] += w.n_pause[i][j];
+			n_resume[i][j] += w.n_resume[i][j];
+			febex_dead_time[i][j] += w.febex_dead_time[i][j];
+
+			// First and last times of the whole run
+			if( w.febex_time_start[i][j] != 0 &&
+				( febex_time_start[i][j] == 0 ||
+				  w.febex_time_start[i][j] < febex_time_start[i][j] ) )
+				febex_time_start[i][j] = w.febex_time_start[i][j];
+
+			if( w.febex_time_stop[i][j] > febex_time_stop[i][j] )
+				febex_time_stop[i][j] = w.febex_time_stop[i][j];
+
+		}
+
+	}
+
+	// Histograms
+	tdiff->Add( w.tdiff );
+	tdiff_clean->Add( w.tdiff_clean );
+	pulser_period->Add( w.pulser_period );
+	ebis_period->Add( w.ebis_period );
+	t1_period->Add( w.t1_period );
+	sc_period->Add( w.sc_period );
+	pulser_freq->Add( w.pulser_freq );
+	ebis_freq->Add( w.ebis_freq );
+	t1_freq->Add( w.t1_freq );
+	sc_freq->Add( w.sc_freq );
+	mb_td_core_seg->Add( w.mb_td_core_seg );
+	mb_td_core_core->Add( w.mb_td_core_core );
+
+	for( unsigned int i = 0; i < mb_en_core_seg.size(); ++i ) {
+
+		for( unsigned int j = 0; j < mb_en_core_seg[i].size(); ++j ) {
+
+			mb_en_core_seg[i][j]->Add( w.mb_en_core_seg[i][j] );
+			mb_en_core_seg_ebis_on[i][j]->Add( w.mb_en_core_seg_ebis_on[i][j] );
+
+		}
 
-		}		
+	}
+
+	for( unsigned int i = 0; i < cd_pen_id.size(); ++i ) {
+
+		for( unsigned int j = 0; j < cd_pen_id[i].size(); ++j ) {
+
+			cd_pen_id[i][j]->Add( w.cd_pen_id[i][j] );
+			cd_nen_id[i][j]->Add( w.cd_nen_id[i][j] );
+			cd_pn_1v1[i][j]->Add( w.cd_pn_1v1[i][j] );
+			cd_pn_1v2[i][j]->Add( w.cd_pn_1v2[i][j] );
+			cd_pn_2v1[i][j]->Add( w.cd_pn_2v1[i][j] );
+			cd_pn_2v2[i][j]->Add( w.cd_pn_2v2[i][j] );
+			cd_pn_td[i][j]->Add( w.cd_pn_td[i][j] );
+			cd_pp_td[i][j]->Add( w.cd_pp_td[i][j] );
+			cd_nn_td[i][j]->Add( w.cd_nn_td[i][j] );
+			cd_pn_mult[i][j]->Add( w.cd_pn_mult[i][j] );
+
+		}
+
+	}
+
+	ic_td->Add( w.ic_td );
+	ic_dE->Add( w.ic_dE );
+	ic_E->Add( w.ic_E );
+	ic_dE_E->Add( w.ic_dE_E );
+
+	return;
+
+}
+
+unsigned long MiniballEventBuilder::BuildEvents() {
+	
+	/// Function to loop over the sort tree and build array and recoil events
+
+	// Load the full tree if possible
+	//output_tree->SetMaxVirtualSize(200e6);	// 200 MB
+	//input_tree->SetMaxVirtualSize(200e6); 	// 200 MB
+	//input_tree->LoadBaskets(200e6); 		// Load 200 MB of data to memory
+
+	// From the queue, we don't know how many hits there are until the end
+	if( hit_queue ) {
+
+		if( !GetInputEntry(0) ){
+
+			std::cout << " Event Building: nothing to do" << std::endl;
+			return 0;
+
+		}
+
+		Initialise();
+		BuildSlice( 0, std::numeric_limits<unsigned long>::max() );
+		n_entries = hit_queue->GetEntries();
+
+		std::cout << " Event Building: number of hits from the converter = ";
+		std::cout << n_entries << std::endl;
+
+	}
+
+	else if( !input_tree || input_tree->LoadTree(0) < 0 ){
+		
+		std::cout << " Event Building: nothing to do" << std::endl;
+		return 0;
 		
-	} // End of main loop over TTree to process raw FEBEX data entries (for n_entries)
+	}
+
+	else {
+
+		// Get ready and go
+		Initialise();
+		n_entries = input_tree->GetEntries();
+
+		std::cout << " Event Building: number of entries in input tree = ";
+		std::cout << n_entries << std::endl;
+
+		std::cout << "\tnumber of MBS Events/triggers in input tree = ";
+		std::cout << mbsinfo_tree->GetEntries() << std::endl;
+
+		// ------------------------------------------------------------------------ //
+		// Build the events in slices on worker threads, or in one go here
+		// ------------------------------------------------------------------------ //
+		// Only one pass through the hits here, so they can be let go of
+		if( nthreads > 1 && flag_input_file ) BuildParallel();
+		else {
+
+			hit_file.SetReleaseBlocks( true );
+			BuildSlice( 0, n_entries );
+
+		}
+
+	}
+	
 	
 	//--------------------------
 	// Clean up
@@ -1644,7 +2268,7 @@ unsigned long MiniballEventBuilder::BuildEvents() {
 	ss_log << "    IonChamber ion events = " << ic_ctr << std::endl;
 
 	std::cout << ss_log.str();
-	if( log_file.is_open() && flag_input_file ) log_file << ss_log.str();
+	if( log_file.is_open() && ( flag_input_file || hit_queue ) ) log_file << ss_log.str();
 
 	std::cout << "Writing output file...\r";
 	std::cout.flush();
@@ -0,0 +1,885 @@
+#include "HitBuffer.hh"
+#include "HitFile.hh"
+#include "HitQueue.hh"
+
+MiniballHitBuffer::MiniballHitBuffer() {
+
+	tree = nullptr;
+	packet = nullptr;
+	flat = false;
+	flat_traces = false;
+	hit_file = nullptr;
+	hit_queue = nullptr;
+
+	// Space for the longest trace in the flat branches
+	hit_trace.resize( 0x10000 );
+
+	// Write out the older hits every 64k hits by default
+	flush_size = 0x10000;
+
+	// Sort within 100 ms by default
+	window = 1e8;
+
+	// Spill to files after 1 GB, next to where we are by default
+	memory = 1024. * 1024. * 1024.;
+	temp_dir = "./";
+	spilling = false;
+	nbytes = 0;
+
+	// Sort in one thread unless told otherwise
+	nthreads = 1;
+
+	newest = std::numeric_limits<Long64_t>::min();
+	nbuffered = 0;
+	nadded = 0;
+	late.head = 0;
+	ResetOrder();
+
+	SetStreams( 1, 1 );
+
+	febex_data = std::make_shared<FebexData>();
+	info_data = std::make_shared<InfoData>();
+	febex_data->ClearData();
+	info_data->ClearData();
+
+}
+
+MiniballHitBuffer::~MiniballHitBuffer() {
+
+	for( unsigned int i = 0; i < runs.size(); ++i )
+		fclose( runs[i].fp );
+
+}
+
+void MiniballHitBuffer::SetOutput( TTree *t, MiniballDataPackets *p ){
+
+	tree = t;
+	packet = p;
+	flat = false;
+
+	for( unsigned int i = 0; i < streams.size(); ++i ) {
+
+		streams[i].hits.clear();
+		streams[i].trace_start.clear();
+		streams[i].samples.clear();
+		streams[i].head = 0;
+
+	}
+
+	late.hits.clear();
+	late.trace_start.clear();
+	late.samples.clear();
+	late.head = 0;
+
+	for( unsigned int i = 0; i < runs.size(); ++i )
+		fclose( runs[i].fp );
+	runs.clear();
+
+	newest = std::numeric_limits<Long64_t>::min();
+	nbuffered = 0;
+	nadded = 0;
+	nbytes = 0;
+	spilling = false;
+	ResetOrder();
+
+	return;
+
+}
+
+// A flat branch for each part of the hit, with the trace as a variable
+// length array that has its length in another branch
+void MiniballHitBuffer::Branch( TTree *t, bool traces ){
+
+	SetOutput( t, nullptr );
+	flat = true;
+	flat_traces = traces;
+
+	tree->Branch( "time", &hit.time, "time/L" );
+	tree->Branch( "eventid", &hit.eventid, "eventid/l" );
+	tree->Branch( "energy", &hit.energy, "energy/F" );
+	tree->Branch( "Qint", &hit.Qint, "Qint/i" );
+	tree->Branch( "Qhalf", &hit.Qhalf, "Qhalf/F" );
+	tree->Branch( "Qshort", &hit.Qshort, "Qshort/s" );
+	tree->Branch( "sfp", &hit.sfp, "sfp/b" );
+	tree->Branch( "board", &hit.board, "board/b" );
+	tree->Branch( "ch", &hit.ch, "ch/b" );
+	tree->Branch( "code", &hit.code, "code/b" );
+	tree->Branch( "flags", &hit.flags, "flags/b" );
+
+	if( traces ) {
+
+		tree->Branch( "trace_length", &hit.trace_length, "trace_length/s" );
+		tree->Branch( "trace", hit_trace.data(), "trace[trace_length]/s" );
+
+	}
+
+	return;
+
+}
+
+void MiniballHitBuffer::FromPacket( const MiniballDataPackets *p, MiniballHit &h,
+									std::vector<unsigned short> *trace ){
+
+	if( p->IsFebex() ) {
+
+		const FebexData *data = &p->GetFebexRef();
+		h.time = data->GetTime();
+		h.eventid = data->GetEventID();
+		h.energy = data->GetEnergy();
+		h.Qint = data->GetQint();
+		h.Qhalf = data->GetQhalf();
+		h.Qshort = data->GetQshort();
+		h.sfp = data->GetSfp();
+		h.board = data->GetBoard();
+		h.ch = data->GetChannel();
+		h.code = 0;
+
+		h.flags = FLAG_FEBEX;
+		if( data->IsOverThreshold() ) h.flags |= FLAG_THRES;
+		if( data->IsVeto() ) h.flags |= FLAG_VETO;
+		if( data->IsFail() ) h.flags |= FLAG_FAIL;
+		if( data->IsPileUp() ) h.flags |= FLAG_PILEUP;
+
+		h.trace_length = TraceLength( data->GetTrace().size() );
+		if( trace ) trace->assign( data->GetTrace().begin(),
+								   data->GetTrace().begin() + h.trace_length );
+
+	}
+
+	else {
+
+		const InfoData *data = &p->GetInfoRef();
+		h.time = data->GetTime();
+		h.eventid = data->GetEventID();
+		h.energy = 0;
+		h.Qint = 0;
+		h.Qhalf = 0;
+		h.Qshort = 0;
+		h.sfp = data->GetSfp();
+		h.board = data->GetBoard();
+		h.ch = 0;
+		h.code = data->GetCode();
+		h.flags = 0;
+		h.trace_length = 0;
+		if( trace ) trace->clear();
+
+	}
+
+	return;
+
+}
+
+UShort_t MiniballHitBuffer::TraceLength( std::size_t n ){
+
+	const std::size_t max_length = std::numeric_limits<UShort_t>::max();
+	if( n <= max_length ) return n;
+
+	// Only say it once, there'll be lots of them
+	static std::atomic<bool> warned( false );
+	if( !warned.exchange( true ) ) {
+
+		std::cerr << "Trace of " << n << " samples is too long for a hit, ";
+		std::cerr << "only the first " << max_length << " are kept" << std::endl;
+
+	}
+
+	return max_length;
+
+}
+
+void MiniballHitBuffer::SetStreams( unsigned int _nsfp, unsigned int _nboards ){
+
+	// Only change this when there's nothing waiting
+	if( nbuffered ) Flush();
+
+	nsfp = _nsfp;
+	nboards = _nboards;
+	streams.resize( nsfp * nboards + 1 );
+	for( unsigned int i = 0; i < streams.size(); ++i )
+		streams[i].head = 0;
+
+	return;
+
+}
+
+// Add a FEBEX hit to the buffer
+void MiniballHitBuffer::AddFebex( std::shared_ptr<FebexData> data ){
+
+	MiniballHit h;
+	h.time = data->GetTime();
+	h.eventid = data->GetEventID();
+	h.energy = data->GetEnergy();
+	h.Qint = data->GetQint();
+	h.Qhalf = data->GetQhalf();
+	h.Qshort = data->GetQshort();
+	h.sfp = data->GetSfp();
+	h.board = data->GetBoard();
+	h.ch = data->GetChannel();
+	h.code = 0;
+
+	h.flags = FLAG_FEBEX;
+	if( data->IsOverThreshold() ) h.flags |= FLAG_THRES;
+	if( data->IsVeto() ) h.flags |= FLAG_VETO;
+	if( data->IsFail() ) h.flags |= FLAG_FAIL;
+	if( data->IsPileUp() ) h.flags |= FLAG_PILEUP;
+
+	// Borrow the trace to copy the samples, then give it back
+	data->SwapTrace( swap_trace );
+	h.trace_length = TraceLength( swap_trace.size() );
+	Add( GetStream( h.sfp, h.board ), h, swap_trace.data() );
+	data->SwapTrace( swap_trace );
+
+	return;
+
+}
+
+// Add an info hit to the buffer
+void MiniballHitBuffer::AddInfo( std::shared_ptr<InfoData> data ){
+
+	MiniballHit h;
+	h.time = data->GetTime();
+	h.eventid = data->GetEventID();
+	h.energy = 0;
+	h.Qint = 0;
+	h.Qhalf = 0;
+	h.Qshort = 0;
+	h.sfp = data->GetSfp();
+	h.board = data->GetBoard();
+	h.ch = 0;
+	h.code = data->GetCode();
+	h.flags = 0;
+	h.trace_length = 0;
+
+	Add( GetStream( h.sfp, h.board ), h, nullptr );
+
+	return;
+
+}
+
+void MiniballHitBuffer::Add( unsigned int s, const MiniballHit &h, const unsigned short *trace ){
+
+	// Older than a hit that was written already
+	if( h.time < last_time ) {
+
+		Late( h, trace );
+		return;
+
+	}
+	if( h.time > newest ) newest = h.time;
+
+	Insert( streams[s], h, trace );
+
+	nbuffered++;
+	nadded++;
+	nbytes += sizeof(MiniballHit) + sizeof(unsigned long);
+	nbytes += h.trace_length * sizeof(unsigned short);
+
+	// Sorted runs go to files when the memory is full
+	if( spilling ) {
+
+		if( nbytes >= memory ) Spill();
+
+	}
+
+	// Write the hits that are now outside of the window, once every
+	// flush_size hits, even if the window holds more than that
+	else if( nbuffered >= flush_size && nadded >= flush_size ) {
+
+		Write( newest - (Long64_t)window );
+		nadded = 0;
+
+		// The window doesn't fit in memory, so spill from now on
+		if( nbytes >= memory ) {
+
+			spilling = true;
+			Spill();
+
+			// The runs overlap in time, so nothing more can go to the
+			// event builder until they are merged at the end
+			if( hit_queue ) {
+
+				std::cerr << "Sorting window doesn't fit in memory, the events";
+				std::cerr << " will only be built after the conversion" << std::endl;
+
+			}
+
+		}
+
+	}
+
+	return;
+
+}
+
+// The rest of the hits carry on to the tree as before, so it stays in
+// order, and the tree is merged with the late hits at the end
+void MiniballHitBuffer::Late( const MiniballHit &h, const unsigned short *trace ){
+
+	ordered = false;
+	nlate++;
+	Insert( late, h, trace );
+
+	// Make the window wide enough for this hit next time, unless it's
+	// so far out that it's more likely a bad timestamp
+	double need = (double)newest - (double)h.time;
+	if( need > window && need < 10. * window ) window = need;
+
+	return;
+
+}
+
+void MiniballHitBuffer::Insert( MiniballHitStream &st, const MiniballHit &h, const unsigned short *trace ){
+
+	// Samples always go on the end, wherever the hit goes
+	unsigned long start = st.samples.size();
+	if( h.trace_length )
+		st.samples.insert( st.samples.end(), trace, trace + h.trace_length );
+
+	// Usually the hit is the latest of its stream
+	if( st.head == st.hits.size() || h.time >= st.hits.back().time ) {
+
+		st.hits.push_back( h );
+		st.trace_start.push_back( start );
+
+	}
+
+	// Otherwise it goes after the hits that are not later than it
+	else {
+
+		auto it = std::upper_bound( st.hits.begin() + st.head, st.hits.end(), h.time,
+			[]( Long64_t t, const MiniballHit &a ){ return t < a.time; } );
+		unsigned long pos = it - st.hits.begin();
+		st.hits.insert( it, h );
+		st.trace_start.insert( st.trace_start.begin() + pos, start );
+
+	}
+
+	return;
+
+}
+
+// Take the earliest hit of all the streams each time, using a heap of
+// the first hit in each, until the next hit is later than we want
+void MiniballHitBuffer::Write( Long64_t until, FILE *fp ){
+
+	// Later hits go to the bottom, and streams keep the same order for ties
+	auto later = []( const std::pair<Long64_t,unsigned int> &a,
+					 const std::pair<Long64_t,unsigned int> &b ){
+		return a.first > b.first || ( a.first == b.first && a.second > b.second );
+	};
+
+	heap.clear();
+	for( unsigned int i = 0; i < streams.size(); ++i ) {
+
+		MiniballHitStream &st = streams[i];
+		if( st.head < st.hits.size() && st.hits[st.head].time <= until )
+			heap.push_back( std::make_pair( st.hits[st.head].time, i ) );
+
+	}
+	std::make_heap( heap.begin(), heap.end(), later );
+
+	while( heap.size() ) {
+
+		std::pop_heap( heap.begin(), heap.end(), later );
+		unsigned int s = heap.back().second;
+		heap.pop_back();
+
+		MiniballHitStream &st = streams[s];
+		Emit( st.hits[st.head], st.samples.data() + st.trace_start[st.head], fp );
+		st.head++;
+
+		if( st.head < st.hits.size() && st.hits[st.head].time <= until ) {
+
+			heap.push_back( std::make_pair( st.hits[st.head].time, s ) );
+			std::push_heap( heap.begin(), heap.end(), later );
+
+		}
+
+	}
+
+	for( unsigned int i = 0; i < streams.size(); ++i )
+		Compact( streams[i] );
+
+	return;
+
+}
+
+// When everything is written, the keys of all the hits are sorted at
+// once, which is quicker than the heap for lots of hits. The order is the
+// same, because the sort is stable and the keys go through the streams
+// in turn, just like ties are broken in the heap
+void MiniballHitBuffer::WriteAll( FILE *fp ){
+
+	// The heap is fine for a few hits, and entries have to fit in 32 bits
+	if( nbuffered < 0x10000 || nbuffered > std::numeric_limits<UInt_t>::max() ) {
+
+		Write( std::numeric_limits<Long64_t>::max(), fp );
+		return;
+
+	}
+
+	// Keys of all the waiting hits in one pass, noting which bits differ
+	keys.resize( nbuffered );
+	key_offset.resize( streams.size() );
+	ULong64_t all_or = 0, all_and = ~0ull;
+	UInt_t n = 0;
+	for( unsigned int i = 0; i < streams.size(); ++i ) {
+
+		MiniballHitStream &st = streams[i];
+		key_offset[i] = n;
+		for( unsigned long j = st.head; j < st.hits.size(); ++j ) {
+
+			keys[n].time = (ULong64_t)st.hits[j].time ^ ( 1ull << 63 );
+			keys[n].entry = n;
+			all_or |= keys[n].time;
+			all_and &= keys[n].time;
+			n++;
+
+		}
+
+	}
+
+	RadixSort( keys, keys_tmp, all_or ^ all_and, nthreads );
+
+	// Find each hit from its entry and write them in order
+	for( unsigned long k = 0; k < keys.size(); ++k ) {
+
+		unsigned int s = std::upper_bound( key_offset.begin(), key_offset.end(),
+										   keys[k].entry ) - key_offset.begin() - 1;
+		MiniballHitStream &st = streams[s];
+		unsigned long j = st.head + keys[k].entry - key_offset[s];
+		Emit( st.hits[j], st.samples.data() + st.trace_start[j], fp );
+
+	}
+
+	for( unsigned int i = 0; i < streams.size(); ++i ) {
+
+		streams[i].head = streams[i].hits.size();
+		Compact( streams[i] );
+
+	}
+
+	return;
+
+}
+
+void MiniballHitBuffer::RadixSort( std::vector<MiniballHitKey> &keys,
+								   std::vector<MiniballHitKey> &tmp,
+								   ULong64_t differ, unsigned int nthreads ){
+
+	unsigned long n = keys.size();
+	tmp.resize( n );
+
+	// Not worth the threads for less than a million keys each
+	if( n < nthreads * 0x100000ul ) nthreads = n / 0x100000ul;
+	if( nthreads < 1 ) nthreads = 1;
+	unsigned long chunk = ( n + nthreads - 1 ) / nthreads;
+
+	std::vector<std::array<unsigned long,256>> count( nthreads );
+	MiniballHitKey *src = keys.data();
+	MiniballHitKey *dst = tmp.data();
+
+	// Run a job on each part of the keys, one part in this thread
+	auto parallel = [&]( std::function<void(unsigned int)> job ){
+		std::vector<std::thread> workers;
+		for( unsigned int t = 1; t < nthreads; ++t )
+			workers.push_back( std::thread( job, t ) );
+		job( 0 );
+		for( unsigned int t = 0; t < workers.size(); ++t )
+			workers[t].join();
+	};
+
+	for( unsigned int shift = 0; shift < 64; shift += 8 ) {
+
+		// Skip bytes that are the same in every key
+		if( !( ( differ >> shift ) & 0xff ) ) continue;
+
+		// Count the bytes in each part
+		parallel( [&]( unsigned int t ){
+			count[t].fill( 0 );
+			unsigned long end = std::min( n, ( t + 1 ) * chunk );
+			for( unsigned long i = t * chunk; i < end; ++i )
+				count[t][ ( src[i].time >> shift ) & 0xff ]++;
+		} );
+
+		// Where each part starts for each byte, keeping parts in order
+		unsigned long pos = 0;
+		for( unsigned int d = 0; d < 256; ++d ) {
+
+			for( unsigned int t = 0; t < nthreads; ++t ) {
+
+				unsigned long c = count[t][d];
+				count[t][d] = pos;
+				pos += c;
+
+			}
+
+		}
+
+		// Move the keys of each part to their places
+		parallel( [&]( unsigned int t ){
+			unsigned long end = std::min( n, ( t + 1 ) * chunk );
+			for( unsigned long i = t * chunk; i < end; ++i )
+				dst[ count[t][ ( src[i].time >> shift ) & 0xff ]++ ] = src[i];
+		} );
+
+		std::swap( src, dst );
+
+	}
+
+	// Sorted keys ended up in the other vector
+	if( src != keys.data() ) keys.swap( tmp );
+
+	return;
+
+}
+
+void MiniballHitBuffer::Emit( const MiniballHit &h, const unsigned short *trace, FILE *fp ){
+
+	// To the run file, or to the tree
+	if( fp ) {
+
+		fwrite( &h, sizeof(MiniballHit), 1, fp );
+		if( h.trace_length )
+			fwrite( trace, sizeof(unsigned short), h.trace_length, fp );
+
+	}
+
+	else WriteHit( h, trace );
+
+	nbuffered--;
+	nbytes -= sizeof(MiniballHit) + sizeof(unsigned long);
+	nbytes -= h.trace_length * sizeof(unsigned short);
+
+	return;
+
+}
+
+void MiniballHitBuffer::Flush(){
+
+	if( spilling || runs.size() || late.hits.size() ) Merge();
+	else WriteAll();
+
+	return;
+
+}
+
+void MiniballHitBuffer::WriteHit( const MiniballHit &h, const unsigned short *trace, bool push ){
+
+	last_time = h.time;
+
+	if( hit_file ) hit_file->Write( h );
+	if( hit_queue && push ) hit_queue->Push( h );
+
+	if( !tree ) return;
+
+	// Copy to the flat branches
+	if( flat ) {
+
+		hit = h;
+		if( flat_traces && h.trace_length )
+			std::copy( trace, trace + h.trace_length, hit_trace.begin() );
+
+		tree->Fill();
+		return;
+
+	}
+
+	packet->ClearData();
+
+	if( h.flags & FLAG_FEBEX ) {
+
+		febex_data->ClearData();
+		febex_data->SetTime( h.time );
+		febex_data->SetEventID( h.eventid );
+		febex_data->SetEnergy( h.energy );
+		febex_data->SetQint( h.Qint );
+		febex_data->SetQhalf( h.Qhalf );
+		febex_data->SetQshort( h.Qshort );
+		febex_data->SetSfp( h.sfp );
+		febex_data->SetBoard( h.board );
+		febex_data->SetChannel( h.ch );
+		febex_data->SetThreshold( h.flags & FLAG_THRES );
+		febex_data->SetVeto( h.flags & FLAG_VETO );
+		febex_data->SetFail( h.flags & FLAG_FAIL );
+		febex_data->SetPileUp( h.flags & FLAG_PILEUP );
+
+		swap_trace.assign( trace, trace + h.trace_length );
+		febex_data->SwapTrace( swap_trace );
+
+		packet->SetData( febex_data );
+
+	}
+
+	else {
+
+		info_data->ClearData();
+		info_data->SetTime( h.time );
+		info_data->SetEventID( h.eventid );
+		info_data->SetSfp( h.sfp );
+		info_data->SetBoard( h.board );
+		info_data->SetCode( h.code );
+
+		packet->SetData( info_data );
+
+	}
+
+	tree->Fill();
+
+	return;
+
+}
+
+void MiniballHitBuffer::Compact( MiniballHitStream &st ){
+
+	// Everything was written, so keep the space and start again
+	if( st.head == st.hits.size() ) {
+
+		st.hits.clear();
+		st.trace_start.clear();
+		st.samples.clear();
+		st.head = 0;
+		return;
+
+	}
+
+	// Only move the rest down when at least half of it is done
+	if( st.head < 0x1000 || 2 * st.head < st.hits.size() ) return;
+
+	// Hits that were out of order have their samples further on,
+	// so keep everything from the first sample that's still needed
+	unsigned long first = *std::min_element( st.trace_start.begin() + st.head,
+											 st.trace_start.end() );
+
+	st.hits.erase( st.hits.begin(), st.hits.begin() + st.head );
+	st.trace_start.erase( st.trace_start.begin(), st.trace_start.begin() + st.head );
+	st.samples.erase( st.samples.begin(), st.samples.begin() + first );
+	for( unsigned long i = 0; i < st.trace_start.size(); ++i )
+		st.trace_start[i] -= first;
+	st.head = 0;
+
+	return;
+
+}
+
+// Sort everything in the buffer in to a new file. The file is removed
+// straight away, so it goes when it's closed, even if we crash
+bool MiniballHitBuffer::Spill(){
+
+	if( !nbuffered ) return true;
+
+	std::string name = temp_dir + "mb_sort_run_XXXXXX";
+	std::vector<char> tmpl( name.begin(), name.end() );
+	tmpl.push_back( 0 );
+
+	FILE *fp = nullptr;
+	int fd = mkstemp( tmpl.data() );
+	if( fd >= 0 ) {
+
+		unlink( tmpl.data() );
+		fp = fdopen( fd, "w+b" );
+		if( !fp ) close( fd );
+
+	}
+
+	// Keep going in memory if we can't
+	if( !fp ) {
+
+		std::cerr << "Cannot make a temporary file in " << temp_dir;
+		std::cerr << ", keeping the hits in memory" << std::endl;
+		memory = std::numeric_limits<double>::max();
+		return false;
+
+	}
+
+	setvbuf( fp, nullptr, _IOFBF, 1 << 20 );
+	WriteAll( fp );
+	rewind( fp );
+
+	MiniballHitRun run;
+	run.fp = fp;
+	runs.push_back( run );
+
+	return true;
+
+}
+
+bool MiniballHitBuffer::ReadRun( MiniballHitRun &run ){
+
+	if( fread( &run.hit, sizeof(MiniballHit), 1, run.fp ) != 1 )
+		return false;
+
+	run.trace.resize( run.hit.trace_length );
+	if( run.hit.trace_length &&
+	    fread( run.trace.data(), sizeof(unsigned short), run.hit.trace_length, run.fp )
+	    != run.hit.trace_length )
+		return false;
+
+	return true;
+
+}
+
+// Read back a hit that was written to the tree already
+bool MiniballHitBuffer::ReadTree( TTree *t, Long64_t i, MiniballHitRun &run ){
+
+	// Straight from the flat branches
+	if( flat ) {
+
+		if( t->GetEntry( i ) <= 0 ) return false;
+		run.hit = hit;
+		if( !flat_traces ) run.hit.trace_length = 0;
+		run.trace.assign( hit_trace.begin(), hit_trace.begin() + run.hit.trace_length );
+		return true;
+
+	}
+
+	packet->ClearData();
+	if( t->GetEntry( i ) <= 0 ) return false;
+	if( !packet->IsFebex() && !packet->IsInfo() ) return false;
+
+	FromPacket( packet, run.hit, &run.trace );
+
+	return true;
+
+}
+
+// Merge all of the sorted runs in to the tree, with the hits that are
+// still in memory, which are sorted within each stream. If some hits
+// came later than ones that were written, the tree is another sorted
+// run to merge, so a new tree is filled. Every file is read in order
+void MiniballHitBuffer::Merge(){
+
+	TTree *in = nullptr;
+	Long64_t nin = 0, iin = 0;
+	MiniballHitRun tree_run;
+	if( !ordered && tree && tree->GetEntries() ) {
+
+		in = tree;
+		nin = in->GetEntries();
+
+		// Autosaved cycles of the old tree are keyed by its name, so they
+		// have to go now. Deleting it later, as "mb_unmerged", would leave
+		// them in the file next to the new tree, which may autosave too
+		if( in->GetDirectory() ) in->GetDirectory()->Delete( "mb_sort;*" );
+		in->SetName( "mb_unmerged" );
+		tree = in->CloneTree( 0 );
+		tree->SetName( "mb_sort" );
+		tree->SetDirectory( in->GetDirectory() );
+
+		// The hit file gets all of the hits again too
+		if( hit_file ) hit_file->Rewind();
+
+	}
+
+	if( nlate ) {
+
+		std::cout << " " << nlate << " hits came later than the sorting window of ";
+		std::cout << window << " ns" << std::endl;
+		if( hit_queue ) std::cout << " They were passed on to the event builder out of order" << std::endl;
+
+	}
+	std::cout << " Merging " << runs.size() << " sorted runs";
+	if( in ) std::cout << " and " << nin << " sorted hits";
+	std::cout << " with " << nbuffered + late.hits.size() << " hits in memory" << std::endl;
+
+	// Sources are the runs, then the streams, then the late hits, then the tree
+	unsigned int nruns = runs.size();
+	unsigned int nstreams = streams.size();
+	auto later = []( const std::pair<Long64_t,unsigned int> &a,
+					 const std::pair<Long64_t,unsigned int> &b ){
+		return a.first > b.first || ( a.first == b.first && a.second > b.second );
+	};
+
+	heap.clear();
+	for( unsigned int i = 0; i < nruns; ++i )
+		if( ReadRun( runs[i] ) ) heap.push_back( std::make_pair( runs[i].hit.time, i ) );
+	for( unsigned int i = 0; i < nstreams; ++i ) {
+
+		MiniballHitStream &st = streams[i];
+		if( st.head < st.hits.size() )
+			heap.push_back( std::make_pair( st.hits[st.head].time, nruns + i ) );
+
+	}
+	if( late.hits.size() )
+		heap.push_back( std::make_pair( late.hits[0].time, nruns + nstreams ) );
+	if( in && ReadTree( in, iin++, tree_run ) )
+		heap.push_back( std::make_pair( tree_run.hit.time, nruns + nstreams + 1 ) );
+	std::make_heap( heap.begin(), heap.end(), later );
+
+	while( heap.size() ) {
+
+		std::pop_heap( heap.begin(), heap.end(), later );
+		unsigned int s = heap.back().second;
+		heap.pop_back();
+
+		bool more = false;
+		Long64_t next = 0;
+
+		// From a run file
+		if( s < nruns ) {
+
+			WriteHit( runs[s].hit, runs[s].trace.data() );
+			if( ( more = ReadRun( runs[s] ) ) ) next = runs[s].hit.time;
+
+		}
+
+		// From memory
+		else if( s < nruns + nstreams ) {
+
+			MiniballHitStream &st = streams[s-nruns];
+			WriteHit( st.hits[st.head], st.samples.data() + st.trace_start[st.head] );
+			st.head++;
+			nbuffered--;
+			if( ( more = st.head < st.hits.size() ) ) next = st.hits[st.head].time;
+
+		}
+
+		// From the late hits
+		else if( s == nruns + nstreams ) {
+
+			MiniballHitStream &st = late;
+			WriteHit( st.hits[st.head], st.samples.data() + st.trace_start[st.head] );
+			st.head++;
+			if( ( more = st.head < st.hits.size() ) ) next = st.hits[st.head].time;
+
+		}
+
+		// From the old tree
+		else {
+
+			WriteHit( tree_run.hit, tree_run.trace.data(), false );
+			if( ( more = iin < nin && ReadTree( in, iin++, tree_run ) ) )
+				next = tree_run.hit.time;
+
+		}
+
+		if( more ) {
+
+			heap.push_back( std::make_pair( next, s ) );
+			std::push_heap( heap.begin(), heap.end(), later );
+
+		}
+
+	}
+
+	// Everything is in the tree now
+	for( unsigned int i = 0; i < nruns; ++i )
+		fclose( runs[i].fp );
+	runs.clear();
+	for( unsigned int i = 0; i < nstreams; ++i )
+		Compact( streams[i] );
+	late.hits.clear();
+	late.trace_start.clear();
+	late.samples.clear();
+	late.head = 0;
+	nbytes = 0;
+
+	// Remove the old tree from memory and its baskets from the file
+	if( in ) in->Delete( "all" );
+
+	spilling = false;
+	ordered = true;
+
+	return;
+
+}
@@ -0,0 +1,317 @@
+#include "HitFile.hh"
+
+// zlib is only needed here, like for the data files
+#include <zlib.h>
+
+// The header sits in the place of the first hit
+static_assert( sizeof(MiniballHitFileHeader) == sizeof(MiniballHit),
+			   "hit file header must be the same size as a hit" );
+
+MiniballHitFile::MiniballHitFile() {
+
+	output_file = nullptr;
+	level = 0;
+	header_bytes = 0;
+	current = nullptr;
+	current_block = 0;
+	have_block = false;
+	release_blocks = false;
+	std::memset( &header, 0, sizeof(header) );
+
+}
+
+MiniballHitFile::~MiniballHitFile() {
+
+	Close();
+
+}
+
+// Open a new hit file for writing
+bool MiniballHitFile::Create( std::string _filename, ULong64_t hash, int lvl ){
+
+	// Close file if already open
+	Close();
+
+	output_file = fopen( _filename.data(), "w+b" );
+	if( !output_file ) {
+
+		std::cerr << "Unable to write hit file " << _filename << std::endl;
+		return false;
+
+	}
+
+	filename = _filename;
+	level = lvl < 0 ? 0 : ( lvl > 9 ? 9 : lvl );
+	block.clear();
+	block.reserve( BLOCK_HITS );
+
+	std::memset( &header, 0, sizeof(header) );
+	std::memcpy( header.magic, MAGIC, 8 );
+	header.byte_order = 1;
+	header.record_size = sizeof(MiniballHit);
+	header.settings_hash = hash;
+
+	// The header isn't compressed, but it's still a gzip stream of
+	// its own in a compressed file, so it's always the same size
+	if( !WriteBlock( (const char*)&header, sizeof(header), 0 ) ) {
+
+		Close();
+		return false;
+
+	}
+	header_bytes = ftell( output_file );
+
+	return true;
+
+}
+
+// Add a hit to the block, writing the block when it's full
+void MiniballHitFile::Write( const MiniballHit &h ){
+
+	if( !output_file ) return;
+
+	// Copy each part so that the padding is always zero
+	block.emplace_back();
+	MiniballHit &r = block.back();
+	std::memset( &r, 0, sizeof(r) );
+	r.time = h.time;
+	r.eventid = h.eventid;
+	r.energy = h.energy;
+	r.Qint = h.Qint;
+	r.Qhalf = h.Qhalf;
+	r.Qshort = h.Qshort;
+	r.sfp = h.sfp;
+	r.board = h.board;
+	r.ch = h.ch;
+	r.code = h.code;
+	r.flags = h.flags;
+	r.trace_length = 0;
+
+	header.nhits++;
+	if( h.flags & MiniballHitBuffer::FLAG_FEBEX ) header.nfebex++;
+
+	if( block.size() == BLOCK_HITS ) {
+
+		WriteBlock( (const char*)block.data(), block.size() * sizeof(MiniballHit), level );
+		block.clear();
+
+	}
+
+	return;
+
+}
+
+// Start again with no hits after the header
+void MiniballHitFile::Rewind(){
+
+	if( !output_file ) return;
+
+	fflush( output_file );
+	if( ftruncate( fileno( output_file ), header_bytes ) != 0 )
+		std::cerr << __FUNCTION__ << ": Unable to truncate " << filename << std::endl;
+	fseek( output_file, header_bytes, SEEK_SET );
+
+	block.clear();
+	header.nhits = 0;
+	header.nfebex = 0;
+
+	return;
+
+}
+
+// Write some bytes, as a gzip stream if the file is compressed
+bool MiniballHitFile::WriteBlock( const char *src, size_t n, int lvl ){
+
+	if( !level ) {
+
+		if( fwrite( src, 1, n, output_file ) != n ) {
+
+			std::cerr << __FUNCTION__ << ": Unable to write to " << filename << std::endl;
+			return false;
+
+		}
+
+		return true;
+
+	}
+
+	// A window of 15 bits, plus 16 for a gzip header and trailer
+	z_stream zs;
+	std::memset( &zs, 0, sizeof(zs) );
+	if( deflateInit2( &zs, lvl, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY ) != Z_OK ) {
+
+		std::cerr << __FUNCTION__ << ": Unable to start compressing " << filename << std::endl;
+		return false;
+
+	}
+
+	zbuf.resize( deflateBound( &zs, n ) );
+	zs.next_in = (Bytef*)src;
+	zs.avail_in = n;
+	zs.next_out = zbuf.data();
+	zs.avail_out = zbuf.size();
+	int ret = deflate( &zs, Z_FINISH );
+	size_t nout = zbuf.size() - zs.avail_out;
+	deflateEnd( &zs );
+
+	if( ret != Z_STREAM_END ) {
+
+		std::cerr << __FUNCTION__ << ": Unable to compress a block of " << filename << std::endl;
+		return false;
+
+	}
+
+	if( fwrite( zbuf.data(), 1, nout, output_file ) != nout ) {
+
+		std::cerr << __FUNCTION__ << ": Unable to write to " << filename << std::endl;
+		return false;
+
+	}
+
+	return true;
+
+}
+
+// Put the counts in the header at the start of the file
+bool MiniballHitFile::WriteHeader(){
+
+	fseek( output_file, 0, SEEK_SET );
+	if( !WriteBlock( (const char*)&header, sizeof(header), 0 ) ) return false;
+
+	// This can't happen, but it would break the file if it did
+	if( ftell( output_file ) != header_bytes ) {
+
+		std::cerr << __FUNCTION__ << ": Header of " << filename;
+		std::cerr << " has changed size" << std::endl;
+		return false;
+
+	}
+
+	fseek( output_file, 0, SEEK_END );
+
+	return true;
+
+}
+
+// Open a hit file and check its header
+bool MiniballHitFile::Open( std::string _filename ){
+
+	// Close file if already open
+	Close();
+
+	// Each block that we ask for has to fit in a chunk when it's compressed
+	input_file.SetBlockSize( BLOCK_HITS * sizeof(MiniballHit) );
+	if( !input_file.Open( _filename ) ) return false;
+	filename = _filename;
+
+	const char *h = input_file.GetBlock( 0, sizeof(header) );
+	if( h ) std::memcpy( &header, h, sizeof(header) );
+	if( !h || std::strncmp( header.magic, MAGIC, 8 ) != 0 ||
+		header.byte_order != 1 || header.record_size != sizeof(MiniballHit) ) {
+
+		std::cerr << _filename << " is not a valid hit file" << std::endl;
+		Close();
+		return false;
+
+	}
+
+	return true;
+
+}
+
+void MiniballHitFile::Close(){
+
+	// Finish off a file that we are writing
+	if( output_file ) {
+
+		if( block.size() )
+			WriteBlock( (const char*)block.data(), block.size() * sizeof(MiniballHit), level );
+		block.clear();
+
+		WriteHeader();
+		fclose( output_file );
+		output_file = nullptr;
+
+	}
+
+	if( input_file.IsOpen() ) input_file.Close();
+	current = nullptr;
+	have_block = false;
+	current_block = 0;
+
+	return;
+
+}
+
+// Get a hit, reading the next block of the file when we get to it
+const MiniballHit* MiniballHitFile::GetHit( ULong64_t i ){
+
+	if( i >= header.nhits || !input_file.IsOpen() ) return nullptr;
+
+	// The header is in the first record
+	ULong64_t rec = i + 1;
+	ULong64_t b = rec / BLOCK_HITS;
+	if( !have_block || b != current_block ) {
+
+		ULong64_t start = b * BLOCK_HITS;
+		ULong64_t n = header.nhits + 1 - start;
+		if( n > BLOCK_HITS ) n = BLOCK_HITS;
+
+		// Let go of the blocks before this one. A compressed file has to,
+		// so the decompressor can carry on, but the pages of a plain file
+		// are only dropped if nobody is going to read them again
+		if( have_block && b > current_block &&
+			( release_blocks || input_file.IsCompressed() ) )
+			input_file.Release( start * sizeof(MiniballHit) );
+
+		const char *p = input_file.GetBlock( start * sizeof(MiniballHit), n * sizeof(MiniballHit) );
+		if( !p ) {
+
+			std::cerr << __FUNCTION__ << ": " << filename;
+			std::cerr << " is shorter than its header says" << std::endl;
+			have_block = false;
+			return nullptr;
+
+		}
+
+		current = (const MiniballHit*)p;
+		current_block = b;
+		have_block = true;
+
+	}
+
+	return current + ( rec - current_block * BLOCK_HITS );
+
+}
+
+// A hash of the FEBEX layout and where the info signals come from,
+// since the hits are no good to an event builder with different ones
+ULong64_t MiniballHitFile::SettingsHash( std::shared_ptr<MiniballSettings> set ){
+
+	std::vector<ULong64_t> values = {
+		set->GetNumberOfFebexSfps(),
+		set->GetNumberOfFebexBoards(),
+		set->GetNumberOfFebexChannels(),
+		set->IsFebexOnly(),
+		set->GetPulserSfp(), set->GetPulserBoard(), set->GetPulserChannel(),
+		set->GetEBISSfp(), set->GetEBISBoard(), set->GetEBISChannel(),
+		set->GetT1Sfp(), set->GetT1Board(), set->GetT1Channel(),
+		set->GetSCSfp(), set->GetSCBoard(), set->GetSCChannel()
+	};
+
+	// FNV-1a, a byte at a time
+	ULong64_t hash = 0xcbf29ce484222325ULL;
+	for( unsigned int i = 0; i < values.size(); ++i ) {
+
+		for( unsigned int j = 0; j < 8; ++j ) {
+
+			hash ^= ( values[i] >> ( 8 * j ) ) & 0xff;
+			hash *= 0x100000001b3ULL;
+
+		}
+
+	}
+
+	return hash;
+
+}
@@ -0,0 +1,116 @@
+#include "HitQueue.hh"
+
+MiniballHitQueue::MiniballHitQueue() {
+
+	Open();
+
+}
+
+// Start again with an empty queue
+void MiniballHitQueue::Open( unsigned int nblocks ){
+
+	std::lock_guard<std::mutex> lock( mtx );
+
+	// Keep the space of the old blocks
+	while( full.size() ) {
+
+		spare.push_back( std::move( full.front() ) );
+		full.pop_front();
+
+	}
+
+	filling.clear();
+	filling.reserve( BLOCK_HITS );
+	reading.clear();
+	read_first = 0;
+	nhits = 0;
+	closed = false;
+	max_blocks = nblocks > 0 ? nblocks : 1;
+
+	return;
+
+}
+
+// Add a hit to the block, sending the block when it's full
+void MiniballHitQueue::Push( const MiniballHit &h ){
+
+	filling.push_back( h );
+	filling.back().trace_length = 0;
+
+	if( filling.size() == BLOCK_HITS ) Send();
+
+	return;
+
+}
+
+// Move the block on to the queue, once there is space for it. Each block
+// is checked against the bound by itself, however many hits are pushed
+void MiniballHitQueue::Send(){
+
+	std::unique_lock<std::mutex> lock( mtx );
+	cv.wait( lock, [&]{ return full.size() < max_blocks; } );
+
+	nhits += filling.size();
+	full.push_back( std::move( filling ) );
+
+	// Fill a block that was used before if there is one
+	if( spare.size() ) {
+
+		filling = std::move( spare.back() );
+		spare.pop_back();
+
+	}
+	else filling = std::vector<MiniballHit>();
+
+	filling.clear();
+	filling.reserve( BLOCK_HITS );
+
+	lock.unlock();
+	cv.notify_all();
+
+	return;
+
+}
+
+// Send what's left and let the reader know that's all
+void MiniballHitQueue::Close(){
+
+	if( filling.size() ) Send();
+
+	std::unique_lock<std::mutex> lock( mtx );
+	closed = true;
+	lock.unlock();
+	cv.notify_all();
+
+	return;
+
+}
+
+// Get a hit, waiting for the next block when we get to the end of this one
+const MiniballHit* MiniballHitQueue::GetHit( unsigned long i ){
+
+	// Already gone
+	if( i < read_first ) return nullptr;
+
+	while( i >= read_first + reading.size() ) {
+
+		std::unique_lock<std::mutex> lock( mtx );
+		cv.wait( lock, [&]{ return full.size() || closed; } );
+
+		// The end of the hits
+		if( !full.size() ) return nullptr;
+
+		// Give back the block we've finished with and take the next one
+		read_first += reading.size();
+		if( reading.capacity() ) spare.push_back( std::move( reading ) );
+		reading = std::move( full.front() );
+		full.pop_front();
+
+		lock.unlock();
+		cv.notify_all();
+
+	}
+
+	return reading.data() + ( i - read_first );
+
+}
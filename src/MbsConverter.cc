@@ -47,42 +47,30 @@ void MiniballMbsConverter::ProcessFebexData( UInt_t &pos ) {
 	flag_febex_data0 = false;
 	flag_febex_trace = false;
 
-	// Check for padding - Liam
-	while( (data[pos++] & 0xFFFF0000) == 0xADD00000 ) {
-
-		// Make sure we can still read the channel ID and data header after this
-		if( pos + 2 >= ndata ) {
-			std::cerr << "No data, only padding in this event" << std::endl;
-			pos = ndata;
-			return;
-		}
+	// Find where everything is, then we read it from the start of the channel
+	MiniballMbsChannel chan;
+	channel_status_t status = FindChannel( data, ndata, pos, chan );
+	UInt_t end = pos;
 
+	if( status == CHANNEL_PADDING ) {
+		std::cerr << "No data, only padding in this event" << std::endl;
+		pos = ndata;
+		return;
 	}
-	pos--;
-	
-	// Padding - Nik
-	//unsigned int first_word = data[pos++];
-	//if( ( first_word & 0xFFF00000 ) == 0xADD00000 ) {
-	//
-	//	//std::cout << "Padding found" << std::endl;
-	//	pos += ((first_word & 0xFF00) >> 8 );
-	//	pos--;
-	//
-	//}
-	
+
 	// Get channel header
-	if( !GetFebexChanID( data[pos++] ) ){
+	if( !GetFebexChanID( chan.id ) ){
 		pos = ndata;
 		return;
 	}
+	pos = chan.body;
 	
 	// Special channel
 	if( my_ch_id == 255 ) {
 		
-		// Get the length in bytes
-		auto length = data[pos++];
-		nsamples = (length - 16) >> 3; // Length in 64-bit (8-byte) words
-		if( pos + 4 + 2*nsamples > ndata ) {
+		// Length in 64-bit (8-byte) words
+		nsamples = chan.nwords;
+		if( status == CHANNEL_BAD_LENGTH ) {
 			std::cerr << "Wrong number of data words (" << (int)nsamples+5;
 			std::cerr << ") for data remaning data size (";
 			std::cerr << ndata-pos << ")" << std::endl;
@@ -190,8 +178,8 @@ void MiniballMbsConverter::ProcessFebexData( UInt_t &pos ) {
 		}
 		
 		// Spec trailer
-		auto spectrailer = data[pos++];
-		if( ((spectrailer & 0xff000000) >> 24) != 0xbf ){
+		auto spectrailer = data[chan.trailer];
+		if( status == CHANNEL_BAD_TRAILER ){
 			std::cerr << "Invalid special trailer: ";
 			std::cerr << ((spectrailer & 0xff000000) >> 24);
 			std::cerr << std::endl;
@@ -203,9 +191,9 @@ void MiniballMbsConverter::ProcessFebexData( UInt_t &pos ) {
 	
 	else { // Trace
 
-		// Trace size
-		nsamples = (data[pos++]/4) - 2; // In 32-bit words - 2 samples per word?
-		if( pos + 2 + nsamples > ndata ) {
+		// Trace size, in 32-bit words
+		nsamples = chan.nwords;
+		if( status == CHANNEL_BAD_LENGTH ) {
 			std::cerr << "Wrong number of trace samples (" << (int)nsamples+2;
 			std::cerr << ") for data remaning data size (";
 			std::cerr << ndata-pos << ")" << std::endl;
@@ -214,71 +202,75 @@ void MiniballMbsConverter::ProcessFebexData( UInt_t &pos ) {
 		}
 
 		// Trace header
-		unsigned int trace_header = data[pos++];
-		if( ((trace_header & 0xff000000) >> 24) != 0xaa ){
+		unsigned int trace_header = chan.trace_header;
+		if( status == CHANNEL_BAD_HEADER ){
 			std::cerr << "Invalid trace header: ";
 			std::cerr << ((trace_header & 0xff000000) >> 24);
 			std::cerr << std::endl;
 			pos = ndata;
 			return;
 		}
+		pos = chan.first;
 		
-		bool adc_type = (trace_header & 0x800000) >> 23;
 		bool filter_on = (trace_header & 0x80000) >> 19;
 		bool filter_mode = (trace_header & 0x40000) >> 18;
 
-		for( UInt_t i = 0; i < nsamples; i++ ) {
+		// With the filter on, each word has one sample and the filter
+		// energy, and the energy of the last one is kept
+		if( filter_on && nsamples ) {
 
-			auto sample_packet = data[pos++];
+			auto sample_packet = data[pos+nsamples-1];
+			bool filter_sign = (sample_packet & 0x800000) >> 23;
+			int filter_energy = sample_packet & 0x7fffff;
+			if( filter_sign ) filter_energy *= -1.0;
+			febex_data->SetQint( filter_energy );
+			
+		}
 
-			if( nsamples > 0 ) {
+		// Use the trace from a worker thread if it has done it already
+		MiniballMbsTrace *prepared = nullptr;
+		if( prepared_event ) {
 
-				//std::cout << pos << " : " << sample_packet << std::endl;
-				//std::cout << " " << (( sample_packet >> 16 ) & 0x0000FFFF) << std::endl;
-				//std::cout << " " << (sample_packet & 0x0000FFFF) << std::endl;
+			unsigned int last = prepared_event->first_trace + prepared_event->ntraces;
+			while( prepared_trace < last &&
+				   prepared_batch->traces[prepared_trace].start < pos )
+				prepared_trace++;
 
-			}
-			
-			if( filter_on ) {
-			
-				if( adc_type ) febex_data->AddSample( ( sample_packet >> 16 ) & 0x00003FFF ); // 14 bit
-				else febex_data->AddSample( ( sample_packet >> 16 ) & 0x00000FFF ); // 12 bit
-				
-				bool filter_sign = (sample_packet & 0x800000) >> 23;
-				int filter_energy = sample_packet & 0x7fffff;
-				if( filter_sign ) filter_energy *= -1.0;
-				febex_data->SetQint( filter_energy );
-				
-			}
-			
-			else {
-				
-				if( adc_type ) { // 14 bit
-			
-					febex_data->AddSample( sample_packet & 0x00003FFF );
-					febex_data->AddSample( ( sample_packet >> 16 ) & 0x00003FFF );
-			
-				}
-				
-				else { // 12 bit
-					
-					febex_data->AddSample( sample_packet & 0x00000FFF );
-					febex_data->AddSample( ( sample_packet >> 16 ) & 0x00000FFF );
+			if( prepared_trace < last &&
+			    prepared_batch->traces[prepared_trace].start == pos )
+				prepared = &prepared_batch->traces[prepared_trace++];
+
+		}
+
+		if( prepared ) {
+
+			trace_samples.swap( prepared->samples );
+			mwd_energy.swap( prepared->mwd_energy );
+			mwd_time.swap( prepared->mwd_time );
 
-				}
-			
-			}
-			
 		}
 
-		FebexMWD mwd = cal->DoMWD( my_sfp_id, my_board_id, my_ch_id, febex_data->GetTrace() );
-		for( unsigned int i = 0; i < mwd.NumberOfTriggers(); ++i ) {
+		// Otherwise unpack the samples and do the MWD now
+		else {
+
+			UnpackTrace( data + pos, nsamples, trace_header, trace_samples );
+			FebexMWD mwd = cal->DoMWD( my_sfp_id, my_board_id, my_ch_id, trace_samples );
+			mwd_energy = mwd.GetEnergies();
+			mwd_time = mwd.GetCfdTimes();
+
+		}
+		pos += nsamples;
+
+		// The samples go to the first hit from this trace, if we write them
+		if( KeepTrace( my_sfp_id, my_board_id, my_ch_id ) )
+			febex_data->SwapTrace( trace_samples );
+		for( unsigned int i = 0; i < mwd_energy.size(); ++i ) {
 
 			flag_febex_trace = true;
 
 			// Make a FebexData item
-			febex_data->SetQint( mwd.GetEnergy(i) );
-			febex_data->SetTime( my_tm_stp + mwd.GetCfdTime(i) );
+			febex_data->SetQint( mwd_energy[i] );
+			febex_data->SetTime( my_tm_stp + mwd_time[i] );
 			febex_data->SetSfp( my_sfp_id );
 			febex_data->SetBoard( my_board_id );
 			febex_data->SetChannel( my_ch_id );
@@ -292,8 +284,8 @@ void MiniballMbsConverter::ProcessFebexData( UInt_t &pos ) {
 		}
 
 		// Trace trailer
-		auto tracetrailer = data[pos++];
-		if( ((tracetrailer & 0xff000000) >> 24) != 0xbb ){
+		auto tracetrailer = data[chan.trailer];
+		if( status == CHANNEL_BAD_TRAILER ){
 			std::cerr << "Invalid trace trailer: ";
 			std::cerr << ((tracetrailer & 0xff000000) >> 24);
 			std::cerr << std::endl;
@@ -302,11 +294,159 @@ void MiniballMbsConverter::ProcessFebexData( UInt_t &pos ) {
 		}
 
 	}
+
+	// Carry on after the trailer
+	pos = end;
 	
 	return;
 	
 }
 
+// Find the parts of the channel that starts at pos, checking everything
+// that says where the next channel starts. The hits and the samples
+// themselves are left for the caller
+MiniballMbsConverter::channel_status_t
+MiniballMbsConverter::FindChannel( const UInt_t *d, size_t n, UInt_t &pos,
+								   MiniballMbsChannel &chan ){
+
+	// Check for padding - Liam
+	while( (d[pos++] & 0xFFFF0000) == 0xADD00000 ) {
+
+		// Make sure we can still read the channel ID and data header after this
+		if( pos + 2 >= n ) {
+			pos = n;
+			return CHANNEL_PADDING;
+		}
+
+	}
+	pos--;
+	
+	// Padding - Nik
+	//unsigned int first_word = d[pos++];
+	//if( ( first_word & 0xFFF00000 ) == 0xADD00000 ) {
+	//
+	//	//std::cout << "Padding found" << std::endl;
+	//	pos += ((first_word & 0xFF00) >> 8 );
+	//	pos--;
+	//
+	//}
+
+	// Channel header
+	chan.id = d[pos++];
+	chan.sfp = (chan.id & 0xF000) >> 12;
+	chan.board = (chan.id & 0xFF0000) >> 16;
+	chan.ch = (chan.id & 0xFF000000) >> 24;
+	chan.nwords = 0;
+	chan.trace_header = 0;
+
+	channel_status_t status = CheckChannelID( chan.id );
+	if( status != CHANNEL_OK ) {
+		pos = n;
+		return status;
+	}
+
+	// The length comes next
+	if( pos >= n ) {
+		chan.body = pos;
+		pos = n;
+		return CHANNEL_BAD_LENGTH;
+	}
+	UInt_t length = d[pos++];
+	chan.body = pos;
+
+	// Special channel: spec header, two timestamp words,
+	// then two words for each hit and the trailer
+	if( chan.ch == 255 ) {
+
+		chan.nwords = (length - 16) >> 3; // Length in 64-bit (8-byte) words
+		if( pos + 4 + 2*chan.nwords > n ) {
+			pos = n;
+			return CHANNEL_BAD_LENGTH;
+		}
+
+		chan.first = pos + 3;
+		chan.trailer = chan.first + 2*chan.nwords;
+		pos = chan.trailer + 1;
+		if( ((d[chan.trailer] & 0xff000000) >> 24) != 0xbf ) return CHANNEL_BAD_TRAILER;
+
+	}
+
+	// Trace: trace header, the samples and the trailer
+	else {
+
+		chan.nwords = (length/4) - 2; // In 32-bit words - 2 samples per word?
+		if( pos + 2 + chan.nwords > n ) {
+			pos = n;
+			return CHANNEL_BAD_LENGTH;
+		}
+
+		chan.trace_header = d[pos];
+		if( ((chan.trace_header & 0xff000000) >> 24) != 0xaa ) {
+			pos = n;
+			return CHANNEL_BAD_HEADER;
+		}
+
+		chan.first = pos + 1;
+		chan.trailer = chan.first + chan.nwords;
+		pos = chan.trailer + 1;
+		if( ((d[chan.trailer] & 0xff000000) >> 24) != 0xbb ) return CHANNEL_BAD_TRAILER;
+
+	}
+
+	return CHANNEL_OK;
+
+}
+
+// Check that a channel header is one of ours
+MiniballMbsConverter::channel_status_t MiniballMbsConverter::CheckChannelID( UInt_t x ){
+
+	unsigned char tag = (x & 0xFF);
+	unsigned char sfp = (x & 0xF000) >> 12;
+	unsigned char board = (x & 0xFF0000) >> 16;
+	unsigned char ch = (x & 0xFF000000) >> 24;
+
+	if( tag != 0x34 ) return CHANNEL_BAD_TAG;
+
+	if( sfp >= set->GetNumberOfFebexSfps() ||
+	    board >= set->GetNumberOfFebexBoards() ||
+	    ( ch >= set->GetNumberOfFebexChannels() && ch != 255 ) )
+		return CHANNEL_BAD_ID;
+
+	return CHANNEL_OK;
+
+}
+
+
+// Unpack the samples of a trace, given its header word. With the filter
+// on, each word has one sample, otherwise there are two in each word
+void MiniballMbsConverter::UnpackTrace( const UInt_t *words, UInt_t nwords,
+									   UInt_t trace_header,
+									   std::vector<unsigned short> &samples ){
+
+	bool adc_type = (trace_header & 0x800000) >> 23;
+	bool filter_on = (trace_header & 0x80000) >> 19;
+
+	// 14 bit or 12 bit samples
+	UShort_t sample_mask = adc_type ? 0x00003FFF : 0x00000FFF;
+
+	if( filter_on ) {
+
+		samples.resize( nwords );
+		for( UInt_t i = 0; i < nwords; i++ )
+			samples[i] = ( words[i] >> 16 ) & sample_mask;
+
+	}
+
+	else {
+
+		samples.resize( 2 * nwords );
+		UnpackSamples32( words, nwords, sample_mask, samples.data() );
+
+	}
+
+	return;
+
+}
 
 bool MiniballMbsConverter::GetFebexChanID( unsigned int x ){
 	
@@ -326,7 +466,8 @@ bool MiniballMbsConverter::GetFebexChanID( unsigned int x ){
 	//std::cout << "my_ch_id: " << (unsigned int)my_ch_id << std::endl;
 
 	// Make sure it is valid
-	if( my_tag_id != 0x34 ) {
+	channel_status_t status = CheckChannelID( x );
+	if( status == CHANNEL_BAD_TAG ) {
 		
 		std::cerr << "Invalid channel header: ";
 		std::cerr << (int)my_tag_id << std::endl;
@@ -335,10 +476,7 @@ bool MiniballMbsConverter::GetFebexChanID( unsigned int x ){
 	}
 	
 	// Check things make sense
-	if( my_sfp_id >= set->GetNumberOfFebexSfps() ||
-	    my_board_id >= set->GetNumberOfFebexBoards() ||
-	    ( my_ch_id >= set->GetNumberOfFebexChannels()
-		 && my_ch_id != 255 ) ) {
+	if( status == CHANNEL_BAD_ID ) {
 		
 		std::cerr << "Bad FEBEX event with sfp_id=" << (unsigned int)my_sfp_id;
 		std::cerr << " board_id=" << (unsigned int)my_board_id;
@@ -359,10 +497,10 @@ void MiniballMbsConverter::FinishFebexData(){
 	time_corr += cal->FebexTime( febex_data->GetSfp(), febex_data->GetBoard(), febex_data->GetChannel() );
 
 	// Check if this is actually just a timestamp or info like event
+	const MiniballChannel &chan = set->GetChannel( febex_data->GetSfp(),
+												   febex_data->GetBoard(), febex_data->GetChannel() );
 	flag_febex_info = false;
-	if( febex_data->GetSfp()     == set->GetPulserSfp()     &&
-	    febex_data->GetBoard()   == set->GetPulserBoard()   &&
-	    febex_data->GetChannel() == set->GetPulserChannel() ){
+	if( chan.flags & MiniballSettings::CHANNEL_PULSER ){
 		
 		flag_febex_info = true;
 		my_info_code = 20; // Pulser is always 20 (defined here)
@@ -371,18 +509,14 @@ void MiniballMbsConverter::FinishFebexData(){
 		
 	}
 	
-	else if( febex_data->GetSfp()     == set->GetEBISSfp()     &&
-			 febex_data->GetBoard()   == set->GetEBISBoard()   &&
-			 febex_data->GetChannel() == set->GetEBISChannel() ){
+	else if( chan.flags & MiniballSettings::CHANNEL_EBIS ){
 		
 		flag_febex_info = true;
 		my_info_code = 21; // EBIS is always 21 (defined here)
 		
 	}
 	
-	else if( febex_data->GetSfp()     == set->GetT1Sfp()     &&
-			 febex_data->GetBoard()   == set->GetT1Board()   &&
-			 febex_data->GetChannel() == set->GetT1Channel() ){
+	else if( chan.flags & MiniballSettings::CHANNEL_T1 ){
 		
 		flag_febex_info = true;
 		my_info_code = 22; // T1 is always 22 (defined here)
@@ -397,8 +531,7 @@ void MiniballMbsConverter::FinishFebexData(){
 		info_data->SetSfp( febex_data->GetSfp() );
 		info_data->SetBoard( febex_data->GetBoard() );
 		info_data->SetCode( my_info_code );
-		data_packet->SetData( info_data );
-		output_tree->Fill();
+		hits.AddInfo( info_data );
 
 	}
 	
@@ -420,8 +553,7 @@ void MiniballMbsConverter::FinishFebexData(){
 		// Set this data and fill event to tree
 		// Also add the time offset when we do this
 		febex_data->SetTime( time_corr );
-		data_packet->SetData( febex_data );
-		output_tree->Fill();
+		hits.AddFebex( febex_data );
 
 	}
 	
@@ -441,6 +573,7 @@ void MiniballMbsConverter::FinishFebexData(){
 
 	// Count the hit, even if it's bad
 	ctr_febex_hit[febex_data->GetSfp()][febex_data->GetBoard()]++;
+	IndexHit( febex_data->GetSfp(), febex_data->GetTime() );
 	
 	// Clean up.
 	data_packet->ClearData();
@@ -451,6 +584,105 @@ void MiniballMbsConverter::FinishFebexData(){
 
 }
 
+// Convert the current event, which starts at a given buffer and position
+void MiniballMbsConverter::ConvertEvent( unsigned long mbsevt, UInt_t evt_buffer,
+										 UInt_t evt_pos, bool process ){
+
+	my_event_id = ev->GetEventID();
+
+	// New index entry for each buffer that an event starts in
+	if( !flag_index_entry || evt_buffer != index_entry.block )
+		StartIndexEntry( evt_pos, evt_buffer, mbsevt );
+
+	// Write the MBS event info
+	mbsinfo_packet->SetTime( my_good_tm_stp );
+	mbsinfo_packet->SetEventID( my_event_id );
+	mbsinfo_tree->Fill();
+
+	// Check if we are before the start sub event
+	if( !process ) return;
+
+	// Process current block
+	ProcessBlock( mbsevt );
+
+	return;
+
+}
+
+// Function to follow a file that is still being written. Each call only
+// converts the events that were added since the last one. The file stays
+// open and the decoder state is kept, so nothing is lost between calls
+int MiniballMbsConverter::FollowFile( std::string input_file_name ) {
+
+	// Open the file the first time, or if it changed
+	if( !mbs.IsOpen() || mbs.GetFileName() != input_file_name ) {
+
+		std::cout << "Following MBS file: " << input_file_name << std::endl;
+		mbs.SetBufferSize( set->GetBlockSize() );
+		mbs.OpenFile( input_file_name );
+		if( !mbs.IsOpen() ) return -1;
+
+		StartFile();
+		follow_evt = 0;
+
+	}
+
+	// Otherwise see if there's anything new
+	else mbs.Refresh();
+
+	// Convert all the complete events that we have now
+	while( ( ev = mbs.GetNextEvent() ) ) {
+
+		my_event_id = ev->GetEventID();
+
+		// Write the MBS event info
+		mbsinfo_packet->SetTime( my_good_tm_stp );
+		mbsinfo_packet->SetEventID( my_event_id );
+		mbsinfo_tree->Fill();
+
+		// Process current block
+		ProcessBlock( follow_evt++ );
+
+	}
+
+	return follow_evt;
+
+}
+
+// Function to follow the data from an MBS event server. Events arrive
+// in the background and each call converts the ones that are waiting
+int MiniballMbsConverter::FollowEventServer( std::string server, unsigned short port ) {
+
+	// Connect the first time, or again if the server went away
+	if( !mbs.IsStreamOpen() || mbs.IsStreamEnd() ) {
+
+		std::cout << "Connecting to MBS event server: " << server << ":" << port << std::endl;
+		if( mbs.OpenEventServer( server, port ) ) return -1;
+
+		StartFile();
+		follow_evt = 0;
+
+	}
+
+	// Convert all the events that we have now
+	while( ( ev = mbs.GetNextEventFromStream() ) ) {
+
+		my_event_id = ev->GetEventID();
+
+		// Write the MBS event info
+		mbsinfo_packet->SetTime( my_good_tm_stp );
+		mbsinfo_packet->SetEventID( my_event_id );
+		mbsinfo_tree->Fill();
+
+		// Process current block
+		ProcessBlock( follow_evt++ );
+
+	}
+
+	return follow_evt;
+
+}
+
 // Function to run the conversion for a single file
 int MiniballMbsConverter::ConvertFile( std::string input_file_name,
 							 unsigned long start_subevt,
@@ -459,9 +691,11 @@ int MiniballMbsConverter::ConvertFile( std::string input_file_name,
 	// Uncomment to force only a few subevts - debug
 	//end_subevt = 1000;
 	
-	// Read the file.
-	std::ifstream input_file( input_file_name, std::ios::in|std::ios::binary );
-	if( !input_file.is_open() ){
+	// Open the file and map it into memory, only once
+	std::cout << "Opening file: " << input_file_name << std::endl;
+	mbs.SetBufferSize( set->GetBlockSize() );
+	mbs.OpenFile( input_file_name );
+	if( !mbs.IsOpen() ){
 		
 		std::cout << "Cannot open " << input_file_name << std::endl;
 		return -1;
@@ -472,49 +706,70 @@ int MiniballMbsConverter::ConvertFile( std::string input_file_name,
 	StartFile();
 
 	// Calculate the size of the file.
-	input_file.seekg( 0, input_file.end );
-	unsigned long long size_end = input_file.tellg();
-	input_file.seekg( 0, input_file.beg );
-	unsigned long long size_beg = input_file.tellg();
-	unsigned long long FILE_SIZE = size_end - size_beg;
+	unsigned long long FILE_SIZE = mbs.GetFileSize();
 
 	// Calculate the number of blocks in the file.
 	unsigned long BLOCKS_NUM = FILE_SIZE / set->GetBlockSize();
-	
-	// a sanity check for file size...
-	if( FILE_SIZE % set->GetBlockSize() != 0 ){
-		
-		std::cout << " *WARNING* " << __PRETTY_FUNCTION__;
-		std::cout << "\tMissing data blocks?" << std::endl;
+
+	// a sanity check for file size, which we can't do if it's compressed
+	if( mbs.IsCompressed() ) {
+
+		sslogs << "\t File size = unknown, compressed" << std::endl;
+		sslogs << "\tBlock size = " << set->GetBlockSize() << std::endl;
 
 	}
+
+	else {
+
+		if( FILE_SIZE % set->GetBlockSize() != 0 ){
+		
+			std::cout << " *WARNING* " << __PRETTY_FUNCTION__;
+			std::cout << "\tMissing data blocks?" << std::endl;
+
+		}
 	
-	sslogs << "\t File size = " << FILE_SIZE << std::endl;
-	sslogs << "\tBlock size = " << set->GetBlockSize() << std::endl;
-	sslogs << "\t  N blocks = " << BLOCKS_NUM << std::endl;
+		sslogs << "\t File size = " << FILE_SIZE << std::endl;
+		sslogs << "\tBlock size = " << set->GetBlockSize() << std::endl;
+		sslogs << "\t  N blocks = " << BLOCKS_NUM << std::endl;
+
+	}
 
 	std::cout << sslogs.str() << std::endl;
 	sslogs.str( std::string() ); // clean up
 
-	// Close the file
-	input_file.close();
+	// Write an index of the buffers when we convert the whole file
+	unsigned long mbsevt = 0, nblock = 0;
+	if( start_subevt == 0 && end_subevt < 0 ) StartIndex( input_file_name );
+
+	// If we start part way through, jump to the nearest buffer in the index
+	else if( start_subevt > 0 ) {
 
-	// Create an MBS data instance and set block/buffer size etc
-	std::cout << "Opening file: " << input_file_name << std::endl;
-	MBS mbs;
-	mbs.SetBufferSize( set->GetBlockSize() );
-	mbs.OpenFile( input_file_name );
+		MiniballDataIndex input_index;
+		unsigned long entry;
+		if( input_index.Read( MiniballDataIndex::GetIndexName( input_file_name ) ) &&
+		    input_index.FindEvent( start_subevt, entry ) ) {
+
+			mbs.Seek( input_index.GetEntry( entry ).block, input_index.GetEntry( entry ).offset );
+			mbsevt = input_index.GetEntry( entry ).event;
+			RestoreIndexEntry( input_index.GetEntry( entry ) );
+
+		}
+
+	}
+
+	// Start the worker threads to prepare the events in parallel
+	if( nthreads > 1 ) StartWorkers();
 
 	// Loop over all the MBS Events.
-	unsigned long mbsevt = 0, nblock = 0;
-	for( mbsevt = 0; ; mbsevt++ ){
+	for( ; ; mbsevt++ ){
 		
 		// Calculate how many blocks we have used and progress
 		nblock = mbs.GetBufferCount();
 		if( nblock % 200 == 0 || nblock+1 == BLOCKS_NUM ) {
 			
-			// Percent complete
+			// Percent complete, from how much we've read if it's compressed
 			float percent = (float)(nblock+1)*100.0/(float)BLOCKS_NUM;
+			if( mbs.IsCompressed() ) percent = mbs.GetProgress();
 			
 			// Progress bar in GUI
 			if( _prog_ ){
@@ -534,23 +789,24 @@ int MiniballMbsConverter::ConvertFile( std::string input_file_name,
 		// Get the next event - returns nullptr at the end of the file
 		ev = mbs.GetNextEvent();
 		if( !ev ) break;
-		my_event_id = ev->GetEventID();
 
-		// Write the MBS event info
-		mbsinfo_packet->SetTime( my_good_tm_stp );
-		mbsinfo_packet->SetEventID( my_event_id );
-		mbsinfo_tree->Fill();
+		// Stop after the end sub event
+		if( (long)mbsevt > end_subevt && end_subevt >= 0 ) break;
 
-		// Check if we are before the start sub event or after the end sub events
-		if( mbsevt < start_subevt || ( (long)mbsevt > end_subevt && end_subevt > 0 ) )
-			continue;
-
-		// Process current block
-		ProcessBlock( mbsevt );
+		// Hand the event to the worker threads, or convert it now.
+		// Events before the start sub event only go in the MBS info
+		if( nthreads > 1 ) QueueEvent( mbsevt, mbsevt >= start_subevt );
+		else ConvertEvent( mbsevt, mbs.GetEventBuffer(), mbs.GetEventPosition(),
+						   mbsevt >= start_subevt );
 		
 	} // loop - mbsevt < MBS_EVENTS
+
+	// Finish the events that are still with the worker threads
+	if( nthreads > 1 ) StopWorkers();
 	
-	// Close the file
+	// Close the file and the index
+	FinishIndex();
+	PrintWaitTime( mbs.GetWaitTime() );
 	mbs.CloseFile();
 	
 	// Print stats
@@ -561,3 +817,190 @@ int MiniballMbsConverter::ConvertFile( std::string input_file_name,
 	return mbsevt;
 	
 }
+
+// Find the traces of an event with FindChannel, the same as ProcessFebexData,
+// then unpack them and do the MWD. Anything that looks wrong is left
+// for ProcessFebexData to complain about when the event is processed
+void MiniballMbsConverter::PrepareEvent( MiniballMbsBatch &batch, MiniballMbsEvent &evt ){
+
+	evt.first_trace = batch.ntraces;
+	evt.ntraces = 0;
+	if( !evt.process || evt.words.size() < 2 ) return;
+
+	// Data without the trigger and counter
+	const UInt_t *d = evt.words.data() + 2;
+	size_t n = evt.words.size() - 2;
+
+	// Skip the header
+	UInt_t pos = 10;
+	MiniballMbsChannel chan;
+	while( pos < n ) {
+
+		// Stop where ProcessFebexData would give up on the event
+		channel_status_t status = FindChannel( d, n, pos, chan );
+		if( status != CHANNEL_OK && status != CHANNEL_BAD_TRAILER ) return;
+
+		// Only the traces need doing, the special channel is read in order
+		if( chan.ch != 255 ) {
+
+			if( batch.ntraces == batch.traces.size() ) batch.traces.emplace_back();
+			MiniballMbsTrace &trace = batch.traces[batch.ntraces++];
+			evt.ntraces++;
+			trace.start = chan.first;
+			UnpackTrace( d + chan.first, chan.nwords, chan.trace_header, trace.samples );
+			FebexMWD mwd = cal->DoMWD( chan.sfp, chan.board, chan.ch, trace.samples );
+			trace.mwd_energy = mwd.GetEnergies();
+			trace.mwd_time = mwd.GetCfdTimes();
+
+		}
+
+		if( status == CHANNEL_BAD_TRAILER ) return;
+
+	}
+
+	return;
+
+}
+
+// Loop for the worker threads, taking the next batch until we're stopped
+void MiniballMbsConverter::PrepareWorker(){
+
+	while( true ) {
+
+		// Take the next batch once it has been filled
+		std::unique_lock<std::mutex> lock( prepared_mutex );
+		prepared_cv.wait( lock, [&]{
+			return stop_workers || next_prepare < next_fill;
+		} );
+		if( stop_workers ) return;
+		MiniballMbsBatch &batch = prepared[ next_prepare % prepared.size() ];
+		next_prepare++;
+		lock.unlock();
+
+		// Prepare the events
+		batch.ntraces = 0;
+		for( unsigned int i = 0; i < batch.nevents; ++i )
+			PrepareEvent( batch, batch.events[i] );
+
+		// Tell the output it's ready
+		lock.lock();
+		batch.ready = true;
+		lock.unlock();
+		prepared_cv.notify_all();
+
+	}
+
+}
+
+// Start the worker threads
+void MiniballMbsConverter::StartWorkers(){
+
+	// A few batches per thread in flight is enough to keep them all busy
+	prepared.resize( 4 * nthreads );
+	for( unsigned int i = 0; i < prepared.size(); ++i ) {
+		prepared[i].ready = false;
+		prepared[i].nevents = 0;
+		prepared[i].ntraces = 0;
+	}
+
+	next_fill = 0;
+	next_prepare = 0;
+	next_process = 0;
+	stop_workers = false;
+
+	for( unsigned int i = 0; i < nthreads; ++i )
+		workers.emplace_back( &MiniballMbsConverter::PrepareWorker, this );
+
+	return;
+
+}
+
+// Copy the current event in to the batch that is being filled. When the
+// batch is full it goes to the workers, and if that was the last free
+// one, we process the oldest batch to make space
+void MiniballMbsConverter::QueueEvent( unsigned long mbsevt, bool process ){
+
+	MiniballMbsBatch &batch = prepared[ next_fill % prepared.size() ];
+	if( batch.nevents == batch.events.size() ) batch.events.emplace_back();
+	MiniballMbsEvent &evt = batch.events[batch.nevents++];
+	evt.words.assign( ev->GetWords(), ev->GetWords() + ev->GetNWords() );
+	evt.eventid = ev->GetEventID();
+	evt.mbsevt = mbsevt;
+	evt.buffer = mbs.GetEventBuffer();
+	evt.position = mbs.GetEventPosition();
+	evt.process = process;
+
+	if( batch.nevents < BATCH_SIZE ) return;
+
+	// Give it to the workers
+	std::unique_lock<std::mutex> lock( prepared_mutex );
+	next_fill++;
+	lock.unlock();
+	prepared_cv.notify_all();
+
+	// Make sure the next one is free
+	if( next_fill >= next_process + prepared.size() ) ProcessBatch();
+
+	return;
+
+}
+
+// Wait for the oldest batch and process its events in order
+void MiniballMbsConverter::ProcessBatch(){
+
+	MiniballMbsBatch &batch = prepared[ next_process % prepared.size() ];
+	std::unique_lock<std::mutex> lock( prepared_mutex );
+	prepared_cv.wait( lock, [&]{ return batch.ready; } );
+	lock.unlock();
+
+	prepared_batch = &batch;
+	for( unsigned int i = 0; i < batch.nevents; ++i ) {
+
+		prepared_event = &batch.events[i];
+		prepared_trace = prepared_event->first_trace;
+		batch_evt.SetView( prepared_event->words.data(), prepared_event->words.size() );
+		batch_evt.SetEventID( prepared_event->eventid );
+		ev = &batch_evt;
+		ConvertEvent( prepared_event->mbsevt, prepared_event->buffer,
+					  prepared_event->position, prepared_event->process );
+
+	}
+	prepared_event = nullptr;
+	prepared_batch = nullptr;
+
+	// Give the batch back
+	batch.nevents = 0;
+	batch.ready = false;
+	next_process++;
+
+	return;
+
+}
+
+// Process everything that's left and stop the worker threads
+void MiniballMbsConverter::StopWorkers(){
+
+	// The last batch is probably not full
+	if( prepared[ next_fill % prepared.size() ].nevents ) {
+
+		std::unique_lock<std::mutex> lock( prepared_mutex );
+		next_fill++;
+		lock.unlock();
+		prepared_cv.notify_all();
+
+	}
+
+	while( next_process < next_fill ) ProcessBatch();
+
+	std::unique_lock<std::mutex> lock( prepared_mutex );
+	stop_workers = true;
+	lock.unlock();
+	prepared_cv.notify_all();
+
+	for( unsigned int i = 0; i < workers.size(); ++i )
+		workers[i].join();
+	workers.clear();
+
+	return;
+
+}
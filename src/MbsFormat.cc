@@ -2,11 +2,20 @@
 
 MBS::MBS() {
 	
-	fp = nullptr;
-	ptr = nullptr;
-	len = 0;
+	buf = nullptr;
+	fh = nullptr;
 	current = -1;
+	evt_buffer = 0;
+	evt_pos = 0;
 	bufsize = 0x8000; // default buffer size
+
+	socket_id = -1;
+	stream_queue_size = 0x10000;
+	stream_stop = false;
+	stream_end = false;
+	flag_stream_frag = false;
+	stream_last_buf = 0;
+	stream_lost = 0;
 	
 }
 
@@ -14,33 +23,27 @@ MBS::MBS() {
 void MBS::OpenFile( std::string _filename ){
 	
 	// Close file if already open
-	if(fp) CloseFile();
-	
-	// Open file
-	fp = fopen( _filename.data(), "rb");
-	if( !fp ) {
-		std::cerr << "Unable to open " << _filename << std::endl;
-		return;
-	}
-	
-	// Get length of file
-	fseek( fp, 0, SEEK_END );
-	len = ftell(fp);
-	
-	// Map into virtual memory
-	ptr = (const UChar_t *)mmap(nullptr, len, PROT_READ, MAP_SHARED, fileno(fp), 0);
-	if( ptr == MAP_FAILED ) {
+	if( input_file.IsOpen() ) CloseFile();
+	
+	// Open file and map into virtual memory, it is read ahead
+	// in the background while we work through the buffers.
+	// Compressed files are decompressed a whole number of buffers
+	// at a time, so that a buffer is always in one piece
+	input_file.SetBlockSize( bufsize );
+	if( !input_file.Open( _filename ) ) return;
+	const char *header = input_file.GetBlock( 0, sizeof(s_filhe) );
+	if( !header ) {
 		
-		std::cerr << __FUNCTION__ << ": Error mapping MBS file " << _filename << std::endl;
-		fclose(fp);
-		fp = nullptr;
-		ptr = nullptr;
+		std::cerr << __FUNCTION__ << ": Empty MBS file " << _filename << std::endl;
+		CloseFile();
 		return;
 		
 	}
 	
-	// File header
-	fh = (s_filhe *)ptr;
+	// File header, which we keep a copy of because the
+	// start of a compressed file is not kept for long
+	filhe = *(const s_filhe *)header;
+	fh = &filhe;
 	fh->Show();
 	
 	// Set to first buffer with real data (i.e. skipping file header)
@@ -54,82 +57,408 @@ void MBS::OpenFile( std::string _filename ){
 // Close the file
 void MBS::CloseFile() {
 	
-	if(!fp) return;
-	fclose(fp);
-	fp = nullptr;
+	if( !input_file.IsOpen() ) return;
+	input_file.Close();
+	buf = nullptr;
+	
+}
+
+// Map the part of the file that was written since we opened it
+bool MBS::Refresh() {
+	
+	if( !input_file.Refresh() ) return false;
+	const char *block = input_file.GetBlock( current_buffer * bufsize, bufsize );
+	if( block ) {
+		
+		buf = (const UChar_t *)block;
+		bh = (s_bufhe *)buf;
+		
+	}
+	
+	return true;
 	
 }
 
 // Open a stream
 int MBS::OpenEventServer( std::string _server, unsigned short _port ){
 	
+	// Close the old connection first
+	CloseEventServer();
+
 	// Get the server and port number
 	server = _server;
 	port = _port;
 	
+	// Look up the address of the server, which can be a name
+	struct addrinfo hints, *res;
+	memset( &hints, 0, sizeof(hints) );
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_STREAM;
+	if( getaddrinfo( server.data(), std::to_string( port ).data(), &hints, &res ) != 0 ) {
+		
+		std::cerr << "Invalid server address " << server << std::endl;
+		return -1;
+		
+	}
+	
 	// Create to the socket
-	struct sockaddr_in serv_addr;
-	if( !(socket_id = socket( AF_INET, SOCK_STREAM, 0 )) ){
+	if( ( socket_id = socket( res->ai_family, res->ai_socktype, res->ai_protocol ) ) < 0 ){
 		
 		std::cerr << "Socket creation failed" << std::endl;
+		freeaddrinfo( res );
 		return -1;
 		
 	}
 	
-	// Make the address of the server
-	serv_addr.sin_family = AF_INET;
-	serv_addr.sin_port = htons( port );
-	if( inet_pton( AF_INET, server.data(), &serv_addr.sin_addr ) <= 0 ) {
+	// Connect to the server
+	if( connect( socket_id, res->ai_addr, res->ai_addrlen ) < 0 ) {
 		
-		std::cerr << "Invalid server address " << server << std::endl;
+		std::cerr << "Failed to connect to " << server << ":" << port << std::endl;
+		freeaddrinfo( res );
+		close( socket_id );
+		socket_id = -1;
 		return -1;
 		
 	}
+	freeaddrinfo( res );
+
+	// We wait for data with poll, so the reads never block
+	fcntl( socket_id, F_SETFL, fcntl( socket_id, F_GETFL ) | O_NONBLOCK );
 	
-	// Connect to the server
-	if( (server_id = connect( socket_id, (struct sockaddr*)&serv_addr,
-							 sizeof(serv_addr) )) < 0 ) {
+	// The server tells us how big its buffers are and how many are in a stream
+	stream_stop = false;
+	stream_end = false;
+	if( !ReadStream( &tcpinfo, sizeof(tcpinfo) ) ) {
+		
+		std::cerr << "No stream information from " << server << std::endl;
+		close( socket_id );
+		socket_id = -1;
+		return -1;
 		
-		std::cerr << "Failed to connect to " << server << std::endl;
+	}
+	
+	// Data in the other byte order isn't supported, the same as for files
+	if( tcpinfo.l_testbit != 1 ) {
+		
+		std::cerr << "Event server " << server << " has the wrong byte order" << std::endl;
+		close( socket_id );
+		socket_id = -1;
 		return -1;
 		
 	}
 	
+	// Check that the buffer size makes sense
+	if( tcpinfo.l_bufsize <= sizeof(s_bufhe) || tcpinfo.l_bufsize > 0x4000000 ||
+	    tcpinfo.l_bufsize % 4 || tcpinfo.l_bufs == 0 ) {
+		
+		std::cerr << "Bad stream information from " << server << ": buffer size = ";
+		std::cerr << tcpinfo.l_bufsize << ", buffers = " << tcpinfo.l_bufs << std::endl;
+		close( socket_id );
+		socket_id = -1;
+		return -1;
+		
+	}
+	
+	std::cout << "Connected to MBS event server " << server << ":" << port;
+	std::cout << ", buffer size = " << tcpinfo.l_bufsize;
+	std::cout << ", buffers per stream = " << tcpinfo.l_bufs << std::endl;
+
+	// Receive buffer the size that the server uses
+	bufsize = tcpinfo.l_bufsize;
+	stream_buf.resize( bufsize );
+	
+	// Start with an empty queue and no partial events
+	stream_queue.clear();
+	stream_frag.Clear();
+	flag_stream_frag = false;
+	stream_last_buf = 0;
+	stream_lost = 0;
+	
+	// Thread to read the stream
+	stream_thread = std::thread( &MBS::StreamWorker, this );
+	
 	return 0;
 	
 }
 
 void MBS::CloseEventServer() {
 	
-	close(server_id);
+	if( socket_id < 0 ) return;
+	
+	// Stop the thread
+	{
+		std::lock_guard<std::mutex> lk( stream_mutex );
+		stream_stop = true;
+	}
+	stream_cv.notify_all();
+	if( stream_thread.joinable() ) stream_thread.join();
+
+	// Say goodbye to the server
+	if( !stream_end ) SendRequest( "CLOSE" );
+	close( socket_id );
+	socket_id = -1;
+
+	if( stream_lost )
+		std::cout << "Lost " << stream_lost << " split events from the event server" << std::endl;
+	
+}
+
+// Check if the server has gone and we've had all of its events
+bool MBS::IsStreamEnd() {
+	
+	std::lock_guard<std::mutex> lk( stream_mutex );
+	return( stream_end && stream_queue.empty() );
 	
 }
 
+// Read from the socket, using poll to wait for data so
+// that we can check every so often if we should stop
+bool MBS::ReadStream( void *dest, size_t n ) {
+	
+	char *p = (char *)dest;
+	struct pollfd pfd;
+	pfd.fd = socket_id;
+	pfd.events = POLLIN;
+	
+	while( n > 0 ) {
+		
+		if( stream_stop ) return false;
+		
+		// Wait up to 100 ms for some data
+		int ready = poll( &pfd, 1, 100 );
+		if( ready < 0 && errno != EINTR ) return false;
+		if( ready <= 0 ) continue;
+		
+		ssize_t got = recv( socket_id, p, n, 0 );
+		if( got == 0 ) return false; // the server closed the connection
+		if( got < 0 ) {
+			if( errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ) continue;
+			return false;
+		}
+		
+		p += got;
+		n -= got;
+		
+	}
+	
+	return true;
+	
+}
+
+// Requests are 12 bytes, padded with zeros
+bool MBS::SendRequest( const char *request ) {
+	
+	char msg[12] = {0};
+	strncpy( msg, request, sizeof(msg) - 1 );
+	
+	size_t sent = 0;
+	while( sent < sizeof(msg) ) {
+		
+		ssize_t n = send( socket_id, msg + sent, sizeof(msg) - sent, MSG_NOSIGNAL );
+		if( n < 0 ) {
+			
+			if( errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ) {
+				
+				struct pollfd pfd;
+				pfd.fd = socket_id;
+				pfd.events = POLLOUT;
+				poll( &pfd, 1, 100 );
+				if( stream_stop ) return false;
+				continue;
+				
+			}
+			return false;
+			
+		}
+		sent += n;
+		
+	}
+	
+	return true;
+	
+}
+
+// Read one whole buffer from the server
 const UChar_t* MBS::GetBufferFromStream(){
 	
-	// TODO: This is not correct, probably!!
-	read( socket_id, &ptr, bufsize );
+	if( !ReadStream( stream_buf.data(), bufsize ) ) return nullptr;
+	
+	return stream_buf.data();
+	
+}
+
+// Ask the server for a stream of buffers at a time, as long as there's
+// space in the queue. If the queue is full we don't ask, and the server
+// drops the data rather than holding up the DAQ
+void MBS::StreamWorker() {
+	
+	while( true ) {
+		
+		// Wait for some space in the queue
+		{
+			std::unique_lock<std::mutex> lk( stream_mutex );
+			stream_cv.wait( lk, [this]{
+				return stream_stop || stream_queue.size() < stream_queue_size;
+			});
+			if( stream_stop ) break;
+		}
+		
+		// Ask for the next stream and read all of its buffers
+		bool ok = SendRequest( "GETEVT" );
+		for( UInt_t i = 0; ok && i < tcpinfo.l_bufs; ++i ) {
+			
+			const UChar_t *b = GetBufferFromStream();
+			if( !b ) ok = false;
+			else UnpackStreamBuffer( b );
+			
+		}
+		
+		if( !ok ) break;
+		
+	}
+	
+	// Let the converter know that nothing else is coming
+	std::lock_guard<std::mutex> lk( stream_mutex );
+	stream_end = true;
+	stream_cv.notify_all();
+	
+}
+
+// Put a complete event in the queue, moving the data out of e
+void MBS::PushStreamEvent( MBSEvent &e ) {
 	
-	return ptr;
+	std::lock_guard<std::mutex> lk( stream_mutex );
+	stream_queue.emplace_back();
+	stream_queue.back().Swap( e );
+	e.Clear();
+	stream_cv.notify_all();
 	
 }
 
+// Same as GetNextEvent, but the events are copied from the stream buffer.
+// Events that are split over buffers are kept until the rest arrives
+void MBS::UnpackStreamBuffer( const UChar_t *b ) {
+	
+	const s_bufhe *sbh = (const s_bufhe *)b;
+	UInt_t end = sbh->i_used * 2 + sizeof(s_bufhe);
+	UInt_t p = sizeof(s_bufhe);
+	
+	// Empty buffers are sent when there's no data
+	if( sbh->i_used == 0 ) return;
+	if( end > bufsize ) {
+		
+		std::cerr << "Bad buffer " << sbh->l_buf << " from the event server" << std::endl;
+		if( flag_stream_frag ) stream_lost++;
+		flag_stream_frag = false;
+		stream_frag.Clear();
+		return;
+		
+	}
+
+	// If a buffer was missed, we lose the start of a split event
+	bool missed = sbh->l_buf != stream_last_buf + 1;
+	stream_last_buf = sbh->l_buf;
+	if( flag_stream_frag && missed ) {
+		
+		stream_lost++;
+		flag_stream_frag = false;
+		stream_frag.Clear();
+		
+	}
+	
+	// Rest of an event that started in an earlier buffer
+	if( flag_stream_frag ) {
+		
+		const UInt_t *val32 = (const UInt_t *)( b + p );
+		UInt_t elen = val32[0];
+		if( p + 8 + elen * 2 > end ) elen = 0;
+		
+		// Subevent header was in this buffer
+		if( stream_frag_slen == 0 && elen >= 2 ) stream_frag_slen = val32[2];
+		
+		stream_frag.Store( val32 + 2, elen / 2 );
+		p += elen * 2 + 8;
+		
+		if( stream_frag.GetNData() >= stream_frag_slen / 2 + 2 ) {
+			
+			PushStreamEvent( stream_frag );
+			flag_stream_frag = false;
+			
+		}
+		
+	}
+	
+	// Start of this buffer is the end of an event that we don't have
+	else if( sbh->h_end ) {
+		
+		const UInt_t *val32 = (const UInt_t *)( b + p );
+		p += val32[0] * 2 + 8;
+		
+	}
+	
+	// Events that start in this buffer
+	while( p + 8 <= end && !flag_stream_frag ) {
+		
+		const UInt_t *val32 = (const UInt_t *)( b + p );
+		UInt_t elen = val32[0]; // l_dlen of event header
+		
+		stream_frag.Clear();
+		stream_frag.SetEventID( val32[3] ); // l_count of event header
+		
+		// Subevent header is in the next buffer
+		if( elen <= 4 ) {
+			
+			stream_frag.Store( val32 + 2, 2 );
+			stream_frag_slen = 0;
+			flag_stream_frag = true;
+			break;
+			
+		}
+		
+		// Don't go past the end of the buffer
+		if( p + 8 + elen * 2 > end ) break;
+		
+		stream_frag_slen = val32[4]; // l_dlen of subevent header
+		stream_frag.Store( val32 + 2, elen / 2 );
+		p += elen * 2 + 8;
+		
+		// Whole event is here, otherwise the rest is in the next buffer
+		if( stream_frag.GetNData() >= stream_frag_slen / 2 + 2 )
+			PushStreamEvent( stream_frag );
+		else flag_stream_frag = true;
+		
+	}
+	
+	return;
+	
+}
 
 // Get the next event
 const MBSEvent* MBS::GetNextEvent() {
 	
 	// Return nullptr if we've reached the end of the file
-	if( pos + bufsize >= len ) return(nullptr);
+	if( !input_file.IsAvailable( (unsigned long long)pos + bufsize + 1 ) ) return(nullptr);
+	
+	// Remember where we started, in case the event isn't all there yet
+	UInt_t start_buffer = current_buffer;
+	UInt_t start_pos = pos;
+
+	// Nothing before this is needed again, the last event is finished with
+	input_file.Release( (unsigned long long)start_buffer * bufsize );
 	
 	// Check if we need another buffer
 	if( pos >= current_buffer * bufsize + used )
-		if( !GetNextBuffer() ) return(nullptr);
+		if( !GetNextBuffer() ) return( Rewind( start_buffer, start_pos ) );
+	
+	// This is where the event really starts
+	evt_buffer = current_buffer;
+	evt_pos = pos;
 	
 	// Clear old data
 	evt.Clear();
 	
 	// Event header (16 bytes)
-	UInt_t *val32 = (UInt_t *)(ptr + pos);
+	const UInt_t *val32 = GetCurrentData();
 	UInt_t elen = val32[0]; // l_dlen of event header
 	evt.SetEventID( val32[3] ); // l_count of event header
 	//eh = (s_vehe *)(ptr + pos);
@@ -141,16 +470,26 @@ const MBSEvent* MBS::GetNextEvent() {
 	//sh = (s_evhe *)(ptr + pos);
 	//UInt_t slen = sh->l_dlen;
 	
+	// Most of the time the whole event is in this buffer,
+	// so we can use it from where it is without copying it
+	if( elen > 4 && elen / 2 >= slen / 2 + 4 ) {
+		
+		evt.SetView( val32 + 2, elen / 2 );
+		pos += elen * 2; // Advance past this data
+		
+		return(&evt);
+		
+	}
+	
 	// Handle the special case, where the subevent header is in the
 	// next buffer
 	if( elen <= 4 ) {
 		
-		for( UInt_t i = 2; i < 4; i++ )
-			evt.Store(val32[i]);
+		evt.Store( val32 + 2, 2 );
 		
 		// Next buffer
-		if( !GetNextBuffer() ) return(nullptr);
-		val32 = (UInt_t *)(ptr + pos);
+		if( !GetNextBuffer() ) return( Rewind( start_buffer, start_pos ) );
+		val32 = GetCurrentData();
 		elen = val32[0];
 		slen = val32[2];
 		pos += 8;
@@ -159,19 +498,17 @@ const MBSEvent* MBS::GetNextEvent() {
 	
 	
 	// Copy payload of event (without event header)
-	for( UInt_t i = 2; i < elen / 2 + 2; i++ )
-		evt.Store(val32[i]);
+	evt.Store( val32 + 2, elen / 2 );
 	pos += elen * 2; // Advance past this data
 	
 	// Check if there's more data in the next buffer
 	while( evt.GetNData() < slen / 2 + 2 ) { // Yes, there's more data
 		
 		// Next buffer
-		if( !GetNextBuffer() ) return(nullptr);
-		val32 = (UInt_t *)(ptr + pos);
+		if( !GetNextBuffer() ) return( Rewind( start_buffer, start_pos ) );
+		val32 = GetCurrentData();
 		elen = val32[0];
-		for( UInt_t i = 2; i < elen / 2 + 2; i++ )
-			evt.Store(val32[i]);
+		evt.Store( val32 + 2, elen / 2 );
 		pos += elen * 2 + 8; // Advance past this data
 		
 	}
@@ -180,16 +517,45 @@ const MBSEvent* MBS::GetNextEvent() {
 	
 };
 
-// Get the next event
-const MBSEvent* MBS::GetNextEventFromStream() {
-
-	// Clear old data
-	evt.Clear();
+// Go back to where we were before an incomplete event, so that
+// we can read it again when the rest of it has been written
+const MBSEvent* MBS::Rewind( UInt_t buffer, UInt_t position ) {
+	
+	Seek( buffer, position );
+	
+	return(nullptr);
+	
+}
 
-	// Need to do stuff here
+// Go to a position inside a buffer
+void MBS::Seek( UInt_t buffer, UInt_t position ) {
 	
-	return(&evt);
+	// A compressed file can skip everything before here
+	input_file.Release( (unsigned long long)buffer * bufsize );
+	GetBuffer( buffer );
+	pos = position;
+	
+}
 
+// Get the next event from the queue of events from the stream
+const MBSEvent* MBS::GetNextEventFromStream( int timeout ) {
+
+	std::unique_lock<std::mutex> lk( stream_mutex );
+	if( stream_queue.empty() && timeout > 0 ) {
+		
+		stream_cv.wait_for( lk, std::chrono::milliseconds( timeout ), [this]{
+			return !stream_queue.empty() || stream_end;
+		});
+		
+	}
+	if( stream_queue.empty() ) return(nullptr);
+
+	// Take the event and let the thread know there's space
+	evt.Swap( stream_queue.front() );
+	stream_queue.pop_front();
+	stream_cv.notify_all();
+
+	return(&evt);
 	
 }
 
@@ -198,12 +564,16 @@ const UChar_t* MBS::GetBuffer( UInt_t i ) {
 	
 	current_buffer = i;
 	pos = current_buffer * bufsize;
-	if( pos + bufsize > len ) return(nullptr);
 	
-	bh = (s_bufhe *)(ptr + pos);
+	// Make sure the read ahead or the decompression has got this far
+	const char *block = input_file.GetBlock( pos, bufsize );
+	if( !block ) return(nullptr);
+	
+	buf = (const UChar_t *)block;
+	bh = (s_bufhe *)buf;
 	used = bh->i_used * 2 + sizeof(s_bufhe);
 	pos += sizeof(s_bufhe);
 	
-	return( ptr + pos - sizeof(s_bufhe) );
+	return( buf );
 	
 };
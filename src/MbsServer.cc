@@ -0,0 +1,211 @@
+#include "MbsServer.hh"
+
+MBSReplayServer::MBSReplayServer() {
+
+	listen_id = -1;
+	client_id = -1;
+	bufsize = 0x8000; // default buffer size
+	bufs_per_stream = 4;
+	current_file = 0;
+	current_buffer = 1;
+	nsent = 0;
+
+}
+
+// Make a socket to listen for clients, only from this machine
+bool MBSReplayServer::Listen( unsigned short port ) {
+
+	Close();
+
+	if( ( listen_id = socket( AF_INET, SOCK_STREAM, 0 ) ) < 0 ) {
+
+		std::cerr << "Socket creation failed" << std::endl;
+		return false;
+
+	}
+
+	int on = 1;
+	setsockopt( listen_id, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on) );
+
+	struct sockaddr_in addr;
+	memset( &addr, 0, sizeof(addr) );
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons( port );
+	addr.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+
+	if( bind( listen_id, (struct sockaddr*)&addr, sizeof(addr) ) < 0 ||
+	    listen( listen_id, 1 ) < 0 ) {
+
+		std::cerr << "Cannot listen on port " << port << ": " << strerror( errno ) << std::endl;
+		Close();
+		return false;
+
+	}
+
+	std::cout << "MBS replay server listening on port " << port << std::endl;
+
+	return true;
+
+}
+
+void MBSReplayServer::Close() {
+
+	if( client_id >= 0 ) close( client_id );
+	if( listen_id >= 0 ) close( listen_id );
+	client_id = -1;
+	listen_id = -1;
+	input_file.Close();
+
+}
+
+// Send all of it, unless the client goes away
+bool MBSReplayServer::Send( const void *src, size_t n ) {
+
+	const char *p = (const char *)src;
+	while( n > 0 ) {
+
+		ssize_t sent = send( client_id, p, n, MSG_NOSIGNAL );
+		if( sent < 0 && errno == EINTR ) continue;
+		if( sent <= 0 ) return false;
+		p += sent;
+		n -= sent;
+
+	}
+
+	return true;
+
+}
+
+// Requests are 12 bytes, padded with zeros
+bool MBSReplayServer::GetRequest( std::string &request ) {
+
+	char msg[12];
+	size_t got = 0;
+	while( got < sizeof(msg) ) {
+
+		ssize_t n = recv( client_id, msg + got, sizeof(msg) - got, 0 );
+		if( n < 0 && errno == EINTR ) continue;
+		if( n <= 0 ) return false;
+		got += n;
+
+	}
+
+	request = std::string( msg, strnlen( msg, sizeof(msg) ) );
+
+	return true;
+
+}
+
+// Send the next buffers of the files, moving on to the next file
+// at the end of each one. The first buffer of a file is its header
+bool MBSReplayServer::SendStream() {
+
+	for( unsigned int i = 0; i < bufs_per_stream; ++i ) {
+
+		const char *block = nullptr;
+		while( !block && current_file < files.size() ) {
+
+			// Open the next file
+			if( !input_file.IsOpen() ) {
+
+				std::cout << "Replaying " << files[current_file] << std::endl;
+				input_file.SetBlockSize( bufsize );
+				if( !input_file.Open( files[current_file] ) ) {
+
+					current_file++;
+					continue;
+
+				}
+				current_buffer = 1;
+
+			}
+
+			if( input_file.IsAvailable( ( current_buffer + 1 ) * bufsize ) )
+				block = input_file.GetBlock( current_buffer * bufsize, bufsize );
+
+			// End of this file
+			if( !block ) {
+
+				input_file.Close();
+				current_file++;
+
+			}
+
+		}
+
+		// Nothing left, so send an empty buffer
+		if( !block ) block = (const char *)empty_buf.data();
+		else {
+
+			input_file.Release( current_buffer * bufsize );
+			current_buffer++;
+			nsent++;
+
+		}
+
+		if( !Send( block, bufsize ) ) return false;
+
+	}
+
+	return true;
+
+}
+
+long MBSReplayServer::Serve( std::vector<std::string> filenames ) {
+
+	if( listen_id < 0 ) return -1;
+
+	files = filenames;
+	current_file = 0;
+	nsent = 0;
+	empty_buf.assign( bufsize, 0 );
+
+	// Wait for a client
+	std::cout << "Waiting for a client..." << std::endl;
+	if( ( client_id = accept( listen_id, nullptr, nullptr ) ) < 0 ) {
+
+		std::cerr << "Failed to accept a client: " << strerror( errno ) << std::endl;
+		return -1;
+
+	}
+
+	// Tell the client about our buffers
+	s_tcpinfo info;
+	info.l_testbit = 1;
+	info.l_bufsize = bufsize;
+	info.l_bufs = bufs_per_stream;
+	info.l_streams = 1;
+	if( !Send( &info, sizeof(info) ) ) {
+
+		close( client_id );
+		client_id = -1;
+		return -1;
+
+	}
+
+	// Send a stream each time we are asked, until there's no more data
+	std::string request;
+	while( GetRequest( request ) ) {
+
+		if( request == "CLOSE" ) break;
+		if( request != "GETEVT" ) {
+
+			std::cerr << "Unknown request from the client: " << request << std::endl;
+			continue;
+
+		}
+
+		if( !SendStream() ) break;
+		if( current_file >= files.size() ) break;
+
+	}
+
+	std::cout << "Sent " << nsent << " buffers" << std::endl;
+
+	close( client_id );
+	client_id = -1;
+	input_file.Close();
+
+	return nsent;
+
+}
@@ -1,12 +1,18 @@
 #include "MidasConverter.hh"
 
+// Vector instructions for swapping whole blocks, chosen at run time
+#if defined(__x86_64__) || defined(__i386__)
+# include <immintrin.h>
+# define MIDAS_SIMD_SWAP
+#endif
+
 
 // Function to copy the header from a DataSpy, for example
-void MiniballMidasConverter::SetBlockHeader( char *input_header ){
+void MiniballMidasConverter::SetBlockHeader( const char *input_header ){
 	
 	// Copy header
-	for( unsigned int i = 0; i < HEADER_SIZE; i++ )
-		block_header[i] = input_header[i];
+	std::memcpy( block_header, input_header, HEADER_SIZE );
+	header = block_header;
 
 	return;
 	
@@ -30,23 +36,23 @@ void MiniballMidasConverter::ProcessBlockHeader( unsigned long nblock ){
 
 	// Process header.
 	for( UInt_t i = 0; i < 8; i++ )
-		header_id[i] = block_header[i];
+		header_id[i] = header[i];
 	
 	header_sequence =
-	(block_header[8] & 0xFF) << 24 | (block_header[9]& 0xFF) << 16 |
-	(block_header[10]& 0xFF) << 8  | (block_header[11]& 0xFF);
+	(header[8] & 0xFF) << 24 | (header[9]& 0xFF) << 16 |
+	(header[10]& 0xFF) << 8  | (header[11]& 0xFF);
 	
-	header_stream = (block_header[12] & 0xFF) << 8 | (block_header[13]& 0xFF);
+	header_stream = (header[12] & 0xFF) << 8 | (header[13]& 0xFF);
 	
-	header_tape = (block_header[14] & 0xFF) << 8 | (block_header[15]& 0xFF);
+	header_tape = (header[14] & 0xFF) << 8 | (header[15]& 0xFF);
 	
-	header_MyEndian = (block_header[16] & 0xFF) << 8 | (block_header[17]& 0xFF);
+	header_MyEndian = (header[16] & 0xFF) << 8 | (header[17]& 0xFF);
 	
-	header_DataEndian = (block_header[18] & 0xFF) << 8 | (block_header[19]& 0xFF);
+	header_DataEndian = (header[18] & 0xFF) << 8 | (header[19]& 0xFF);
 	
 	header_DataLen =
-	(block_header[20] & 0xFF) | (block_header[21]& 0xFF) << 8 |
-	(block_header[22] & 0xFF) << 16  | (block_header[23]& 0xFF) << 24 ;
+	(header[20] & 0xFF) | (header[21]& 0xFF) << 8 |
+	(header[22] & 0xFF) << 16  | (header[23]& 0xFF) << 24 ;
 	
 	if( std::string(header_id).substr(0,8) != "EBYEDATA" ) {
 	
@@ -61,11 +67,11 @@ void MiniballMidasConverter::ProcessBlockHeader( unsigned long nblock ){
 
 
 // Function to copy the main data from a DataSpy, for example
-void MiniballMidasConverter::SetBlockData( char *input_data ){
+void MiniballMidasConverter::SetBlockData( const char *input_data ){
 	
-	// Copy header
-	for( UInt_t i = 0; i < MAIN_SIZE; i++ )
-		block_data[i] = input_data[i];
+	// Copy data
+	std::memcpy( block_data, input_data, MAIN_SIZE );
+	data = block_data;
 
 	return;
 	
@@ -79,30 +85,25 @@ void MiniballMidasConverter::ProcessBlockData( unsigned long nblock ){
 	// Data format here: http://npg.dl.ac.uk/documents/edoc504/edoc504.html
 	// Unpack in to two 32-bit words for purposes of data format
 		
-	// Swap mode is unknown for the first block of data, so let's work it out
-	if( (swap & SWAP_KNOWN) == 0 ) {
-
-		// See if we can figure out the swapping - the DataEndian word of the
-		// header is 256 if the endianness is correct, otherwise swap endianness
-		if( header_DataEndian != 256 ) swap |= SWAP_ENDIAN;
-		
-		// However, that is not all, the words may also be swapped, so check
-		// for that. Bits 31:30 should always be zero in the timestamp word
-		for( UInt_t i = 0; i < WORD_SIZE; i++ ) {
-			ULong64_t word = (swap & SWAP_ENDIAN) ? Swap64(data[i]) : data[i];
-			if( word & 0xC000000000000000LL ) {
-				swap |= SWAP_KNOWN;
-				break;
-			}
-			if( word & 0x00000000C0000000LL ) {
-				swap |= SWAP_KNOWN;
-				swap |= SWAP_WORDS;
-				break;
-			}
-		}
-		
+	// Blocks prepared by a worker thread are already in the right order
+	if( prepared_block ) {
+
+		data = prepared_block->words;
+		swap = SWAP_KNOWN;
+		prepared_trace = 0;
+
 	}
 
+	// Otherwise use the swap mode of the file, if we know it
+	else if( file_swap & SWAP_KNOWN ) swap = file_swap;
+
+	// Swap mode is unknown for the first block of data, so let's work it out
+	if( (swap & SWAP_KNOWN) == 0 )
+		swap |= FindSwapMode( data, header_DataEndian );
+
+	// Swap the whole block in one go, so we don't have to do it word by word
+	data = SwapBlockData( data, block_data, swap );
+
 	
 	// Process all words
 	for( UInt_t i = 0; i < WORD_SIZE; i++ ) {
@@ -170,6 +171,159 @@ void MiniballMidasConverter::ProcessBlockData( unsigned long nblock ){
 
 }
 
+// Function to work out the swap mode of a block of data words
+Int_t MiniballMidasConverter::FindSwapMode( const ULong64_t *words, UShort_t data_endian ){
+
+	Int_t mode = 0;
+
+	// See if we can figure out the swapping - the DataEndian word of the
+	// header is 256 if the endianness is correct, otherwise swap endianness
+	if( data_endian != 256 ) mode |= SWAP_ENDIAN;
+	
+	// However, that is not all, the words may also be swapped, so check
+	// for that. Bits 31:30 should always be zero in the timestamp word
+	for( UInt_t i = 0; i < WORD_SIZE; i++ ) {
+		ULong64_t word = (mode & SWAP_ENDIAN) ? Swap64(words[i]) : words[i];
+		if( word & 0xC000000000000000LL ) {
+			mode |= SWAP_KNOWN;
+			break;
+		}
+		if( word & 0x00000000C0000000LL ) {
+			mode |= SWAP_KNOWN;
+			mode |= SWAP_WORDS;
+			break;
+		}
+	}
+
+	return mode;
+
+}
+
+// Function to work out the swap mode of a block straight from the file
+Int_t MiniballMidasConverter::FindSwapMode( const char *input_block ){
+
+	if( !input_block ) return 0;
+
+	// We only need the endianness from the header
+	UShort_t data_endian = (input_block[18] & 0xFF) << 8 | (input_block[19]& 0xFF);
+	return FindSwapMode( (const ULong64_t *)( input_block + HEADER_SIZE ), data_endian );
+
+}
+
+#ifdef MIDAS_SIMD_SWAP
+// Which vector instructions can we use? 2 = AVX2, 1 = SSSE3, 0 = none
+static int SwapVectorLevel(){
+
+	// Worked out once, the first time it's needed
+	static const int level = __builtin_cpu_supports("avx2") ? 2 :
+							 __builtin_cpu_supports("ssse3") ? 1 : 0;
+
+	return level;
+
+}
+
+// Shuffle the bytes of each 64-bit word with AVX2, four words at a time.
+// Returns the number of words done, the rest are left for the caller
+__attribute__((target("avx2")))
+static UInt_t SwapVectorAVX2( const ULong64_t *in, ULong64_t *out, UInt_t n, const char *order ){
+
+	char shuffle[32];
+	for( unsigned int j = 0; j < 32; ++j )
+		shuffle[j] = ( j & 0x8 ) + order[j&7];
+	__m256i mask = _mm256_loadu_si256( (const __m256i*)shuffle );
+
+	UInt_t i = 0;
+	for( ; i + 4 <= n; i += 4 ) {
+		__m256i w = _mm256_loadu_si256( (const __m256i*)( in + i ) );
+		_mm256_storeu_si256( (__m256i*)( out + i ), _mm256_shuffle_epi8( w, mask ) );
+	}
+
+	return i;
+
+}
+
+// Shuffle the bytes of each 64-bit word with SSSE3, two words at a time
+__attribute__((target("ssse3")))
+static UInt_t SwapVectorSSSE3( const ULong64_t *in, ULong64_t *out, UInt_t n, const char *order ){
+
+	char shuffle[16];
+	for( unsigned int j = 0; j < 16; ++j )
+		shuffle[j] = ( j & 0x8 ) + order[j&7];
+	__m128i mask = _mm_loadu_si128( (const __m128i*)shuffle );
+
+	UInt_t i = 0;
+	for( ; i + 2 <= n; i += 2 ) {
+		__m128i w = _mm_loadu_si128( (const __m128i*)( in + i ) );
+		_mm_storeu_si128( (__m128i*)( out + i ), _mm_shuffle_epi8( w, mask ) );
+	}
+
+	return i;
+
+}
+#endif
+
+// Swap a block of words with the swap mode known at compile time, so that
+// there are no decisions to make for each word. The vector instructions
+// do most of the work if we have them and the scalar loop does the rest
+template<Int_t mode>
+void MiniballMidasConverter::SwapBlock( const ULong64_t *in, ULong64_t *out, UInt_t n ){
+
+	UInt_t i = 0;
+
+#ifdef MIDAS_SIMD_SWAP
+	// Order of the bytes in each 64-bit word after swapping
+	static const char order[8] = {
+		(mode & SWAP_ENDIAN) ? ( (mode & SWAP_WORDS) ? 3 : 7 ) : 4,
+		(mode & SWAP_ENDIAN) ? ( (mode & SWAP_WORDS) ? 2 : 6 ) : 5,
+		(mode & SWAP_ENDIAN) ? ( (mode & SWAP_WORDS) ? 1 : 5 ) : 6,
+		(mode & SWAP_ENDIAN) ? ( (mode & SWAP_WORDS) ? 0 : 4 ) : 7,
+		(mode & SWAP_ENDIAN) ? ( (mode & SWAP_WORDS) ? 7 : 3 ) : 0,
+		(mode & SWAP_ENDIAN) ? ( (mode & SWAP_WORDS) ? 6 : 2 ) : 1,
+		(mode & SWAP_ENDIAN) ? ( (mode & SWAP_WORDS) ? 5 : 1 ) : 2,
+		(mode & SWAP_ENDIAN) ? ( (mode & SWAP_WORDS) ? 4 : 0 ) : 3
+	};
+
+	int level = SwapVectorLevel();
+	if( level == 2 ) i = SwapVectorAVX2( in, out, n, order );
+	else if( level == 1 ) i = SwapVectorSSSE3( in, out, n, order );
+#endif
+
+	for( ; i < n; ++i ) {
+
+		ULong64_t result = in[i];
+		if( mode & SWAP_ENDIAN ) result = Swap64(result);
+		if( mode & SWAP_WORDS )  result = SwapWords(result);
+		out[i] = result;
+
+	}
+
+}
+
+// Function to put all words of a block in to the right order
+const ULong64_t* MiniballMidasConverter::SwapBlockData( const ULong64_t *in, ULong64_t *out, Int_t mode ){
+
+	switch( mode & ( SWAP_ENDIAN | SWAP_WORDS ) ) {
+
+		case SWAP_ENDIAN:
+			SwapBlock<SWAP_ENDIAN>( in, out, WORD_SIZE );
+			return out;
+
+		case SWAP_WORDS:
+			SwapBlock<SWAP_WORDS>( in, out, WORD_SIZE );
+			return out;
+
+		case SWAP_ENDIAN | SWAP_WORDS:
+			SwapBlock<SWAP_ENDIAN | SWAP_WORDS>( in, out, WORD_SIZE );
+			return out;
+
+		// Nothing to do, the words are fine as they are
+		default:
+			return in;
+
+	}
+
+}
+
 bool MiniballMidasConverter::GetFebexChanID(){
 	
 	// ADCchannelIdent are bits 27:16 of word_0
@@ -221,40 +375,44 @@ int MiniballMidasConverter::ProcessTraceData( int pos ){
 	// sample length
 	nsamples = word_0 & 0xFFFF; // 16 bits from 0
 	
-	// Get the samples from the trace
-	for( UInt_t j = 0; j < nsamples; j++ ){
-		
-		// get next word
-		ULong64_t sample_packet = GetWord(pos++);
-		
-		UInt_t block_test = ( sample_packet >> 32 ) & 0x00000000FFFFFFFF;
-		unsigned char trace_test = ( sample_packet >> 62 ) & 0x0000000000000003;
-		
-		if( trace_test == 0 && block_test != 0x5E5E5E5E ){
-			
-			febex_data->AddSample( ( sample_packet >> 48 ) & 0x0000000000003FFF );
-			febex_data->AddSample( ( sample_packet >> 32 ) & 0x0000000000003FFF );
-			febex_data->AddSample( ( sample_packet >> 16 ) & 0x0000000000003FFF );
-			febex_data->AddSample( sample_packet & 0x0000000000003FFF );
-			
-		}
-		
-		else {
-			
-			//std::cout << "This isn't a trace anymore..." << std::endl;
-			//std::cout << "Sample #" << j << " of " << nsamples << std::endl;
-			//std::cout << " trace_test = " << (int)trace_test << std::endl;
+	// Get the samples from the trace and do the MWD, unless
+	// it was all done already on a worker thread
+	std::vector<float> mwd_energy;
+	if( prepared_block ) {
+
+		// Traces are prepared in the same order that we meet them
+		while( prepared_trace < prepared_block->ntraces &&
+			   prepared_block->traces[prepared_trace].start < (UInt_t)pos )
+			prepared_trace++;
+
+		if( prepared_trace < prepared_block->ntraces &&
+		    prepared_block->traces[prepared_trace].start == (UInt_t)pos ) {
+
+			MiniballMidasTrace &trace = prepared_block->traces[prepared_trace++];
+			if( KeepTrace( my_sfp_id, my_board_id, my_ch_id ) )
+				febex_data->SwapTrace( trace.samples );
+			mwd_energy.swap( trace.mwd_energy );
+			pos = trace.end;
 
-			pos--;
-			break;
-			
 		}
 
 	}
-	
-	FebexMWD mwd = cal->DoMWD( my_sfp_id, my_board_id, my_ch_id, febex_data->GetTrace() );
-	for( unsigned int i = 0; i < mwd.NumberOfTriggers(); ++i )
-		hfebex_mwd[my_sfp_id][my_board_id][my_ch_id]->Fill( mwd.GetEnergy(i) );
+
+	else {
+
+		pos = UnpackTrace( data, pos, nsamples, trace_samples );
+		FebexMWD mwd = cal->DoMWD( my_sfp_id, my_board_id, my_ch_id, trace_samples );
+		mwd_energy = mwd.GetEnergies();
+
+		// Hand the samples over if we're writing them out,
+		// we get the old space back for the next trace
+		if( KeepTrace( my_sfp_id, my_board_id, my_ch_id ) )
+			febex_data->SwapTrace( trace_samples );
+
+	}
+
+	for( unsigned int i = 0; i < mwd_energy.size(); ++i )
+		hfebex_mwd[my_sfp_id][my_board_id][my_ch_id]->Fill( mwd_energy[i] );
 
 	
 	flag_febex_trace = true;
@@ -263,6 +421,37 @@ int MiniballMidasConverter::ProcessTraceData( int pos ){
 
 }
 
+// Unpack a trace from the words after its header at pos and return the
+// position of the last word of the trace, so the caller carries on after it.
+// The samples buffer is only resized, so it keeps its space between traces
+int MiniballMidasConverter::UnpackTrace( const ULong64_t *words, int pos,
+										 UInt_t ns, std::vector<unsigned short> &samples ){
+
+	// First find how many words are still part of the trace,
+	// the samples start on the word after the header
+	UInt_t first = pos + 1;
+	UInt_t nwords = 0;
+	while( nwords < ns && first + nwords < WORD_SIZE ) {
+		
+		ULong64_t sample_packet = words[first+nwords];
+		
+		UInt_t block_test = ( sample_packet >> 32 ) & 0x00000000FFFFFFFF;
+		unsigned char trace_test = ( sample_packet >> 62 ) & 0x0000000000000003;
+		
+		// This isn't a trace anymore...
+		if( trace_test != 0 || block_test == 0x5E5E5E5E ) break;
+		nwords++;
+
+	}
+
+	// Then unpack them all in one go
+	samples.resize( 4 * nwords );
+	UnpackSamples64( words + first, nwords, samples.data() );
+
+	return pos + nwords;
+
+}
+
 void MiniballMidasConverter::ProcessFebexData(){
 
 	// Febex data format
@@ -406,10 +595,10 @@ void MiniballMidasConverter::FinishFebexData(){
 		my_adc_data_int = ( my_adc_data_hsb << 16 ) | ( my_adc_data_lsb & 0xFFFF );
 		
 		// Check if this is actually just a timestamp or info like event
+		const MiniballChannel &chan = set->GetChannel( febex_data->GetSfp(),
+													   febex_data->GetBoard(), febex_data->GetChannel() );
 		flag_febex_info = false;
-		if( febex_data->GetSfp()     == set->GetPulserSfp()     &&
-		    febex_data->GetBoard()   == set->GetPulserBoard()   &&
-		    febex_data->GetChannel() == set->GetPulserChannel() ){
+		if( chan.flags & MiniballSettings::CHANNEL_PULSER ){
 			
 			flag_febex_info = true;
 			my_info_code = 20; // Pulser is always 20 (defined here)
@@ -418,18 +607,14 @@ void MiniballMidasConverter::FinishFebexData(){
 
 		}
 		
-		else if( febex_data->GetSfp()     == set->GetEBISSfp()     &&
-				 febex_data->GetBoard()   == set->GetEBISBoard()   &&
-				 febex_data->GetChannel() == set->GetEBISChannel() ){
+		else if( chan.flags & MiniballSettings::CHANNEL_EBIS ){
 			
 			flag_febex_info = true;
 			my_info_code = 21; // EBIS is always 21 (defined here)
 			
 		}
 		
-		else if( febex_data->GetSfp()     == set->GetT1Sfp()     &&
-				 febex_data->GetBoard()   == set->GetT1Board()   &&
-				 febex_data->GetChannel() == set->GetT1Channel() ){
+		else if( chan.flags & MiniballSettings::CHANNEL_T1 ){
 			
 			flag_febex_info = true;
 			my_info_code = 22; // T1 is always 22 (defined here)
@@ -443,8 +628,7 @@ void MiniballMidasConverter::FinishFebexData(){
 			info_data->SetSfp( febex_data->GetSfp() );
 			info_data->SetBoard( febex_data->GetBoard() );
 			info_data->SetCode( my_info_code );
-			data_packet->SetData( info_data );
-			output_tree->Fill();
+			hits.AddInfo( info_data );
 	
 		}
 
@@ -455,8 +639,7 @@ void MiniballMidasConverter::FinishFebexData(){
 			// Also add the time offset when we do this
 			febex_data->SetTime( time_corr );
 			febex_data->SetQint( my_adc_data_int );
-			data_packet->SetData( febex_data );
-			output_tree->Fill();
+			hits.AddFebex( febex_data );
 
 			// Fill histograms
 			my_energy = cal->FebexEnergy( febex_data->GetSfp(), febex_data->GetBoard(), febex_data->GetChannel(), febex_data->GetQint() );
@@ -489,6 +672,7 @@ void MiniballMidasConverter::FinishFebexData(){
 
 	// Count the hit, even if it's bad
 	ctr_febex_hit[febex_data->GetSfp()][febex_data->GetBoard()]++;
+	IndexHit( febex_data->GetSfp(), febex_data->GetTime() );
 	
 	// Assuming it did finish, in a good way or bad, clean up.
 	flag_febex_data0 = false;
@@ -557,9 +741,9 @@ void MiniballMidasConverter::ProcessInfoData(){
 		info_data->SetBoard( my_board_id );
 		info_data->SetTime( my_tm_stp );
 		info_data->SetCode( my_info_code );
-		data_packet->SetData( info_data );
-		output_tree->Fill();
+		hits.AddInfo( info_data );
 		info_data->Clear();
+		IndexTime( my_tm_stp );
 
 	//}
 
@@ -574,7 +758,6 @@ bool MiniballMidasConverter::ProcessCurrentBlock( long nblock ) {
 	ProcessBlockHeader( nblock );
 
 	// Process the main block data until terminator found
-	data = (ULong64_t *)(block_data);
 	ProcessBlockData( nblock );
 			
 	// Check once more after going over left overs....
@@ -591,13 +774,16 @@ bool MiniballMidasConverter::ProcessCurrentBlock( long nblock ) {
 }
 
 // Function to convert a block of data from DataSpy
-int MiniballMidasConverter::ConvertBlock( char *input_block, long nblock ) {
+int MiniballMidasConverter::ConvertBlock( const char *input_block, long nblock ) {
 	
-	// Get the header.
-	std::memmove( &block_header, &input_block[0], HEADER_SIZE );
-	
-	// Get the block
-	std::memmove( &block_data, &input_block[HEADER_SIZE], MAIN_SIZE );
+	// Blocks from DataSpy aren't part of a file, so each one
+	// works out its own swap mode
+	file_swap = 0;
+
+	// Point at the header and the data, the block is processed
+	// before the caller reuses the buffer, so no need to copy it
+	header = input_block;
+	data = (const ULong64_t *)( input_block + HEADER_SIZE );
 	
 	// Process the data
 	ProcessCurrentBlock( nblock );
@@ -606,6 +792,137 @@ int MiniballMidasConverter::ConvertBlock( char *input_block, long nblock ) {
 	
 }
 
+// Function to convert the blocks from first_block up to last_block of the
+// open input file. Returns the block to carry on from next time
+unsigned long MiniballMidasConverter::ConvertBlocks( unsigned long first_block,
+													 unsigned long last_block ) {
+
+	// Nothing before the first block is needed, which lets a compressed
+	// file skip ahead without keeping the data it passes
+	input_file.Release( (unsigned long long)first_block * DATA_BLOCK_SIZE );
+
+	// Work out the swap mode once for the file from its first block, so that
+	// every block is read the same way whichever thread it's done on. If the
+	// first block doesn't show it, each block has to work it out for itself
+	if( ( file_swap & SWAP_KNOWN ) == 0 && first_block < last_block )
+		file_swap = FindSwapMode( input_file.GetBlock( (unsigned long long)first_block * DATA_BLOCK_SIZE,
+													   DATA_BLOCK_SIZE ) );
+
+	// Start the worker threads to prepare the blocks in parallel
+	if( nthreads > 1 ) StartWorkers( first_block, last_block );
+
+	unsigned long nblock;
+	for( nblock = first_block; nblock < last_block; nblock++ ){
+		
+		// Take one block each time and analyze it.
+		if( nblock % 200 == 0 || nblock+1 == last_block ) {
+			
+			// Percent complete, we don't know how many blocks
+			// there are in a compressed file until we get to the end
+			float percent = (float)(nblock+1)*100.0/(float)last_block;
+			if( input_file.IsCompressed() ) percent = input_file.GetProgress();
+			
+			// Progress bar in GUI
+			if( _prog_ ){
+				
+				prog->SetPosition( percent );
+				gSystem->ProcessEvents();
+
+			}
+			
+			// Progress bar in terminal
+			std::cout << " " << std::setw(8) << std::setprecision(4);
+			std::cout << percent << "%\r";
+			std::cout.flush();
+
+		}
+		
+		// Point at the header and the block inside the mapped file
+		header = input_file.GetBlock( (unsigned long long)nblock * DATA_BLOCK_SIZE,
+									  DATA_BLOCK_SIZE );
+		if( !header ) break;
+		data = (const ULong64_t *)( header + HEADER_SIZE );
+
+		// Wait for the worker threads to prepare this block
+		if( nthreads > 1 ) {
+
+			MiniballMidasBlock &blk = prepared[ nblock % prepared.size() ];
+			std::unique_lock<std::mutex> lock( prepared_mutex );
+			prepared_cv.wait( lock, [&]{ return blk.ready && blk.nblock == nblock; } );
+			prepared_block = &blk;
+
+		}
+
+		// Process current block. If it's the end, stop.
+		StartIndexEntry( (unsigned long long)nblock * DATA_BLOCK_SIZE, nblock );
+		bool good_block = ProcessCurrentBlock( nblock );
+		FinishIndexEntry();
+
+		// Give the slot back to the worker threads
+		if( prepared_block ) {
+
+			std::unique_lock<std::mutex> lock( prepared_mutex );
+			prepared_block->ready = false;
+			prepared_block = nullptr;
+			next_process = nblock + 1;
+			lock.unlock();
+			prepared_cv.notify_all();
+
+		}
+
+		// We're finished with this block now
+		input_file.Release( (unsigned long long)( nblock + 1 ) * DATA_BLOCK_SIZE );
+
+		// Don't come back to a bad block next time
+		if( !good_block ) {
+
+			nblock++;
+			break;
+
+		}
+		
+	} // loop - nblock < last_block
+	
+	if( nthreads > 1 ) StopWorkers();
+
+	return nblock;
+
+}
+
+// Function to follow a file that is still being written. Each call only
+// converts the blocks that were added since the last one. The file stays
+// open and the decoder state is kept, so nothing is lost between calls
+int MiniballMidasConverter::FollowFile( std::string input_file_name ) {
+
+	// Open the file the first time, or if it changed
+	if( !input_file.IsOpen() || input_file.GetFileName() != input_file_name ) {
+
+		if( !input_file.Open( input_file_name ) ){
+			
+			std::cout << "Cannot open " << input_file_name << std::endl;
+			return -1;
+			
+		}
+
+		std::cout << "Following MIDAS file: " << input_file_name << std::endl;
+		StartFile();
+		follow_block = 0;
+		file_swap = 0;
+
+	}
+
+	// Otherwise see if there's anything new
+	else input_file.Refresh();
+
+	// Convert the new blocks, but only complete ones
+	unsigned long BLOCKS_NUM = input_file.GetSize() / DATA_BLOCK_SIZE;
+	if( BLOCKS_NUM > follow_block )
+		follow_block = ConvertBlocks( follow_block, BLOCKS_NUM );
+
+	return follow_block;
+
+}
+
 // Function to run the conversion for a single file
 int MiniballMidasConverter::ConvertFile( std::string input_file_name,
 							 unsigned long start_block,
@@ -614,9 +931,8 @@ int MiniballMidasConverter::ConvertFile( std::string input_file_name,
 	// Uncomment to force only a few blocks - debug
 	//end_block = 1000;
 	
-	// Read the file.
-	std::ifstream input_file( input_file_name, std::ios::in|std::ios::binary );
-	if( !input_file.is_open() ){
+	// Map the file into memory
+	if( !input_file.Open( input_file_name ) ){
 		
 		std::cout << "Cannot open " << input_file_name << std::endl;
 		return -1;
@@ -629,28 +945,30 @@ int MiniballMidasConverter::ConvertFile( std::string input_file_name,
 	
 	// Reset counters to zero for every file
 	StartFile();
+	file_swap = 0;
 
 	// Calculate the size of the file.
-	input_file.seekg( 0, input_file.end );
-	unsigned long long size_end = input_file.tellg();
-	input_file.seekg( 0, input_file.beg );
-	unsigned long long size_beg = input_file.tellg();
-	unsigned long long FILE_SIZE = size_end - size_beg;
+	unsigned long long FILE_SIZE = input_file.GetSize();
 	
 	// Calculate the number of blocks in the file.
+	// For a compressed file we find out when we get to the end
 	unsigned long BLOCKS_NUM = FILE_SIZE / DATA_BLOCK_SIZE;
+	if( input_file.IsCompressed() ) BLOCKS_NUM = ULONG_MAX;
 	
 	// a sanity check for file size...
-	if( FILE_SIZE % DATA_BLOCK_SIZE != 0 ){
+	if( !input_file.IsCompressed() && FILE_SIZE % DATA_BLOCK_SIZE != 0 ){
 		
 		std::cout << " *WARNING* " << __PRETTY_FUNCTION__;
 		std::cout << "\tMissing data blocks?" << std::endl;
 
 	}
 	
-	sslogs << "\t File size = " << FILE_SIZE << std::endl;
+	if( input_file.IsCompressed() )
+		sslogs << "\t File size = unknown, compressed" << std::endl;
+	else sslogs << "\t File size = " << FILE_SIZE << std::endl;
 	sslogs << "\tBlock size = " << DATA_BLOCK_SIZE << std::endl;
-	sslogs << "\t  N blocks = " << BLOCKS_NUM << std::endl;
+	if( !input_file.IsCompressed() )
+		sslogs << "\t  N blocks = " << BLOCKS_NUM << std::endl;
 
 	std::cout << sslogs.str() << std::endl;
 	sslogs.str( std::string() ); // clean up
@@ -660,49 +978,173 @@ int MiniballMidasConverter::ConvertFile( std::string input_file_name,
 	// The information is split into 2 words of 32 bits (4 byte).
 	// We will collect the data in 64 bit words and split later
 	
-	// Loop over all the blocks.
-	for( unsigned long nblock = 0; nblock < BLOCKS_NUM ; nblock++ ){
-		
-		// Take one block each time and analyze it.
-		if( nblock % 200 == 0 || nblock+1 == BLOCKS_NUM ) {
-			
-			// Percent complete
-			float percent = (float)(nblock+1)*100.0/(float)BLOCKS_NUM;
-			
-			// Progress bar in GUI
-			if( _prog_ ){
-				
-				prog->SetPosition( percent );
-				gSystem->ProcessEvents();
+	// Stop after the end block, if there is one
+	unsigned long last_block = BLOCKS_NUM;
+	if( end_block >= 0 && (unsigned long)end_block + 1 < last_block )
+		last_block = end_block + 1;
 
-			}
-			
-			// Progress bar in terminal
-			std::cout << " " << std::setw(8) << std::setprecision(4);
-			std::cout << percent << "%\r";
-			std::cout.flush();
+	// Write an index of the blocks when we convert the whole file
+	if( start_block == 0 && end_block < 0 ) StartIndex( input_file_name );
 
-		}
-		
-		
-		// Get the header.
-		input_file.read( (char*)&block_header, HEADER_SIZE );
-		// Get the block
-		input_file.read( (char*)&block_data, MAIN_SIZE );
+	// If we start part way through, get the decoder state from the index
+	else if( start_block > 0 ) {
 
+		MiniballDataIndex input_index;
+		unsigned long first, last;
+		if( input_index.Read( MiniballDataIndex::GetIndexName( input_file_name ) ) &&
+		    input_index.FindBlockRange( start_block, start_block, first, last ) )
+			RestoreIndexEntry( input_index.GetEntry( first ) );
 
-		// Check if we are before the start block or after the end block
-		if( nblock < start_block || ( (long)nblock > end_block && end_block > 0 ) )
-			continue;
+		else {
 
+			std::cout << " *WARNING* No index for block " << start_block;
+			std::cout << ", timestamps are wrong until the next sync" << std::endl;
 
-		// Process current block. If it's the end, stop.
-		if( !ProcessCurrentBlock( nblock ) ) break;
-		
-	} // loop - nblock < BLOCKS_NUM
+		}
+
+	}
+
+	// Loop over all the blocks, we can jump straight to the start block
+	ConvertBlocks( start_block, last_block );
+	FinishIndex();
+
+	// Now we know how big a compressed file was
+	if( input_file.IsCompressed() )
+		BLOCKS_NUM = input_file.GetSize() / DATA_BLOCK_SIZE;
 	
-	input_file.close();
+	PrintWaitTime( input_file.GetWaitTime() );
+	input_file.Close();
 
 	return BLOCKS_NUM;
 	
 }
+
+// Function to prepare a block on a worker thread. Only the things that
+// don't depend on the previous blocks are done here: swapping the words
+// in to the right order, unpacking the traces and running the MWD
+void MiniballMidasConverter::PrepareBlock( const char *input_block, MiniballMidasBlock &blk ){
+
+	// Past the end of a compressed file, there's nothing to do
+	blk.ntraces = 0;
+	blk.words = nullptr;
+	if( !input_block ) return;
+
+	// We only need the length from the header
+	UInt_t data_len =
+	(input_block[20] & 0xFF) | (input_block[21]& 0xFF) << 8 |
+	(input_block[22] & 0xFF) << 16  | (input_block[23]& 0xFF) << 24 ;
+	const ULong64_t *input_data = (const ULong64_t *)( input_block + HEADER_SIZE );
+
+	// Swap all of the words, or point straight at them if they're fine already,
+	// with the swap mode of the file if we know it, the same as the output does
+	Int_t mode = ( file_swap & SWAP_KNOWN ) ? file_swap : FindSwapMode( input_block );
+	blk.buffer.resize( WORD_SIZE );
+	blk.words = SwapBlockData( input_data, blk.buffer.data(), mode );
+
+	// Walk through the words in the same way as ProcessBlockData to find the traces
+	for( UInt_t i = 0; i < WORD_SIZE; i++ ) {
+
+		UInt_t w0 = ( blk.words[i] & 0xFFFFFFFF00000000 ) >> 32;
+		UInt_t w1 = ( blk.words[i] & 0x00000000FFFFFFFF );
+
+		// Stop at the trailer or the end of the data
+		if( w0 == 0xFFFFFFFF || w0 == 0x5E5E5E5E ||
+		    w1 == 0xFFFFFFFF || w1 == 0x5E5E5E5E ||
+		    i >= data_len/sizeof(ULong64_t) ) break;
+
+		// Only trace headers are interesting here
+		if( ( ( w0 >> 30 ) & 0x3 ) != 0x1 ) continue;
+
+		// Bad channels are left for the ProcessTraceData to complain about
+		unsigned int ADCchanIdent = (w0 >> 16) & 0x0FFF;
+		unsigned char sfp = (ADCchanIdent >> 10) & 0x0003;
+		unsigned char board = (ADCchanIdent >> 6) & 0x000F;
+		unsigned char ch = ADCchanIdent & 0x000F;
+		if( sfp >= set->GetNumberOfFebexSfps() ||
+		    board >= set->GetNumberOfFebexBoards() ||
+		    ch >= set->GetNumberOfFebexChannels() ) continue;
+
+		// Unpack the trace and do the MWD
+		if( blk.ntraces == blk.traces.size() ) blk.traces.emplace_back();
+		MiniballMidasTrace &trace = blk.traces[blk.ntraces++];
+		trace.start = i;
+		trace.end = UnpackTrace( blk.words, i, w0 & 0xFFFF, trace.samples );
+		FebexMWD mwd = cal->DoMWD( sfp, board, ch, trace.samples );
+		trace.mwd_energy = mwd.GetEnergies();
+
+		i = trace.end;
+
+	}
+
+	return;
+
+}
+
+// Loop for the worker threads, taking the next block until there are none left
+void MiniballMidasConverter::PrepareWorker(){
+
+	while( true ) {
+
+		// Take the next block, but don't get too far ahead of the output
+		std::unique_lock<std::mutex> lock( prepared_mutex );
+		prepared_cv.wait( lock, [&]{
+			return stop_workers || next_prepare >= last_prepare ||
+				   next_prepare < next_process + prepared.size();
+		} );
+		if( stop_workers || next_prepare >= last_prepare ) return;
+		unsigned long nblock = next_prepare++;
+		MiniballMidasBlock &blk = prepared[ nblock % prepared.size() ];
+		lock.unlock();
+
+		// Prepare the block
+		PrepareBlock( input_file.GetBlock( (unsigned long long)nblock * DATA_BLOCK_SIZE,
+										   DATA_BLOCK_SIZE ), blk );
+
+		// Tell the output it's ready
+		lock.lock();
+		blk.nblock = nblock;
+		blk.ready = true;
+		lock.unlock();
+		prepared_cv.notify_all();
+
+	}
+
+}
+
+// Start the worker threads for blocks from first_block up to last_block
+void MiniballMidasConverter::StartWorkers( unsigned long first_block, unsigned long last_block ){
+
+	// A few blocks per thread in flight is enough to keep them all busy
+	prepared.resize( 4 * nthreads );
+	for( unsigned int i = 0; i < prepared.size(); ++i ) {
+		prepared[i].ready = false;
+		prepared[i].ntraces = 0;
+	}
+
+	next_prepare = first_block;
+	next_process = first_block;
+	last_prepare = last_block;
+	stop_workers = false;
+
+	for( unsigned int i = 0; i < nthreads; ++i )
+		workers.emplace_back( &MiniballMidasConverter::PrepareWorker, this );
+
+	return;
+
+}
+
+// Stop the worker threads and wait for them to finish
+void MiniballMidasConverter::StopWorkers(){
+
+	std::unique_lock<std::mutex> lock( prepared_mutex );
+	stop_workers = true;
+	lock.unlock();
+	prepared_cv.notify_all();
+
+	for( unsigned int i = 0; i < workers.size(); ++i )
+		workers[i].join();
+	workers.clear();
+
+	return;
+
+}
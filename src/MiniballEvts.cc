@@ -14,6 +14,7 @@ ClassImp(MiniballEvts)
 // --------------- //
 void MiniballEvts::ClearEvt() {
 	
+	// Keep the space for the next event
 	gamma_event.clear();
 	gamma_ab_event.clear();
 	particle_event.clear();
@@ -21,13 +22,6 @@ void MiniballEvts::ClearEvt() {
 	spede_event.clear();
 	ic_event.clear();
 
-	std::vector<GammaRayEvt>().swap(gamma_event);
-	std::vector<GammaRayAddbackEvt>().swap(gamma_ab_event);
-	std::vector<ParticleEvt>().swap(particle_event);
-	std::vector<BeamDumpEvt>().swap(bd_event);
-	std::vector<SpedeEvt>().swap(spede_event);
-	std::vector<IonChamberEvt>().swap(ic_event);
-
 	ebis = 0;
 	t1 = 0;
 	sc = 0;
@@ -126,9 +120,6 @@ void IonChamberEvt::ClearEvt() {
 	energy.clear();
 	id.clear();
 	
-	std::vector<float>().swap(energy);
-	std::vector<unsigned char>().swap(id);
-
 	detime = 0;
 	etime = 0;
 	
@@ -83,6 +83,22 @@ void MiniballSettings::ReadSettings() {
 	block_size			= config->GetValue( "DataBlockSize", 0x10000 );
 	flag_febex_only		= config->GetValue( "FebexOnlyData", true );
 
+	// Hits are time ordered within this window as they are converted
+	sort_window			= config->GetValue( "SortWindow", 1e8 );
+	sort_memory			= config->GetValue( "SortMemory", 1024. );
+
+	// Sorted hits can be in data packets or in flat branches
+	flag_flat_sort		= config->GetValue( "FlatSortedTree", false );
+
+	// Sorted hits can also go to a binary file for the event builder
+	flag_hit_file		= config->GetValue( "WriteHitFile", false );
+	hit_file_level		= config->GetValue( "HitFileCompression", 0 );
+	flag_sorted_tree	= config->GetValue( "WriteSortedTree", true );
+
+	// Traces are used for the MWD, but don't have to be written out
+	trace_write			= config->GetValue( "WriteTraces", true );
+	trace_downscale		= config->GetValue( "TraceDownscale", 1 );
+
 	
 	
 	// Electronics mapping
@@ -96,6 +112,7 @@ void MiniballSettings::ReadSettings() {
 	bd_det.resize( n_febex_sfp );
 	spede_seg.resize( n_febex_sfp );
 	ic_layer.resize( n_febex_sfp );
+	trace_ch.resize( n_febex_sfp );
 
 	for( unsigned int i = 0; i < n_febex_sfp; ++i ){
 
@@ -109,6 +126,7 @@ void MiniballSettings::ReadSettings() {
 		bd_det[i].resize( n_febex_board );
 		spede_seg[i].resize( n_febex_board );
 		ic_layer[i].resize( n_febex_board );
+		trace_ch[i].resize( n_febex_board );
 
 		for( unsigned int j = 0; j < n_febex_board; ++j ){
 
@@ -122,6 +140,7 @@ void MiniballSettings::ReadSettings() {
 			bd_det[i][j].resize( n_febex_ch );
 			spede_seg[i][j].resize( n_febex_ch );
 			ic_layer[i][j].resize( n_febex_ch );
+			trace_ch[i][j].resize( n_febex_ch );
 
 			for( unsigned int k = 0; k < n_febex_ch; ++k ){
 
@@ -135,6 +154,7 @@ void MiniballSettings::ReadSettings() {
 				bd_det[i][j][k]     = -1;
 				spede_seg[i][j][k]  = -1;
 				ic_layer[i][j][k]   = -1;
+				trace_ch[i][j][k]	= config->GetValue( Form( "Febex_%d_%d_%d.WriteTrace", i, j, k ), trace_write );
 
 			} // k: febex ch
 			
@@ -368,11 +388,88 @@ void MiniballSettings::ReadSettings() {
 	} // i: IonChamber detector
 	
 	
+	// Put all of the maps together for looking up hits
+	MakeChannelMap();
+
 	// Finished
 	delete config;
 	
 }
 
+void MiniballSettings::MakeChannelMap() {
+
+	/// The packed channel map has one small entry for each channel, so it
+	/// stays in the cache while building events. Each channel is the first
+	/// of Miniball, CD, SPEDE, beam dump or IonChamber that it's mapped to
+	no_channel.type = CHANNEL_NONE;
+	no_channel.flags = 0;
+	for( unsigned int l = 0; l < 4; ++l ) no_channel.id[l] = -1;
+
+	channel_map.assign( n_febex_sfp * n_febex_board * n_febex_ch, no_channel );
+
+	for( unsigned int i = 0; i < n_febex_sfp; ++i ){
+
+		for( unsigned int j = 0; j < n_febex_board; ++j ){
+
+			for( unsigned int k = 0; k < n_febex_ch; ++k ){
+
+				MiniballChannel &chan = channel_map[ ( i * n_febex_board + j ) * n_febex_ch + k ];
+
+				if( mb_cluster[i][j][k] >= 0 ) {
+
+					chan.type = CHANNEL_MINIBALL;
+					chan.id[0] = mb_cluster[i][j][k];
+					chan.id[1] = mb_crystal[i][j][k];
+					chan.id[2] = mb_segment[i][j][k];
+
+				}
+
+				else if( cd_det[i][j][k] >= 0 ) {
+
+					chan.type = CHANNEL_CD;
+					chan.id[0] = cd_det[i][j][k];
+					chan.id[1] = cd_sector[i][j][k];
+					chan.id[2] = cd_side[i][j][k];
+					chan.id[3] = cd_strip[i][j][k];
+
+				}
+
+				else if( spede_seg[i][j][k] >= 0 ) {
+
+					chan.type = CHANNEL_SPEDE;
+					chan.id[0] = spede_seg[i][j][k];
+
+				}
+
+				else if( bd_det[i][j][k] >= 0 ) {
+
+					chan.type = CHANNEL_BEAMDUMP;
+					chan.id[0] = bd_det[i][j][k];
+
+				}
+
+				else if( ic_layer[i][j][k] >= 0 ) {
+
+					chan.type = CHANNEL_IONCHAMBER;
+					chan.id[0] = ic_layer[i][j][k];
+
+				}
+
+				if( trace_ch[i][j][k] ) chan.flags |= CHANNEL_TRACE;
+				if( i == pulser_sfp && j == pulser_board && k == pulser_ch ) chan.flags |= CHANNEL_PULSER;
+				if( i == ebis_sfp && j == ebis_board && k == ebis_ch ) chan.flags |= CHANNEL_EBIS;
+				if( i == t1_sfp && j == t1_board && k == t1_ch ) chan.flags |= CHANNEL_T1;
+
+			} // k: febex ch
+
+		} // j: febex board
+
+	} // i: febex sfp
+
+	return;
+
+}
+
 
 bool MiniballSettings::IsMiniball( unsigned int sfp, unsigned int board, unsigned int ch ) {
 	
@@ -383,7 +480,7 @@ bool MiniballSettings::IsMiniball( unsigned int sfp, unsigned int board, unsigne
 }
 
 int MiniballSettings::GetMiniballID( unsigned int sfp, unsigned int board, unsigned int ch,
-							 std::vector<std::vector<std::vector<int>>> vector ) {
+							 const std::vector<std::vector<std::vector<int>>> &vector ) {
 	
 	/// Return the Miniball ID by the FEBEX SFP, Board number and Channel number
 	if( sfp < n_febex_sfp && board < n_febex_board && ch < n_febex_ch )
@@ -410,7 +507,7 @@ bool MiniballSettings::IsCD( unsigned int sfp, unsigned int board, unsigned int
 }
 
 int MiniballSettings::GetCDID( unsigned int sfp, unsigned int board, unsigned int ch,
-					  std::vector<std::vector<std::vector<int>>> vector ) {
+					  const std::vector<std::vector<std::vector<int>>> &vector ) {
 	
 	/// Return the CD ID by the FEBEX SFP, Board number and Channel number
 	if( sfp < n_febex_sfp && board < n_febex_board && ch < n_febex_ch )